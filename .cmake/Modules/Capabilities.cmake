@@ -10,3 +10,7 @@ check_prototype_definition(
   NULL
   "string.h"
   HAVE_STRTOK_S)
+
+include(CheckIncludeFile)
+
+check_include_file(linux/perf_event.h HAVE_LINUX_PERF_EVENT_H)
@@ -0,0 +1,73 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CRITERION_BENCH_H_
+# define CRITERION_BENCH_H_
+
+# ifdef __cplusplus
+#  include <cstddef>
+using std::size_t;
+# else
+#  include <stdbool.h>
+#  include <stddef.h>
+# endif
+
+# include "criterion.h"
+# include "stats.h"
+
+# if defined(_MSC_VER) && !defined(__clang__)
+#  include <intrin.h>
+# endif
+
+CR_BEGIN_C_API
+
+CR_API bool cr_bench_next_(size_t *iterations);
+CR_API void cr_bench_escape_(const volatile void *ptr);
+
+CR_API void cr_bench_pause(void);
+CR_API void cr_bench_resume(void);
+CR_API void cr_bench_throughput(enum criterion_bench_unit unit, size_t amount);
+
+CR_END_C_API
+
+# define Bench(...) CR_EXPAND(Bench_(__VA_ARGS__, .sentinel_ = 0))
+# define Bench_(Category, Name, ...) \
+    CR_EXPAND(CR_TEST_BASE_(CR_TEST_BENCH, Category, Name, __VA_ARGS__))
+
+// Runs the following statement as many times as needed to measure it.
+# define cr_bench_loop()                                                        \
+    for (size_t cr_bench_n_ = 0; cr_bench_next_(&cr_bench_n_);)                \
+        for (; cr_bench_n_ > 0; --cr_bench_n_)
+
+# if defined(__GNUC__) || defined(__clang__)
+#  define cr_do_not_optimize(Value) \
+    __asm__ __volatile__("" : : "r,m"(Value) : "memory")
+#  define cr_clobber_memory() \
+    __asm__ __volatile__("" : : : "memory")
+# else
+#  define cr_do_not_optimize(Value) \
+    cr_bench_escape_((const volatile void *) &(Value))
+#  define cr_clobber_memory() _ReadWriteBarrier()
+# endif
+
+#endif /* !CRITERION_BENCH_H_ */
@@ -48,11 +48,13 @@
 
 # define Test(...) CR_EXPAND(Test_(__VA_ARGS__, .sentinel_ = 0))
 # define Test_(Category, Name, ...)                                            \
+    CR_EXPAND(CR_TEST_BASE_(CR_TEST_NORMAL, Category, Name, __VA_ARGS__))
+# define CR_TEST_BASE_(Kind, Category, Name, ...)                              \
     CR_TEST_PROTOTYPE_(Category, Name);                                        \
     struct criterion_test_extra_data CR_IDENTIFIER_(Category, Name, extra) =   \
         CR_EXPAND(CRITERION_MAKE_STRUCT(struct criterion_test_extra_data,      \
             .lang_ = CR_LANG,                                                  \
-            .kind_ = CR_TEST_NORMAL,                                           \
+            .kind_ = Kind,                                                     \
             .param_ = (struct criterion_test_params(*)(void)) NULL,            \
             .identifier_ = #Category "/" #Name,                                \
             .file_    = __FILE__,                                              \
@@ -43,6 +43,34 @@ typedef enum {
 
 typedef void (*f_report_hook)();
 
+/*
+ * A hook registered at runtime, called with the parameter of its phase,
+ * as described for ReportHook, and the user data it was registered with.
+ */
+typedef void (*f_criterion_hook)(void *data, void *userdata);
+
+CR_BEGIN_C_API
+
+/**
+ * Registers a hook for the given phase, for instance from a plugin loaded
+ * at runtime. It must be registered before the phase happens in the runner,
+ * and is called after the hooks declared with ReportHook.
+ *
+ * Returns 1 on success, or 0 if the phase or the callback is invalid.
+ */
+CR_API int criterion_register_hook(e_report_status kind,
+        f_criterion_hook callback, void *userdata);
+
+/**
+ * Removes a hook registered with criterion_register_hook.
+ *
+ * Returns 1 on success, or 0 if no such hook was registered.
+ */
+CR_API int criterion_unregister_hook(e_report_status kind,
+        f_criterion_hook callback, void *userdata);
+
+CR_END_C_API
+
 # define CR_HOOK_IDENTIFIER_(Suffix) CR_HOOK_IDENTIFIER__(__LINE__, Suffix)
 # define CR_HOOK_IDENTIFIER__(Line, Suffix) CR_HOOK_IDENTIFIER___(Line, Suffix)
 # define CR_HOOK_IDENTIFIER___(Line, Suffix) hook_l ## Line ## _ ## Suffix
@@ -48,6 +48,7 @@ enum criterion_logging_prefix {
     CRITERION_LOGGING_PREFIX_PASS,
     CRITERION_LOGGING_PREFIX_FAIL,
     CRITERION_LOGGING_PREFIX_ERR,
+    CRITERION_LOGGING_PREFIX_BENCH,
 };
 
 struct criterion_prefix_data {
@@ -84,6 +85,7 @@ extern const struct criterion_prefix_data g_criterion_logging_prefixes[];
 # define CRITERION_PREFIX_PASS   (&g_criterion_logging_prefixes[CRITERION_LOGGING_PREFIX_PASS  ])
 # define CRITERION_PREFIX_FAIL   (&g_criterion_logging_prefixes[CRITERION_LOGGING_PREFIX_FAIL  ])
 # define CRITERION_PREFIX_ERR    (&g_criterion_logging_prefixes[CRITERION_LOGGING_PREFIX_ERR   ])
+# define CRITERION_PREFIX_BENCH  (&g_criterion_logging_prefixes[CRITERION_LOGGING_PREFIX_BENCH ])
 
 CR_API void criterion_vlog(enum criterion_logging_level level, const char *msg, va_list args);
 
@@ -117,16 +119,21 @@ struct criterion_output_provider {
     void (*log_post_fini    )(struct criterion_test_stats *stats);
     void (*log_post_suite   )(struct criterion_suite_stats *stats);
     void (*log_post_all     )(struct criterion_global_stats *stats);
+    void (*log_test_cancel  )(struct criterion_test_stats *stats);
 };
 
 extern struct criterion_output_provider normal_logging;
 extern struct criterion_output_provider tap_logging;
 extern struct criterion_output_provider xml_logging;
+extern struct criterion_output_provider json_logging;
+extern struct criterion_output_provider binary_logging;
 
 CR_END_C_API
 
 #define CR_NORMAL_LOGGING (&normal_logging)
 #define CR_TAP_LOGGING    (&tap_logging)
 #define CR_XML_LOGGING    (&xml_logging)
+#define CR_JSON_LOGGING   (&json_logging)
+#define CR_BINARY_LOGGING (&binary_logging)
 
 #endif /* !CRITERION_LOGGING_H_ */
@@ -27,6 +27,17 @@
 # include <stdbool.h>
 # include "logging.h"
 
+enum criterion_fail_fast_scope {
+    CR_FAIL_FAST_RUN,   // cancel the whole run after the first failure
+    CR_FAIL_FAST_SUITE, // cancel the rest of the suite of the failed test
+    CR_FAIL_FAST_PARAM, // cancel the other instances of a parameterized test
+};
+
+enum criterion_summary {
+    CR_SUMMARY_NONE,
+    CR_SUMMARY_PERF,    // where the time of the run went
+};
+
 struct criterion_options {
     enum criterion_logging_level logging_threshold;
     struct criterion_output_provider *output_provider;
@@ -38,6 +49,27 @@ struct criterion_options {
     bool short_filename;
     size_t jobs;
     bool measure_time;
+    const char *perf_counters;
+    double bench_time;
+    size_t bench_samples;
+    const char *bench_save;
+    const char *bench_compare;
+    double bench_threshold;
+    bool pin_workers;
+    const char *cpus;
+    size_t reserved_cpus;
+    double timeout;
+    enum criterion_fail_fast_scope fail_fast_scope;
+    bool adaptive_jobs;
+    size_t memory_limit;
+    double cpu_quota;
+    enum criterion_isolation isolation;
+    bool no_fork;
+    bool spawn_workers;
+    size_t async_hooks;
+    const char *metrics_socket;
+    const char *trace;
+    enum criterion_summary summary;
 };
 
 CR_BEGIN_C_API
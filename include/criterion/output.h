@@ -0,0 +1,56 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef CRITERION_OUTPUT_H_
+# define CRITERION_OUTPUT_H_
+
+# include "common.h"
+# include "logging.h"
+
+CR_BEGIN_C_API
+
+/**
+ * Registers an output provider under the given name, making it usable
+ * with criterion_add_output and the --output switch.
+ *
+ * Returns 1 on success, or 0 if the name is already taken.
+ */
+CR_API int criterion_register_output_provider(const char *name,
+        struct criterion_output_provider *provider);
+
+/**
+ * Adds an output to the run, on top of criterion_options.output_provider
+ * which always reports on the standard error.
+ *
+ * `path` may be NULL, "" or "-" for the standard error, "fd:N" for the
+ * already-open file descriptor N, or the path of a file to truncate.
+ * Adding the same provider twice for the same destination has no effect.
+ *
+ * Returns 1 on success, or 0 if the provider is unknown or the destination
+ * could not be opened.
+ */
+CR_API int criterion_add_output(const char *provider, const char *path);
+
+CR_END_C_API
+
+#endif /* !CRITERION_OUTPUT_H_ */
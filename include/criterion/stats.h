@@ -24,6 +24,11 @@
 #ifndef CRITERION_STATS_H_
 # define CRITERION_STATS_H_
 
+# ifdef __cplusplus
+#  include <cstdint>
+# else
+#  include <stdint.h>
+# endif
 # include "types.h"
 
 struct criterion_assert_stats {
@@ -35,6 +40,113 @@ struct criterion_assert_stats {
     struct criterion_assert_stats *next;
 };
 
+/*
+ * Monotonic timestamps in nanoseconds of each phase of a test, or 0 when
+ * the phase was not reached or time measurements are disabled.
+ */
+struct criterion_test_timestamps {
+    uint64_t spawn;         // the runner starts the worker
+    uint64_t pre_init;      // the worker starts running the fixtures
+    uint64_t pre_test;      // the test body starts
+    uint64_t post_test;     // the test body ends
+    uint64_t post_fini;     // the fixtures are done
+    uint64_t exit;          // the runner is notified that the worker exited
+    uint64_t reap;          // the runner handles the worker termination
+};
+
+// Durations in nanoseconds between the test phases
+struct criterion_phase_times {
+    uint64_t startup;       // spawn -> pre_init
+    uint64_t init;          // pre_init -> pre_test
+    uint64_t test;          // pre_test -> post_test
+    uint64_t fini;          // post_test -> post_fini
+    uint64_t exit;          // post_fini -> exit
+    uint64_t reap;          // exit -> reap
+};
+
+/*
+ * Resources used by the worker process of a test, collected when it is
+ * reaped. Fields that are not supported by the platform are left to 0,
+ * such as max_rss on Windows.
+ */
+struct criterion_resource_usage {
+    uint64_t user_time;             // CPU time in user mode, in nanoseconds
+    uint64_t system_time;           // CPU time in kernel mode, in nanoseconds
+    uint64_t max_rss;               // peak resident set size, in bytes
+    uint64_t minor_faults;
+    uint64_t major_faults;
+    uint64_t voluntary_switches;
+    uint64_t involuntary_switches;
+    uint64_t read_bytes;            // bytes read through I/O syscalls
+    uint64_t write_bytes;           // bytes written through I/O syscalls
+    uint64_t memory_peak;           // peak memory usage of the cgroup of the
+                                    // test, in bytes, 0 if not measured
+    uint64_t throttled_time;        // time throttled by the CPU quota of the
+                                    // test, in nanoseconds, 0 if not measured
+                                    // or never throttled
+};
+
+enum criterion_perf_counter {
+    CR_PERF_CYCLES              = 1 << 0,
+    CR_PERF_INSTRUCTIONS        = 1 << 1,
+    CR_PERF_CACHE_REFERENCES    = 1 << 2,
+    CR_PERF_CACHE_MISSES        = 1 << 3,
+    CR_PERF_BRANCHES            = 1 << 4,
+    CR_PERF_BRANCH_MISSES       = 1 << 5,
+};
+
+/*
+ * Hardware performance counters measured over the test body, when enabled
+ * with --perf-counters. Only the counters set in `measured` are valid.
+ */
+struct criterion_perf_counters {
+    unsigned measured;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t cache_references;
+    uint64_t cache_misses;
+    uint64_t branches;
+    uint64_t branch_misses;
+};
+
+enum criterion_bench_unit {
+    CR_BENCH_NO_UNIT,
+    CR_BENCH_BYTES,
+    CR_BENCH_ITEMS,
+};
+
+/*
+ * Comparison of a benchmark with its baseline from --bench-compare. The
+ * changes are relative to the baseline, e.g. 0.05 when 5% slower.
+ */
+struct criterion_bench_comparison {
+    bool compared;          // false when the baseline has no such benchmark
+    double change;          // Hodges-Lehmann estimate
+    double change_low;      // 95% confidence interval of the change
+    double change_high;
+    double p_value;         // Mann-Whitney U test
+    bool regressed;
+};
+
+/*
+ * Results of a benchmark, with times in nanoseconds per iteration. The
+ * confidence interval is the distribution-free 95% interval of the median.
+ */
+struct criterion_bench_stats {
+    size_t samples;
+    size_t iterations;      // iterations per sample
+    double median;
+    double mad;             // median absolute deviation
+    double min;
+    double max;
+    double ci_low;
+    double ci_high;
+    enum criterion_bench_unit unit;
+    uint64_t throughput;    // units processed per iteration
+    double *sample_times;   // time per iteration of each sample
+    struct criterion_bench_comparison baseline;
+};
+
 struct criterion_test_stats {
     struct criterion_test *test;
     struct criterion_assert_stats *asserts;
@@ -48,6 +160,13 @@ struct criterion_test_stats {
     bool crashed;
     unsigned progress;
     const char *file;
+    struct criterion_test_timestamps timestamps;
+    struct criterion_phase_times phase_times;
+    struct criterion_resource_usage resource_usage;
+    struct criterion_perf_counters perf_counters;
+    struct criterion_bench_stats *bench;    // NULL unless a benchmark
+    bool cancelled;
+    bool oom_killed;
 
     struct criterion_test_stats *next;
 };
@@ -68,10 +187,28 @@ struct criterion_suite_stats {
     size_t tests_passed;
     size_t asserts_failed;
     size_t asserts_passed;
+    size_t tests_cancelled;
+    struct criterion_phase_times phase_times;
 
     struct criterion_suite_stats *next;
 };
 
+// Work done by the runner itself, in number of operations and nanoseconds
+struct criterion_runner_counter {
+    size_t calls;
+    uint64_t time;
+};
+
+struct criterion_runner_counters {
+    struct criterion_runner_counter hooks;      // report hooks
+    struct criterion_runner_counter hook_waits; // runner blocked on --async-hooks
+    struct criterion_runner_counter events;     // worker events handled
+    struct criterion_runner_counter spawns;     // workers forked or spawned
+    struct criterion_runner_counter reads;      // reads of the event pipe
+    struct criterion_runner_counter stats;      // events pushed to the stats
+    struct criterion_runner_counter logs;       // output provider calls
+};
+
 struct criterion_global_stats {
     struct criterion_suite_stats *suites;
     size_t nb_suites;
@@ -83,6 +220,12 @@ struct criterion_global_stats {
     size_t tests_passed;
     size_t asserts_failed;
     size_t asserts_passed;
+    size_t tests_cancelled;
+    struct criterion_phase_times phase_times;
+    uint64_t wall_time;
+    struct criterion_runner_counters runner;
+    size_t jobs;            // peak number of workers running at once,
+                            // pooled threads and --no-fork included
 };
 
 #endif /* !CRITERION_STATS_H_ */
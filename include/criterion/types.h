@@ -43,6 +43,13 @@ enum criterion_language {
 enum criterion_test_kind {
     CR_TEST_NORMAL,
     CR_TEST_PARAMETERIZED,
+    CR_TEST_BENCH,
+};
+
+enum criterion_isolation {
+    CR_ISOLATION_DEFAULT,   // use the isolation of the suite, or the options
+    CR_ISOLATION_PROCESS,   // run the test in its own worker process
+    CR_ISOLATION_THREAD,    // run the test in a thread of a shared worker
 };
 
 struct criterion_test_params {
@@ -103,6 +110,10 @@ struct criterion_test_extra_data {
     const char *description;
     double timeout;
     void *data;
+    size_t memory_limit;
+    double cpu_quota;
+    enum criterion_isolation isolation;
+    bool snapshot_init;
 };
 
 struct criterion_test {
@@ -0,0 +1,62 @@
+#include <criterion/bench.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The loop body is the code being measured
+
+Bench(strings, strlen) {
+    const char *str = "The quick brown fox jumps over the lazy dog";
+
+    cr_bench_loop() {
+        size_t len = strlen(str);
+        cr_do_not_optimize(len);
+    }
+}
+
+// Throughput units turn the time per iteration into a rate
+
+static char src[4096];
+static char dst[4096];
+
+Bench(memory, memcpy) {
+    cr_bench_throughput(CR_BENCH_BYTES, sizeof (src));
+
+    cr_bench_loop() {
+        memcpy(dst, src, sizeof (src));
+        cr_clobber_memory();
+    }
+}
+
+// Benchmarks use fixtures just like tests, and the timer can be paused
+// around the per-iteration setup
+
+#define NB_INTS 256
+
+static int *ints;
+
+void setup_ints(void) {
+    ints = malloc(NB_INTS * sizeof (int));
+}
+
+void teardown_ints(void) {
+    free(ints);
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *) a, y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+Bench(sort, qsort, .init = setup_ints, .fini = teardown_ints) {
+    cr_bench_throughput(CR_BENCH_ITEMS, NB_INTS);
+
+    cr_bench_loop() {
+        cr_bench_pause();
+        for (int i = 0; i < NB_INTS; ++i)
+            ints[i] = (i * 7919) % NB_INTS;
+        cr_bench_resume();
+
+        qsort(ints, NB_INTS, sizeof (int), cmp_int);
+    }
+    cr_assert(ints[0] <= ints[NB_INTS - 1]);
+}
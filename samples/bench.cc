@@ -0,0 +1,44 @@
+#include <criterion/bench.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// The loop body is the code being measured
+
+Bench(strings, concat) {
+    std::string foo = "foo", bar = "bar";
+
+    cr_bench_loop() {
+        std::string str = foo + bar;
+        cr_do_not_optimize(str.size());
+    }
+}
+
+// Throughput units turn the time per iteration into a rate
+
+Bench(memory, vector_copy) {
+    std::vector<char> src(4096), dst(4096);
+    cr_bench_throughput(CR_BENCH_BYTES, src.size());
+
+    cr_bench_loop() {
+        std::copy(src.begin(), src.end(), dst.begin());
+        cr_clobber_memory();
+    }
+}
+
+// The timer can be paused around the per-iteration setup
+
+Bench(sort, std_sort) {
+    std::vector<int> ints(256);
+    cr_bench_throughput(CR_BENCH_ITEMS, ints.size());
+
+    cr_bench_loop() {
+        cr_bench_pause();
+        for (size_t i = 0; i < ints.size(); ++i)
+            ints[i] = (i * 7919) % ints.size();
+        cr_bench_resume();
+
+        std::sort(ints.begin(), ints.end());
+    }
+    cr_assert(std::is_sorted(ints.begin(), ints.end()));
+}
@@ -0,0 +1,35 @@
+#include <criterion/criterion.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int *table;
+
+// Runs once for the whole suite, whatever the number of tests
+void load_table(void) {
+    puts("Loading the table");
+    table = malloc(1024 * sizeof (int));
+    for (int i = 0; i < 1024; ++i)
+        table[i] = i * i;
+}
+
+void free_table(void) {
+    puts("Freeing the table");
+    free(table);
+}
+
+TestSuite(squares, .init = load_table, .fini = free_table, .snapshot_init = true);
+
+Test(squares, first) {
+    cr_assert_eq(table[2], 4);
+
+    // the other tests keep their own copy of the table
+    table[2] = 0;
+}
+
+Test(squares, second) {
+    cr_assert_eq(table[2], 4);
+}
+
+Test(squares, last) {
+    cr_assert_eq(table[1023], 1023 * 1023);
+}
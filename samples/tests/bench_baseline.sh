@@ -0,0 +1,4 @@
+#!/bin/sh
+./bench.c.bin --bench-time=0.05 --bench-save=bench-baseline.json --always-succeed
+./bench.c.bin --bench-time=0.05 --bench-compare=bench-baseline.json --always-succeed
+./bench.c.bin --bench-time=0.05 --bench-compare=bench-baseline.json --bench-threshold=0 --json --always-succeed
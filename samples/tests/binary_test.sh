@@ -0,0 +1,28 @@
+#!/bin/sh
+./simple.c.bin --binary --always-succeed
+./signal.c.bin --binary --always-succeed
+./asserts.c.bin --binary --always-succeed
+./more-suites.c.bin --binary --always-succeed
+./long-messages.c.bin --binary --always-succeed
+./description.c.bin --binary --always-succeed
+
+# walks the records, as documented in doc/output.rst, and checks their types
+# and the counts of the summary
+set -e
+./simple.c.bin --output=binary:fd:1 --always-succeed 2>/dev/null \
+    | od -A n -t u1 -v | awk '
+    function u32(i) {
+        return b[i] + b[i+1] * 256 + b[i+2] * 65536 + b[i+3] * 16777216
+    }
+    { for (i = 1; i <= NF; ++i) b[n++] = $i }
+    END {
+        for (i = 0; i < n; i += 4 + size) {
+            size = u32(i)
+            types = types b[i+4]
+            for (f = i + 5; f < i + 4 + size; f += 5 + u32(f + 1))
+                if (b[i+4] == 3 && (b[f] == 50 || b[f] == 51))
+                    counts = counts " " b[f] ":" u32(f + 5)
+        }
+        if (i != n || types != "1223" || counts != " 50:1 51:1")
+            exit 1
+    }'
@@ -1,2 +1,4 @@
 #!/bin/sh
 ./simple.c.bin --fail-fast --always-succeed
+./simple.c.bin --fail-fast=suite --always-succeed
+./simple.c.bin --fail-fast=param --always-succeed
@@ -0,0 +1,5 @@
+#!/bin/sh
+./simple.c.bin --isolation=thread --always-succeed
+./fixtures.c.bin --isolation=thread --always-succeed
+./signal.c.bin --isolation=thread --always-succeed
+./asserts.c.bin --isolation=thread --always-succeed
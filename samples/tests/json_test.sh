@@ -0,0 +1,17 @@
+#!/bin/sh
+./simple.c.bin --json --always-succeed
+./signal.c.bin --json --always-succeed
+./asserts.c.bin --json --always-succeed
+./more-suites.c.bin --json --always-succeed
+./long-messages.c.bin --json --always-succeed
+./description.c.bin --json --always-succeed
+
+# the records, as documented in doc/output.rst: the start, each test, then
+# the summary, one per line
+set -e
+json=$(./simple.c.bin --output=json:fd:1 --always-succeed 2>/dev/null)
+[ "$(echo "$json" | wc -l)" -eq 4 ]
+echo "$json" | head -n 1 | grep -q '^{"type":"start","version":"[^"]*","tests":2}$'
+echo "$json" | grep -q '^{"type":"test","suite":"misc","name":"failing","status":"FAILED",.*"asserts":{"passed":0,"failed":1},"failures":\[{"file":"[^"]*simple.c","line":4,"message":"The expression 0 is false."}\]}$'
+echo "$json" | grep -q '^{"type":"test","suite":"misc","name":"passing","status":"PASSED",.*"resources":{"user_time":[0-9]*,'
+echo "$json" | tail -n 1 | grep -q '^{"type":"summary","suites":1,"tests":2,"passed":1,"failed":1,"crashed":0,"skipped":0,"cancelled":0,"asserts":{"passed":1,"failed":1}'
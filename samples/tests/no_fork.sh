@@ -0,0 +1,4 @@
+#!/bin/sh
+./simple.c.bin --no-fork --always-succeed
+./fixtures.c.bin --no-fork --always-succeed
+CRITERION_NO_FORK=1 ./parameterized.c.bin --always-succeed
@@ -0,0 +1,4 @@
+#!/bin/sh
+./simple.c.bin --output=xml:- --output=json:fd:1 --always-succeed
+./asserts.c.bin --output=normal --output=tap:fd:1 --always-succeed
+./more-suites.c.bin --xml --output=normal --always-succeed
@@ -8,3 +8,7 @@
 ./simple.c.bin --pattern '[!azerty]assing'
 ./simple.c.bin --pattern '|pipe'
 ./simple.c.bin --pattern '\!(escaped'
+./simple.c.bin --pattern '*/passing' --pattern '*/failing'
+./simple.c.bin --exclude '*/passing'
+./simple.c.bin --pattern 'misc/*' --exclude '*/failing'
+! ./simple.c.bin --exclude '@(malformed'
@@ -0,0 +1,4 @@
+#!/bin/sh
+./simple.c.bin --spawn-workers --always-succeed
+./signal.c.bin --spawn-workers --always-succeed
+CRITERION_SPAWN_WORKERS=1 ./parameterized.c.bin --always-succeed
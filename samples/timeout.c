@@ -4,9 +4,19 @@
 # include <Windows.h>
 # define sleep(x) Sleep(x * 1000)
 #else
+# include <signal.h>
 # include <unistd.h>
 #endif
 
 Test(timeout, simple, .timeout = 1.) {
     sleep(10);
 }
+
+#ifndef _WIN32
+// the runner still stops tests that shield themselves from their timer
+Test(timeout, unstoppable, .timeout = 1.) {
+    signal(SIGPROF, SIG_IGN);
+    signal(SIGTERM, SIG_IGN);
+    sleep(10);
+}
+#endif
@@ -32,6 +32,12 @@
 # define INLINE
 #endif
 
+#ifdef _MSC_VER
+# define CR_THREAD_LOCAL __declspec(thread)
+#else
+# define CR_THREAD_LOCAL __thread
+#endif
+
 # define DEF(X, Y) ((X) ? (X) : (Y))
 
 #endif /* !COMMON_H_ */
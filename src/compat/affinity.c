@@ -0,0 +1,309 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _GNU_SOURCE
+#define CRITERION_LOGGING_COLORS
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "criterion/logging.h"
+#include "criterion/options.h"
+#include "string/i18n.h"
+#include "affinity.h"
+#include "processor.h"
+
+#ifdef __linux__
+# include <dirent.h>
+# include <sched.h>
+#endif
+
+typedef const char *const msg_t;
+
+static size_t current_slot;
+
+#ifdef __linux__
+
+#ifdef ENABLE_NLS
+static msg_t msg_shared_cpus = N_("%1$sWarning! There are more jobs than "
+        "CPUs to pin them to, so some of the workers will share a CPU.%2$s\n");
+#else
+static msg_t msg_shared_cpus = "%sWarning! There are more jobs than "
+        "CPUs to pin them to, so some of the workers will share a CPU.%s\n";
+#endif
+
+static bool restricted;     // workers must be kept on worker_set
+static cpu_set_t worker_set;
+static int *worker_cpus;    // CPU of each worker slot, when pinning
+static size_t nb_worker_cpus;
+
+/*
+ * Parses a CPU list as found in sysfs, e.g. "0-3,8,10-11".
+ * Returns 0 when the list is malformed.
+ */
+static int parse_cpu_list(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    while (*list && *list != '\n') {
+        char *end;
+        long first = strtol(list, &end, 10), last = first;
+        if (end == list || first < 0)
+            return 0;
+        if (*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list || last < first)
+                return 0;
+        }
+        if (last >= CPU_SETSIZE)
+            return 0;
+        for (long cpu = first; cpu <= last; ++cpu)
+            CPU_SET(cpu, set);
+
+        list = end;
+        if (*list == ',')
+            ++list;
+        else if (*list && *list != '\n')
+            return 0;
+    }
+    return 1;
+}
+
+static int read_cpu_list(const char *path, cpu_set_t *set) {
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+    char buf[4096];
+    int ok = fgets(buf, sizeof (buf), f) && parse_cpu_list(buf, set);
+    fclose(f);
+    return ok;
+}
+
+static int cpu_node(int cpu) {
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (!dir)
+        return 0;
+
+    int node = 0;
+    for (struct dirent *ent; (ent = readdir(dir)) != NULL;) {
+        int id;
+        if (sscanf(ent->d_name, "node%d", &id) != 1)
+            continue;
+
+        char path[128];
+        cpu_set_t set;
+        snprintf(path, sizeof (path),
+                "/sys/devices/system/node/node%d/cpulist", id);
+        if (read_cpu_list(path, &set) && CPU_ISSET(cpu, &set)) {
+            node = id;
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+// Whether the CPU is the first hardware thread of its core
+static bool is_first_thread(int cpu) {
+    char path[128];
+    cpu_set_t siblings;
+    snprintf(path, sizeof (path),
+            "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    if (!read_cpu_list(path, &siblings))
+        return true;
+    for (int c = 0; c < cpu; ++c)
+        if (CPU_ISSET(c, &siblings))
+            return false;
+    return true;
+}
+
+struct cpu_info {
+    int cpu;
+    int node;
+    bool first_thread;
+    size_t rank;            // rank of the CPU within its node and kind
+};
+
+static int cmp_cpu_info(const void *a, const void *b) {
+    const struct cpu_info *x = a, *y = b;
+    if (x->first_thread != y->first_thread)
+        return x->first_thread ? -1 : 1;
+    if (x->rank != y->rank)
+        return x->rank < y->rank ? -1 : 1;
+    return x->node - y->node;
+}
+
+/*
+ * Orders the worker CPUs so that consecutive slots land on different NUMA
+ * nodes, and on different physical cores before sharing one through SMT.
+ */
+static void order_worker_cpus(void) {
+    size_t count = CPU_COUNT(&worker_set);
+    struct cpu_info *infos = malloc(count * sizeof (*infos));
+
+    size_t n = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && n < count; ++cpu) {
+        if (!CPU_ISSET(cpu, &worker_set))
+            continue;
+        infos[n] = (struct cpu_info) {
+            .cpu = cpu,
+            .node = cpu_node(cpu),
+            .first_thread = is_first_thread(cpu),
+        };
+        for (size_t i = 0; i < n; ++i)
+            if (infos[i].node == infos[n].node
+                    && infos[i].first_thread == infos[n].first_thread)
+                ++infos[n].rank;
+        ++n;
+    }
+    qsort(infos, n, sizeof (*infos), cmp_cpu_info);
+
+    worker_cpus = malloc(n * sizeof (int));
+    for (size_t i = 0; i < n; ++i)
+        worker_cpus[i] = infos[i].cpu;
+    nb_worker_cpus = n;
+    free(infos);
+}
+
+int affinity_init(void) {
+    struct criterion_options *opt = &criterion_options;
+
+    free(worker_cpus);
+    worker_cpus = NULL;
+    nb_worker_cpus = 0;
+    restricted = opt->cpus || opt->reserved_cpus;
+    if (!restricted && !opt->pin_workers)
+        return 1;
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof (allowed), &allowed) == -1) {
+        criterion_perror("Could not get the CPU affinity: %s.\n", strerror(errno));
+        return 0;
+    }
+
+    worker_set = allowed;
+    if (opt->cpus) {
+        if (!parse_cpu_list(opt->cpus, &worker_set)) {
+            criterion_perror("Invalid CPU list: %s.\n", opt->cpus);
+            return 0;
+        }
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &worker_set) && !CPU_ISSET(cpu, &allowed)) {
+                criterion_perror("CPU %d is not available to the tests.\n", cpu);
+                return 0;
+            }
+        }
+    }
+
+    // The runner keeps the lowest CPUs for itself
+    if (opt->reserved_cpus) {
+        if (opt->reserved_cpus >= (size_t) CPU_COUNT(&worker_set)) {
+            criterion_perror("Cannot reserve %lu CPUs out of %d.\n",
+                    (unsigned long) opt->reserved_cpus, CPU_COUNT(&worker_set));
+            return 0;
+        }
+
+        cpu_set_t runner_set;
+        CPU_ZERO(&runner_set);
+        size_t reserved = 0;
+        for (int cpu = 0; reserved < opt->reserved_cpus; ++cpu) {
+            if (!CPU_ISSET(cpu, &worker_set))
+                continue;
+            CPU_CLR(cpu, &worker_set);
+            CPU_SET(cpu, &runner_set);
+            ++reserved;
+        }
+        if (sched_setaffinity(0, sizeof (runner_set), &runner_set) == -1) {
+            criterion_perror("Could not set the CPU affinity of the runner: %s.\n",
+                    strerror(errno));
+            return 0;
+        }
+    }
+
+    if (opt->pin_workers) {
+        order_worker_cpus();
+        if (opt->jobs > nb_worker_cpus)
+            criterion_pimportant(CRITERION_PREFIX_DASHES,
+                    _(msg_shared_cpus), CR_FG_BOLD, CR_RESET);
+    } else {
+        nb_worker_cpus = CPU_COUNT(&worker_set);
+    }
+    return 1;
+}
+
+void affinity_pin_process(unsigned long long pid) {
+    if (worker_cpus) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(worker_cpus[current_slot % nb_worker_cpus], &set);
+        sched_setaffinity((pid_t) pid, sizeof (set), &set);
+    } else if (restricted) {
+        sched_setaffinity((pid_t) pid, sizeof (worker_set), &worker_set);
+    }
+}
+
+void affinity_pin_worker(void) {
+    affinity_pin_process(0);
+}
+
+size_t affinity_worker_cpus(void) {
+    return nb_worker_cpus ? nb_worker_cpus : get_processor_count();
+}
+
+#else
+
+#ifdef ENABLE_NLS
+static msg_t msg_no_affinity = N_("%1$sWarning! Setting the CPU affinity "
+        "is not supported on this platform, and is ignored.%2$s\n");
+#else
+static msg_t msg_no_affinity = "%sWarning! Setting the CPU affinity "
+        "is not supported on this platform, and is ignored.%s\n";
+#endif
+
+int affinity_init(void) {
+    struct criterion_options *opt = &criterion_options;
+    if (opt->cpus || opt->reserved_cpus || opt->pin_workers)
+        criterion_pimportant(CRITERION_PREFIX_DASHES,
+                _(msg_no_affinity), CR_FG_BOLD, CR_RESET);
+    return 1;
+}
+
+void affinity_pin_process(unsigned long long pid) {
+    (void) pid;
+}
+
+void affinity_pin_worker(void) {}
+
+size_t affinity_worker_cpus(void) {
+    return get_processor_count();
+}
+
+#endif
+
+void affinity_set_slot(size_t slot) {
+    current_slot = slot;
+}
+
+size_t affinity_get_slot(void) {
+    return current_slot;
+}
@@ -0,0 +1,50 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef COMPAT_AFFINITY_H_
+# define COMPAT_AFFINITY_H_
+
+# include <stddef.h>
+
+/*
+ * Sets up the CPUs of the workers and of the runner from the --cpus,
+ * --reserve-cpus and --pin-workers options, and moves the runner to its
+ * reserved CPUs. Returns 0 on failure.
+ */
+int affinity_init(void);
+
+// Number of CPUs the workers may run on
+size_t affinity_worker_cpus(void);
+
+/*
+ * Selects the worker slot of the next spawned worker, which is then pinned
+ * to the CPU of that slot by affinity_pin_worker.
+ */
+void affinity_set_slot(size_t slot);
+size_t affinity_get_slot(void);
+void affinity_pin_worker(void);
+
+// Same as affinity_pin_worker, for a worker that the runner spawned
+void affinity_pin_process(unsigned long long pid);
+
+#endif /* !COMPAT_AFFINITY_H_ */
@@ -0,0 +1,395 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _GNU_SOURCE
+#define CRITERION_LOGGING_COLORS
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "criterion/asprintf-compat.h"
+#include "criterion/logging.h"
+#include "criterion/options.h"
+#include "string/i18n.h"
+#include "cgroup.h"
+
+#ifdef __linux__
+# include <dirent.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+typedef const char *const msg_t;
+
+#ifdef ENABLE_NLS
+static msg_t msg_no_cgroup = N_("%1$sWarning! The memory and CPU limits of "
+        "the tests need a delegated cgroup v2 hierarchy, and will not be "
+        "enforced: %2$s.%3$s\n");
+#else
+static msg_t msg_no_cgroup = "%sWarning! The memory and CPU limits of "
+        "the tests need a delegated cgroup v2 hierarchy, and will not be "
+        "enforced: %s.%s\n";
+#endif
+
+static bool warned;
+
+static void warn_unavailable(const char *reason) {
+    if (warned)
+        return;
+    warned = true;
+    criterion_pimportant(CRITERION_PREFIX_DASHES, _(msg_no_cgroup),
+            CR_FG_BOLD, reason, CR_RESET);
+}
+
+#ifdef __linux__
+
+// CPU bandwidth period of the workers, in microseconds
+#define CPU_PERIOD_US 100000
+
+static bool initialized;
+static char parent[PATH_MAX];   // cgroup the runner was started in
+static char *root;              // subtree of the run, NULL if unavailable
+static bool has_memory, has_cpu;
+static bool memory_enabled, cpu_enabled; // enabled in parent by the runner
+static unsigned long nb_leaves;
+
+static bool has_token(const char *list, const char *token, const char *seps) {
+    size_t len = strlen(token);
+    for (const char *c = list; *c; c += strcspn(c, seps)) {
+        c += strspn(c, seps);
+        if (!strncmp(c, token, len) && (!c[len] || strchr(seps, c[len])))
+            return true;
+    }
+    return false;
+}
+
+bool cgroup_dir(const char *controller, char *dir, size_t size, size_t *root) {
+    FILE *f = fopen("/proc/self/cgroup", "r");
+    if (!f)
+        return false;
+
+    bool found = false;
+    char line[4096];
+    while (!found && fgets(line, sizeof (line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+
+        // each line is "hierarchy-id:controller-list:path"
+        char *controllers = strchr(line, ':');
+        char *path = controllers ? strchr(++controllers, ':') : NULL;
+        if (!path)
+            continue;
+        *path++ = '\0';
+
+        if (controller ? !has_token(controllers, controller, ",") : *controllers)
+            continue;
+
+        int len = snprintf(dir, size, "/sys/fs/cgroup%s%s",
+                controller ? "/" : "", controller ? controller : "");
+        if (len < 0 || (size_t) len >= size)
+            break;
+        *root = len;
+        if (strcmp(path, "/"))
+            snprintf(dir + len, size - len, "%s", path);
+        found = true;
+    }
+    fclose(f);
+    return found;
+}
+
+static FILE *open_in(const char *dir, const char *file, const char *mode) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof (path), "%s/%s", dir, file);
+    return fopen(path, mode);
+}
+
+int cgroup_read_u64(const char *dir, const char *file, uint64_t *val) {
+    FILE *f = open_in(dir, file, "r");
+    if (!f)
+        return 0;
+    unsigned long long v;
+    int ok = fscanf(f, "%llu", &v) == 1;
+    fclose(f);
+    if (ok)
+        *val = v;
+    return ok;
+}
+
+// Reads the value of a "key value" line, as found in memory.stat or cpu.stat
+int cgroup_read_key(const char *dir, const char *file, const char *key,
+                    uint64_t *val) {
+    FILE *f = open_in(dir, file, "r");
+    if (!f)
+        return 0;
+
+    char line[256];
+    size_t len = strlen(key);
+    int ok = 0;
+    while (!ok && fgets(line, sizeof (line), f)) {
+        if (!strncmp(line, key, len) && (line[len] == ' ' || line[len] == ':')) {
+            *val = strtoull(line + len + 1, NULL, 10);
+            ok = 1;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+static int write_in(const char *dir, const char *file, const char *fmt, ...) {
+    FILE *f = open_in(dir, file, "w");
+    if (!f)
+        return 0;
+
+    // cgroupfs reports errors on write, hence when the stream is flushed
+    va_list ap;
+    va_start(ap, fmt);
+    int ok = vfprintf(f, fmt, ap) >= 0;
+    va_end(ap);
+    return !fclose(f) && ok;
+}
+
+static bool lists_controller(const char *dir, const char *file,
+                             const char *controller) {
+    FILE *f = open_in(dir, file, "r");
+    if (!f)
+        return false;
+    char line[256];
+    bool listed = fgets(line, sizeof (line), f)
+        && has_token(line, controller, " \n");
+    fclose(f);
+    return listed;
+}
+
+// Enables a controller for the children of a cgroup, unless it already is
+static bool enable_controller(const char *dir, const char *controller,
+                              bool *enabled) {
+    *enabled = false;
+    if (lists_controller(dir, "cgroup.subtree_control", controller))
+        return true;
+    if (!lists_controller(dir, "cgroup.controllers", controller))
+        return false;
+    *enabled = write_in(dir, "cgroup.subtree_control", "+%s", controller);
+    return *enabled;
+}
+
+/*
+ * A cgroup v2 with processes cannot have controllers enabled for its
+ * children, so the runner moves to a leaf of the subtree of the run first:
+ *
+ *   <parent>/criterion.<pid>/runner
+ *   <parent>/criterion.<pid>/worker.<n>
+ */
+static const char *setup_subtree(void) {
+    static char reason[PATH_MAX + 256];
+
+    size_t mount;
+    if (!cgroup_dir(NULL, parent, sizeof (parent), &mount)
+            || (!lists_controller(parent, "cgroup.controllers", "memory")
+                && !lists_controller(parent, "cgroup.controllers", "cpu")))
+        return "no cgroup v2 controller is available";
+
+    cr_asprintf(&root, "%s/criterion.%lu", parent, (unsigned long) getpid());
+    if (mkdir(root, 0755) == -1) {
+        snprintf(reason, sizeof (reason), "could not create %s: %s",
+                root, strerror(errno));
+        free(root);
+        root = NULL;
+        return reason;
+    }
+
+    char runner[PATH_MAX];
+    snprintf(runner, sizeof (runner), "%s/runner", root);
+    if (mkdir(runner, 0755) == -1 || !write_in(runner, "cgroup.procs", "0")) {
+        snprintf(reason, sizeof (reason), "could not move the runner to "
+                "%s: %s", runner, strerror(errno));
+        return reason;
+    }
+
+    has_memory = enable_controller(parent, "memory", &memory_enabled)
+        && write_in(root, "cgroup.subtree_control", "+memory");
+    has_cpu = enable_controller(parent, "cpu", &cpu_enabled)
+        && write_in(root, "cgroup.subtree_control", "+cpu");
+    if (!has_memory && !has_cpu) {
+        snprintf(reason, sizeof (reason), "could not enable the memory and "
+                "cpu controllers in %s: %s", parent, strerror(errno));
+        return reason;
+    }
+    return NULL;
+}
+
+void cgroup_setup(void) {
+    if (initialized)
+        return;
+    initialized = true;
+    const char *reason = setup_subtree();
+    if (reason) {
+        cgroup_cleanup();
+        warn_unavailable(reason);
+    }
+}
+
+char *cgroup_create(const struct cgroup_limits *limits) {
+    cgroup_setup();
+    if (!root)
+        return NULL;
+
+    if ((limits->memory && !has_memory) || (limits->cpus > 0 && !has_cpu))
+        warn_unavailable(has_memory ? "the cpu controller is not delegated"
+                : "the memory controller is not delegated");
+
+    char *leaf;
+    cr_asprintf(&leaf, "%s/worker.%lu", root, nb_leaves++);
+    if (mkdir(leaf, 0755) == -1) {
+        criterion_perror("Could not create the cgroup %s: %s.\n",
+                leaf, strerror(errno));
+        free(leaf);
+        return NULL;
+    }
+
+    bool ok = true;
+    if (limits->memory && has_memory) {
+        ok = write_in(leaf, "memory.max", "%llu",
+                (unsigned long long) limits->memory);
+
+        // the limit must not be escaped through swap, and an OOM kill takes
+        // down the whole worker rather than one of its processes
+        write_in(leaf, "memory.swap.max", "0");
+        write_in(leaf, "memory.oom.group", "1");
+    }
+    if (ok && limits->cpus > 0 && has_cpu) {
+        unsigned long long quota = limits->cpus * CPU_PERIOD_US;
+        ok = write_in(leaf, "cpu.max", "%llu %d",
+                quota < 1000 ? 1000 : quota, CPU_PERIOD_US);
+    }
+    if (!ok) {
+        criterion_perror("Could not set the limits of the cgroup %s: %s.\n",
+                leaf, strerror(errno));
+        rmdir(leaf);
+        free(leaf);
+        return NULL;
+    }
+    return leaf;
+}
+
+void cgroup_enter(const char *cgroup) {
+    if (!write_in(cgroup, "cgroup.procs", "0"))
+        criterion_perror("Could not move the worker into the cgroup %s: %s.\n",
+                cgroup, strerror(errno));
+}
+
+static void remove_leaf(const char *leaf) {
+    // kill what the test left behind, so that the cgroup can be removed
+    write_in(leaf, "cgroup.kill", "1");
+    rmdir(leaf);
+}
+
+int cgroup_release(char *cgroup, struct cgroup_usage *usage) {
+    *usage = (struct cgroup_usage) { .memory_peak = 0 };
+
+    uint64_t val;
+    int ok = cgroup_read_u64(cgroup, "memory.peak", &usage->memory_peak);
+    if (cgroup_read_key(cgroup, "cpu.stat", "user_usec", &val)) {
+        usage->user_time = val * 1000;
+        ok = 1;
+    }
+    if (cgroup_read_key(cgroup, "cpu.stat", "system_usec", &val))
+        usage->system_time = val * 1000;
+    if (cgroup_read_key(cgroup, "cpu.stat", "throttled_usec", &val))
+        usage->throttled_time = val * 1000;
+    if (cgroup_read_key(cgroup, "memory.events", "oom_kill", &val))
+        usage->oom_killed = val > 0;
+
+    remove_leaf(cgroup);
+    free(cgroup);
+    return ok;
+}
+
+void cgroup_cleanup(void) {
+    if (!root)
+        return;
+
+    // leaves still held by stray processes
+    DIR *dir = opendir(root);
+    for (struct dirent *ent; dir && (ent = readdir(dir)) != NULL;) {
+        if (strncmp(ent->d_name, "worker.", 7))
+            continue;
+        char leaf[PATH_MAX];
+        snprintf(leaf, sizeof (leaf), "%s/%s", root, ent->d_name);
+        remove_leaf(leaf);
+    }
+    if (dir)
+        closedir(dir);
+
+    // the runner may only go back once no controller is enabled below
+    // its original cgroup
+    write_in(root, "cgroup.subtree_control", "-memory -cpu");
+    if (memory_enabled)
+        write_in(parent, "cgroup.subtree_control", "-memory");
+    if (cpu_enabled)
+        write_in(parent, "cgroup.subtree_control", "-cpu");
+    write_in(parent, "cgroup.procs", "0");
+
+    char runner[PATH_MAX];
+    snprintf(runner, sizeof (runner), "%s/runner", root);
+    rmdir(runner);
+    rmdir(root);
+    free(root);
+    root = NULL;
+    has_memory = has_cpu = memory_enabled = cpu_enabled = false;
+}
+
+#else
+
+bool cgroup_dir(CR_UNUSED const char *controller, CR_UNUSED char *dir,
+                CR_UNUSED size_t size, CR_UNUSED size_t *root) {
+    return false;
+}
+
+int cgroup_read_u64(CR_UNUSED const char *dir, CR_UNUSED const char *file,
+                    CR_UNUSED uint64_t *val) {
+    return 0;
+}
+
+int cgroup_read_key(CR_UNUSED const char *dir, CR_UNUSED const char *file,
+                    CR_UNUSED const char *key, CR_UNUSED uint64_t *val) {
+    return 0;
+}
+
+void cgroup_setup(void) {}
+
+char *cgroup_create(CR_UNUSED const struct cgroup_limits *limits) {
+    warn_unavailable("cgroups are not supported on this platform");
+    return NULL;
+}
+
+void cgroup_enter(CR_UNUSED const char *cgroup) {}
+
+int cgroup_release(char *cgroup, CR_UNUSED struct cgroup_usage *usage) {
+    free(cgroup);
+    return 0;
+}
+
+void cgroup_cleanup(void) {}
+
+#endif
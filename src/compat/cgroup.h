@@ -0,0 +1,84 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef COMPAT_CGROUP_H_
+# define COMPAT_CGROUP_H_
+
+# include <stdbool.h>
+# include <stddef.h>
+# include <stdint.h>
+
+struct cgroup_limits {
+    size_t memory;          // in bytes, 0 for no limit
+    double cpus;            // CPU bandwidth, in CPUs, 0 for no limit
+};
+
+struct cgroup_usage {
+    uint64_t memory_peak;   // in bytes
+    uint64_t user_time;     // in nanoseconds
+    uint64_t system_time;   // in nanoseconds
+    uint64_t throttled_time;// time throttled by the CPU quota, in nanoseconds
+    bool oom_killed;
+};
+
+/*
+ * Finds the directory of the cgroup of the process in the hierarchy of the
+ * given cgroup v1 controller, or in the unified hierarchy if it is NULL.
+ * root is set to the length of the mount point of the hierarchy.
+ */
+bool cgroup_dir(const char *controller, char *dir, size_t size, size_t *root);
+
+// Return 0 when the file is missing or does not hold a number, e.g. "max"
+int cgroup_read_u64(const char *dir, const char *file, uint64_t *val);
+int cgroup_read_key(const char *dir, const char *file, const char *key,
+                    uint64_t *val);
+
+/*
+ * Moves the runner into a subtree of its own cgroup, which must be a
+ * delegated cgroup v2, printing a warning if it cannot. This must happen
+ * before the runner forks any helper process, as its original cgroup
+ * cannot hand its controllers down while it holds processes.
+ */
+void cgroup_setup(void);
+
+/*
+ * Creates a leaf cgroup enforcing the limits, for the next worker to join,
+ * setting the subtree of the run up first if needed. Returns NULL if the
+ * limits cannot be enforced, after printing a warning once.
+ */
+char *cgroup_create(const struct cgroup_limits *limits);
+
+// Moves the calling worker into its cgroup
+void cgroup_enter(const char *cgroup);
+
+/*
+ * Reads back the accounting of a cgroup whose worker terminated, then
+ * kills what is left in it and removes it.
+ * Returns 0 when nothing could be read.
+ */
+int cgroup_release(char *cgroup, struct cgroup_usage *usage);
+
+// Moves the runner back to its cgroup and removes the subtree of the run
+void cgroup_cleanup(void);
+
+#endif /* !COMPAT_CGROUP_H_ */
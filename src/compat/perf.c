@@ -0,0 +1,222 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include "perf.h"
+#include "config.h"
+
+#if HAVE_LINUX_PERF_EVENT_H
+# include <unistd.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <linux/perf_event.h>
+#endif
+
+unsigned g_perf_counters;
+
+struct perf_counter_desc {
+    const char *name;
+    unsigned counter;
+    size_t offset;
+#if HAVE_LINUX_PERF_EVENT_H
+    uint64_t config;
+#endif
+};
+
+#if HAVE_LINUX_PERF_EVENT_H
+# define COUNTER(Name, Id, Field, Config) \
+    { Name, Id, offsetof(struct criterion_perf_counters, Field), Config }
+#else
+# define COUNTER(Name, Id, Field, Config) \
+    { Name, Id, offsetof(struct criterion_perf_counters, Field) }
+#endif
+
+static const struct perf_counter_desc counters[] = {
+    COUNTER("cycles",           CR_PERF_CYCLES,           cycles,           PERF_COUNT_HW_CPU_CYCLES),
+    COUNTER("instructions",     CR_PERF_INSTRUCTIONS,     instructions,     PERF_COUNT_HW_INSTRUCTIONS),
+    COUNTER("cache-references", CR_PERF_CACHE_REFERENCES, cache_references, PERF_COUNT_HW_CACHE_REFERENCES),
+    COUNTER("cache-misses",     CR_PERF_CACHE_MISSES,     cache_misses,     PERF_COUNT_HW_CACHE_MISSES),
+    COUNTER("branches",         CR_PERF_BRANCHES,         branches,         PERF_COUNT_HW_BRANCH_INSTRUCTIONS),
+    COUNTER("branch-misses",    CR_PERF_BRANCH_MISSES,    branch_misses,    PERF_COUNT_HW_BRANCH_MISSES),
+};
+
+#define NB_COUNTERS (sizeof (counters) / sizeof (counters[0]))
+
+static const struct perf_counter_desc *find_counter(unsigned counter) {
+    for (size_t i = 0; i < NB_COUNTERS; ++i)
+        if (counters[i].counter == counter)
+            return &counters[i];
+    return NULL;
+}
+
+const char *perf_counter_name(unsigned counter) {
+    const struct perf_counter_desc *desc = find_counter(counter);
+    return desc ? desc->name : NULL;
+}
+
+const char *perf_parse_counters(const char *list, unsigned *mask) {
+    static char unknown[64];
+
+    *mask = 0;
+    for (const char *name = list; name && *name; ) {
+        const char *end = strchr(name, ',');
+        size_t len = end ? (size_t) (end - name) : strlen(name);
+
+        size_t i = 0;
+        for (; i < NB_COUNTERS; ++i) {
+            if (strlen(counters[i].name) == len
+                    && !strncmp(counters[i].name, name, len))
+                break;
+        }
+
+        if (i == NB_COUNTERS && len) {
+            if (len >= sizeof (unknown))
+                len = sizeof (unknown) - 1;
+            memcpy(unknown, name, len);
+            unknown[len] = '\0';
+            return unknown;
+        }
+        if (i < NB_COUNTERS)
+            *mask |= counters[i].counter;
+
+        name = end ? end + 1 : NULL;
+    }
+    return NULL;
+}
+
+#if HAVE_LINUX_PERF_EVENT_H
+static int perf_event_open(struct perf_event_attr *attr, int group_fd) {
+    return (int) syscall(__NR_perf_event_open, attr, 0, -1, group_fd, 0);
+}
+#endif
+
+unsigned perf_group_open(struct perf_group *group, unsigned mask) {
+    *group = (struct perf_group) { .leader = -1 };
+
+#if HAVE_LINUX_PERF_EVENT_H
+    int error = 0;
+    for (size_t i = 0; i < NB_COUNTERS; ++i) {
+        if (!(mask & counters[i].counter))
+            continue;
+
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof (attr));
+        attr.size           = sizeof (attr);
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.config         = counters[i].config;
+        attr.disabled       = group->leader == -1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_GROUP
+                            | PERF_FORMAT_TOTAL_TIME_ENABLED
+                            | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        int fd = perf_event_open(&attr, group->leader);
+        if (fd == -1) {
+            if (!error)
+                error = errno;
+            continue;
+        }
+
+        if (group->leader == -1)
+            group->leader = fd;
+        group->fds[group->size] = fd;
+        group->counters[group->size] = counters[i].counter;
+        ++group->size;
+    }
+
+    unsigned opened = 0;
+    for (size_t i = 0; i < group->size; ++i)
+        opened |= group->counters[i];
+
+    if (opened != mask)
+        errno = error;
+    return opened;
+#else
+    (void) mask;
+    errno = ENOTSUP;
+    return 0;
+#endif
+}
+
+void perf_group_enable(struct perf_group *group) {
+#if HAVE_LINUX_PERF_EVENT_H
+    if (group->leader == -1)
+        return;
+    ioctl(group->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(group->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+    (void) group;
+#endif
+}
+
+void perf_group_disable(struct perf_group *group) {
+#if HAVE_LINUX_PERF_EVENT_H
+    if (group->leader == -1)
+        return;
+    ioctl(group->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#else
+    (void) group;
+#endif
+}
+
+void perf_group_read(struct perf_group *group,
+        struct criterion_perf_counters *values) {
+
+    *values = (struct criterion_perf_counters) { .measured = 0 };
+
+#if HAVE_LINUX_PERF_EVENT_H
+    if (group->leader == -1)
+        return;
+
+    // nr, time_enabled, time_running, then one value per counter
+    uint64_t buf[3 + sizeof (group->fds) / sizeof (group->fds[0])];
+    ssize_t size = read(group->leader, buf, sizeof (buf));
+    if (size < (ssize_t) (3 * sizeof (uint64_t)) || buf[0] != group->size)
+        return;
+
+    // scale the values if the group was multiplexed with other events
+    double scale = 1;
+    if (buf[2] && buf[2] < buf[1])
+        scale = (double) buf[1] / (double) buf[2];
+
+    for (size_t i = 0; i < group->size; ++i) {
+        const struct perf_counter_desc *desc = find_counter(group->counters[i]);
+        uint64_t *field = (uint64_t *) ((char *) values + desc->offset);
+        *field = (uint64_t) (buf[3 + i] * scale);
+        values->measured |= desc->counter;
+    }
+#else
+    (void) group;
+#endif
+}
+
+void perf_group_close(struct perf_group *group) {
+#if HAVE_LINUX_PERF_EVENT_H
+    for (size_t i = 0; i < group->size; ++i)
+        close(group->fds[i]);
+#endif
+    *group = (struct perf_group) { .leader = -1 };
+}
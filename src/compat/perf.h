@@ -0,0 +1,58 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef COMPAT_PERF_H_
+# define COMPAT_PERF_H_
+
+# include "criterion/stats.h"
+
+struct perf_group {
+    int leader;
+    int fds[6];
+    unsigned counters[6];
+    size_t size;
+};
+
+// Counters the workers should measure, as a criterion_perf_counter mask
+extern unsigned g_perf_counters;
+
+/*
+ * Parses a comma-separated list of counter names into a mask.
+ * Returns the name of the first unknown counter, or NULL.
+ */
+const char *perf_parse_counters(const char *list, unsigned *mask);
+const char *perf_counter_name(unsigned counter);
+
+/*
+ * Opens one counter group measuring the calling process.
+ * Returns the mask of the counters that could be opened, and sets errno
+ * to the reason of the first failure otherwise.
+ */
+unsigned perf_group_open(struct perf_group *group, unsigned mask);
+void perf_group_enable(struct perf_group *group);
+void perf_group_disable(struct perf_group *group);
+void perf_group_read(struct perf_group *group,
+        struct criterion_perf_counters *counters);
+void perf_group_close(struct perf_group *group);
+
+#endif /* !COMPAT_PERF_H_ */
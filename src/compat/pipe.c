@@ -22,11 +22,17 @@
  * THE SOFTWARE.
  */
 #include <stdio.h>
+#include <errno.h>
+#include <limits.h>
 #include <csptr/smalloc.h>
 
 #include "criterion/assert.h"
 #include "pipe-internal.h"
 
+#ifndef VANILLA_WIN32
+# include <poll.h>
+#endif
+
 FILE *pipe_in(s_pipe_handle *p, enum pipe_opt opts) {
 #ifdef VANILLA_WIN32
     if (opts & PIPE_CLOSE)
@@ -279,10 +285,18 @@ int pipe_write(const void *buf, size_t size, s_pipe_file_handle *pipe) {
         return 1;
     return 0;
 #else
-    ssize_t res = write(pipe->fd, buf, size);
-    if (res < 0)
-        return -1;
-    if (res > 0)
+    size_t off = 0;
+    while (off < size) {
+        ssize_t res = write(pipe->fd, (const char *) buf + off, size - off);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res < 0)
+            return -1;
+        if (res == 0)
+            break;
+        off += res;
+    }
+    if (off > 0)
         return 1;
     return 0;
 #endif
@@ -311,6 +325,60 @@ int pipe_read(void *buf, size_t size, s_pipe_file_handle *pipe) {
 #endif
 }
 
+/*
+ * Reads whatever is available, up to size bytes, blocking only when
+ * nothing is. The number of bytes read is stored in nread.
+ */
+int pipe_read_some(void *buf, size_t size, size_t *nread,
+                   s_pipe_file_handle *pipe) {
+#ifdef VANILLA_WIN32
+    DWORD res = 0;
+    if (!ReadFile(pipe->fh, buf, size, &res, NULL))
+        return GetLastError() == ERROR_BROKEN_PIPE ? 0 : -1;
+    *nread = res;
+    return res > 0;
+#else
+    ssize_t res;
+    do {
+        res = read(pipe->fd, buf, size);
+    } while (res < 0 && errno == EINTR);
+    if (res < 0)
+        return -1;
+    *nread = res;
+    return res > 0;
+#endif
+}
+
+int pipe_wait_readable(s_pipe_file_handle *pipe, int64_t timeout_ns) {
+#ifdef VANILLA_WIN32
+    // anonymous pipes cannot be waited upon, poll them instead
+    DWORD waited = 0;
+    for (;;) {
+        DWORD avail = 0;
+        if (!PeekNamedPipe(pipe->fh, NULL, 0, NULL, &avail, NULL))
+            return -1;
+        if (avail > 0)
+            return 1;
+        if (timeout_ns >= 0 && (int64_t) waited >= timeout_ns / 1000000)
+            return 0;
+        Sleep(10);
+        waited += 10;
+    }
+#else
+    int timeout_ms = -1;
+    if (timeout_ns >= 0) {
+        int64_t ms = (timeout_ns + 999999) / 1000000;
+        timeout_ms = ms > INT_MAX ? INT_MAX : (int) ms;
+    }
+
+    struct pollfd pfd = { .fd = pipe->fd, .events = POLLIN };
+    int res = poll(&pfd, 1, timeout_ms);
+    if (res == -1)
+        return errno == EINTR ? 0 : -1;
+    return res > 0;
+#endif
+}
+
 static s_pipe_handle stdout_redir_;
 static s_pipe_handle stderr_redir_;
 static s_pipe_handle stdin_redir_;
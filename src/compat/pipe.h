@@ -26,6 +26,7 @@
 
 # include <stdio.h>
 # include <stdlib.h>
+# include <stdint.h>
 # include "common.h"
 # include "criterion/logging.h"
 
@@ -63,6 +64,9 @@ void pipe_std_redirect(s_pipe_handle *pipe, enum criterion_std_fd fd);
 
 int pipe_write(const void *buf, size_t size, s_pipe_file_handle *pipe);
 int pipe_read(void *buf, size_t size, s_pipe_file_handle *pipe);
+int pipe_read_some(void *buf, size_t size, size_t *nread,
+                   s_pipe_file_handle *pipe);
+int pipe_wait_readable(s_pipe_file_handle *pipe, int64_t timeout_ns);
 
 INLINE FILE* get_std_file(enum criterion_std_fd fd_kind) {
     switch (fd_kind) {
@@ -0,0 +1,189 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cgroup.h"
+#include "pressure.h"
+#include "compat/time.h"
+
+#ifdef __linux__
+
+typedef void (*f_cgroup_visit)(const char *dir, void *data);
+
+// Visits the cgroup of the process, then each of its ancestors
+static void walk_cgroups(const char *controller, f_cgroup_visit fn, void *data) {
+    char dir[PATH_MAX];
+    size_t root;
+    if (!cgroup_dir(controller, dir, sizeof (dir), &root))
+        return;
+
+    for (;;) {
+        fn(dir, data);
+        char *sep = strrchr(dir + root, '/');
+        if (!sep)
+            break;
+        *sep = '\0';
+    }
+}
+
+static FILE *open_in(const char *dir, const char *file) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof (path), "%s/%s", dir, file);
+    return fopen(path, "r");
+}
+
+static void min_cpu_quota(size_t *cpus, uint64_t quota, uint64_t period) {
+    if (!period)
+        return;
+    size_t n = (quota + period - 1) / period;
+    if (n && (!*cpus || n < *cpus))
+        *cpus = n;
+}
+
+static void visit_cpu_max(const char *dir, void *data) {
+    FILE *f = open_in(dir, "cpu.max");
+    if (!f)
+        return;
+    unsigned long long quota, period;
+    if (fscanf(f, "%llu %llu", &quota, &period) == 2)
+        min_cpu_quota(data, quota, period);
+    fclose(f);
+}
+
+static void visit_cfs_quota(const char *dir, void *data) {
+    FILE *f = open_in(dir, "cpu.cfs_quota_us");
+    if (!f)
+        return;
+
+    // the quota is -1 when unlimited
+    long long quota;
+    uint64_t period;
+    int ok = fscanf(f, "%lld", &quota) == 1 && quota > 0;
+    fclose(f);
+    if (ok && cgroup_read_u64(dir, "cpu.cfs_period_us", &period))
+        min_cpu_quota(data, quota, period);
+}
+
+size_t pressure_cpu_quota(void) {
+    size_t cpus = 0;
+    walk_cgroups(NULL, visit_cpu_max, &cpus);
+    walk_cgroups("cpu", visit_cfs_quota, &cpus);
+    return cpus;
+}
+
+// Reads the cumulative "some" stall time out of a PSI file
+static int read_psi(const char *dir, const char *file, uint64_t *total) {
+    FILE *f = open_in(dir, file);
+    if (!f)
+        return 0;
+
+    char line[256];
+    int ok = 0;
+    while (!ok && fgets(line, sizeof (line), f)) {
+        char *t = strstr(line, " total=");
+        if (!strncmp(line, "some ", 5) && t) {
+            *total = strtoull(t + sizeof (" total=") - 1, NULL, 10);
+            ok = 1;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+struct memory_limits {
+    const char *limit;
+    const char *usage;
+    const char *inactive;
+    struct pressure_sample *sample;
+};
+
+/*
+ * Keeps the most constrained memory limit among the cgroups. The inactive
+ * file cache is reclaimable and is not counted as used.
+ */
+static void visit_memory(const char *dir, void *data) {
+    struct memory_limits *m = data;
+    struct pressure_sample *s = m->sample;
+
+    uint64_t limit, usage, inactive = 0;
+    if (!cgroup_read_u64(dir, m->limit, &limit)
+            || !cgroup_read_u64(dir, m->usage, &usage))
+        return;
+    cgroup_read_key(dir, "memory.stat", m->inactive, &inactive);
+
+    usage = usage > inactive ? usage - inactive : 0;
+    uint64_t available = limit > usage ? limit - usage : 0;
+    if (s->mem_total && (limit >= s->mem_total || available >= s->mem_available))
+        return;
+    s->mem_total = limit;
+    s->mem_available = available;
+}
+
+int pressure_sample(struct pressure_sample *sample) {
+    *sample = (struct pressure_sample) { .timestamp = get_timestamp_ns() };
+
+    char dir[PATH_MAX];
+    size_t root;
+    bool in_cgroup = cgroup_dir(NULL, dir, sizeof (dir), &root);
+    if (in_cgroup)
+        sample->has_psi = read_psi(dir, "cpu.pressure", &sample->cpu_stall)
+            && read_psi(dir, "memory.pressure", &sample->mem_stall);
+    if (!sample->has_psi)
+        sample->has_psi = read_psi("/proc/pressure", "cpu", &sample->cpu_stall)
+            && read_psi("/proc/pressure", "memory", &sample->mem_stall);
+
+    uint64_t kb;
+    if (cgroup_read_key("/proc", "meminfo", "MemTotal", &kb))
+        sample->mem_total = kb * 1024;
+    if (cgroup_read_key("/proc", "meminfo", "MemAvailable", &kb))
+        sample->mem_available = kb * 1024;
+
+    struct memory_limits v2 = {
+        "memory.max", "memory.current", "inactive_file", sample
+    };
+    struct memory_limits v1 = {
+        "memory.limit_in_bytes", "memory.usage_in_bytes",
+        "total_inactive_file", sample
+    };
+    walk_cgroups(NULL, visit_memory, &v2);
+    walk_cgroups("memory", visit_memory, &v1);
+
+    return sample->has_psi || sample->mem_total;
+}
+
+#else
+
+size_t pressure_cpu_quota(void) {
+    return 0;
+}
+
+int pressure_sample(struct pressure_sample *sample) {
+    *sample = (struct pressure_sample) { .timestamp = get_timestamp_ns() };
+    return 0;
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef COMPAT_PRESSURE_H_
+# define COMPAT_PRESSURE_H_
+
+# include <stdbool.h>
+# include <stddef.h>
+# include <stdint.h>
+
+struct pressure_sample {
+    uint64_t timestamp;     // when the sample was taken, in nanoseconds
+    bool has_psi;           // whether the stall times below are known
+    uint64_t cpu_stall;     // cumulative time some task stalled on CPU, in us
+    uint64_t mem_stall;     // cumulative time some task stalled on memory, in us
+    uint64_t mem_total;     // memory usable by the tests, 0 if unknown
+    uint64_t mem_available; // memory left for the tests to use
+};
+
+/*
+ * Number of CPUs allowed by the CPU bandwidth quota of the cgroups of the
+ * process, rounded up, or 0 when there is no quota.
+ */
+size_t pressure_cpu_quota(void);
+
+/*
+ * Samples the CPU and memory pressure of the cgroup of the process, or of
+ * the whole system when the cgroup does not account for it.
+ * Returns 0 when nothing could be measured.
+ */
+int pressure_sample(struct pressure_sample *sample);
+
+#endif /* !COMPAT_PRESSURE_H_ */
@@ -21,13 +21,18 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  */
+#define _GNU_SOURCE
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
 #include <csptr/smalloc.h>
+#include "criterion/options.h"
 #include "core/worker.h"
 #include "core/runner.h"
+#include "affinity.h"
+#include "perf.h"
 #include "io/event.h"
+#include "time.h"
 #include "process.h"
 #include "internal.h"
 #include "pipe-internal.h"
@@ -90,7 +95,7 @@ static int get_win_status(HANDLE handle) {
 }
 #endif
 
-struct worker_context g_worker_context = {.test = NULL};
+CR_THREAD_LOCAL struct worker_context g_worker_context = {.test = NULL};
 
 #ifdef VANILLA_WIN32
 struct full_context {
@@ -115,26 +120,157 @@ static struct full_context local_ctx;
 #  error Unsupported compiler. Use GCC or Clang under *nixes.
 # endif
 
+# include <fcntl.h>
+# include <sys/resource.h>
+
+# include <pthread.h>
+
+# ifdef __linux__
+#  include <dirent.h>
+#  include <spawn.h>
+#  include <sys/mman.h>
+#  include <sys/prctl.h>
+# endif
+
+# ifdef __linux__
+static uint64_t parse_proc_field(const char *buf, const char *name) {
+    size_t len = strlen(name);
+    for (const char *line = buf; line && *line; ) {
+        if (!strncmp(line, name, len) && line[len] == ':') {
+            uint64_t val = 0;
+            for (const char *c = line + len + 1; *c; ++c) {
+                if (*c >= '0' && *c <= '9')
+                    val = val * 10 + (uint64_t) (*c - '0');
+                else if (*c != ' ')
+                    break;
+            }
+            return val;
+        }
+        line = strchr(line, '\n');
+        if (line)
+            ++line;
+    }
+    return 0;
+}
+
+/*
+ * Reads the I/O counters of a terminated but not yet reaped child.
+ * This is called from a signal handler, hence the lack of stdio.
+ */
+static void read_proc_io(pid_t pid, struct criterion_resource_usage *usage) {
+    char path[32] = "/proc/";
+    char digits[16];
+    size_t n = 0;
+    for (unsigned long p = (unsigned long) pid; p || !n; p /= 10)
+        digits[n++] = (char) ('0' + p % 10);
+
+    char *ptr = path + strlen(path);
+    while (n)
+        *ptr++ = digits[--n];
+    memcpy(ptr, "/io", sizeof ("/io"));
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return;
+
+    char buf[512];
+    ssize_t size = read(fd, buf, sizeof (buf) - 1);
+    close(fd);
+    if (size <= 0)
+        return;
+    buf[size] = '\0';
+
+    usage->read_bytes  = parse_proc_field(buf, "rchar");
+    usage->write_bytes = parse_proc_field(buf, "wchar");
+}
+
+static pid_t peek_terminated_child(void) {
+    siginfo_t info;
+    info.si_pid = 0;
+    if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) == -1)
+        return -1;
+    return info.si_pid ? info.si_pid : -1;
+}
+# endif
+
+static uint64_t timeval_to_ns(struct timeval tv) {
+    return (uint64_t) tv.tv_sec * 1000000000 + (uint64_t) tv.tv_usec * 1000;
+}
+
+static pid_t reap_child(int *status, struct criterion_resource_usage *usage) {
+    pid_t pid = -1;
+# ifdef __linux__
+    // peek at the child first, as its /proc entry goes away once reaped
+    pid = peek_terminated_child();
+    if (pid == -1)
+        return -1;
+    read_proc_io(pid, usage);
+# endif
+
+    struct rusage ru;
+    pid = wait4(pid, status, WNOHANG, &ru);
+    if (pid <= 0)
+        return -1;
+
+    usage->user_time            = timeval_to_ns(ru.ru_utime);
+    usage->system_time          = timeval_to_ns(ru.ru_stime);
+# ifdef __APPLE__
+    usage->max_rss              = (uint64_t) ru.ru_maxrss;
+# else
+    usage->max_rss              = (uint64_t) ru.ru_maxrss * 1024;
+# endif
+    usage->minor_faults         = (uint64_t) ru.ru_minflt;
+    usage->major_faults         = (uint64_t) ru.ru_majflt;
+    usage->voluntary_switches   = (uint64_t) ru.ru_nvcsw;
+    usage->involuntary_switches = (uint64_t) ru.ru_nivcsw;
+    return pid;
+}
+
+/*
+ * The processes forked by this one, as opposed to those it adopted as a
+ * subreaper, until their termination was handled.
+ */
+static pid_t *g_children;
+static size_t g_nb_children;
+static size_t g_children_capacity;
+
+static void remember_child(pid_t pid) {
+    if (g_nb_children == g_children_capacity) {
+        g_children_capacity = g_children_capacity ? g_children_capacity * 2 : 16;
+        g_children = realloc(g_children, sizeof (pid_t) * g_children_capacity);
+    }
+    g_children[g_nb_children++] = pid;
+}
+
 static void handle_sigchld(CR_UNUSED int sig) {
     assert(sig == SIGCHLD);
 
-    int fd = g_worker_pipe->fds[1];
+    // the processes adopted by the runner may still terminate once the
+    // run is over, and are only reaped then
+    int fd = g_worker_pipe ? g_worker_pipe->fds[1] : -1;
     pid_t pid;
     int status;
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        int kind = WORKER_TERMINATED;
-        struct worker_status ws = {
-            (s_proc_handle) { pid }, get_status(status)
+    struct criterion_resource_usage usage = { .user_time = 0 };
+    while ((pid = reap_child(&status, &usage)) > 0) {
+        struct {
+            struct event_header header;
+            struct worker_status status;
+        } frame = {
+            .status = {
+                (s_proc_handle) { pid },
+                get_status(status),
+                usage,
+                (unsigned long long) getpid(),
+            },
         };
-
-        unsigned long long pid_ull = (unsigned long long) pid;
-
-        char buf[sizeof (int) + sizeof (pid_ull) + sizeof (struct worker_status)];
-        memcpy(buf, &kind, sizeof (kind));
-        memcpy(buf + sizeof (kind), &pid_ull, sizeof (pid_ull));
-        memcpy(buf + sizeof (kind) + sizeof (pid_ull), &ws, sizeof (ws));
-
-        if (write(fd, &buf, sizeof (buf)) < (ssize_t) sizeof (buf)) {
+        usage = (struct criterion_resource_usage) { .user_time = 0 };
+        if (fd == -1)
+            continue;
+        event_header_init(&frame.header, WORKER_TERMINATED,
+                (unsigned long long) pid, sizeof (frame.status));
+
+        const size_t size = sizeof (frame.header) + sizeof (frame.status);
+        if (write(fd, &frame, size) < (ssize_t) size) {
             criterion_perror("Could not write the WORKER_TERMINATED event "
                     "down the event pipe: %s.\n",
                     strerror(errno));
@@ -142,6 +278,199 @@ static void handle_sigchld(CR_UNUSED int sig) {
         }
     }
 }
+
+# ifdef __linux__
+#  define SPAWN_CONTEXT_ENV "CRITERION_WORKER_CONTEXT"
+
+extern char **environ;
+
+/*
+ * The context of a spawned worker, followed by the names of its suite and
+ * test and the path of its cgroup. The tests are looked up by name since
+ * the addresses differ from one execution to the other. The worker resumes
+ * before the command line is parsed, so the options of the runner come
+ * along.
+ */
+struct spawn_context {
+    struct criterion_options options;
+    unsigned perf_counters;
+    int pipe_fd;
+    bool has_param;
+    size_t param_index;
+    size_t param_size;
+    size_t suite_size;
+    size_t test_size;
+    size_t cgroup_size;
+};
+
+static bool write_all(int fd, const void *buf, size_t size) {
+    return write(fd, buf, size) == (ssize_t) size;
+}
+
+// Splits /proc/self/cmdline, so that the workers get the same arguments
+static char **get_self_argv(void) {
+    static char **argv;
+    static char *args;
+    if (argv)
+        return argv;
+
+    int fd = open("/proc/self/cmdline", O_RDONLY);
+    if (fd == -1)
+        return NULL;
+
+    size_t size = 0, capacity = 0;
+    for (ssize_t res = 1; res > 0; size += (size_t) res) {
+        if (size + 1 >= capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            args = realloc(args, capacity);
+        }
+        res = read(fd, args + size, capacity - size - 1);
+        if (res < 0)
+            res = 0;
+    }
+    close(fd);
+    args[size] = '\0';
+
+    size_t argc = 0;
+    for (size_t i = 0; i < size; ++i)
+        argc += args[i] == '\0';
+
+    argv = malloc(sizeof (char *) * (argc + 1));
+    char *arg = args;
+    for (size_t i = 0; i < argc; ++i, arg += strlen(arg) + 1)
+        argv[i] = arg;
+    argv[argc] = NULL;
+    return argv;
+}
+
+static int write_spawn_context(void) {
+    int fd = memfd_create("criterion-worker", 0);
+    if (fd == -1)
+        return -1;
+
+    struct worker_context *ctx = &g_worker_context;
+    const char *cgroup = DEF(ctx->cgroup, "");
+    struct spawn_context sctx = {
+        .options = criterion_options,
+        .perf_counters = g_perf_counters,
+        .pipe_fd = ctx->pipe->fds[1],
+        .has_param = ctx->param != NULL,
+        .param_index = ctx->param ? ctx->param->index : 0,
+        .param_size = ctx->param ? ctx->param->size : 0,
+        .suite_size = strlen(ctx->suite->name),
+        .test_size = strlen(ctx->test->name),
+        .cgroup_size = strlen(cgroup),
+    };
+
+    if (!write_all(fd, &sctx, sizeof (sctx))
+            || !write_all(fd, ctx->suite->name, sctx.suite_size)
+            || !write_all(fd, ctx->test->name, sctx.test_size)
+            || !write_all(fd, cgroup, sctx.cgroup_size)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Closes every descriptor of the runner in the spawned worker but its
+ * standard streams, its event pipe and its context: the outputs, sockets and
+ * pipes of the other workers would otherwise outlive the runner's use of them.
+ */
+static bool close_runner_fds(posix_spawn_file_actions_t *actions,
+        int pipe_fd, int context_fd) {
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir)
+        return false;
+
+    bool ok = true;
+    for (struct dirent *ent; ok && (ent = readdir(dir));) {
+        if (ent->d_name[0] == '.')
+            continue;
+        int fd = atoi(ent->d_name);
+        if (fd > STDERR_FILENO && fd != pipe_fd && fd != context_fd
+                && fd != dirfd(dir))
+            ok = !posix_spawn_file_actions_addclose(actions, fd);
+    }
+    closedir(dir);
+    return ok;
+}
+
+static char *read_string(int fd, off_t *offset, size_t size) {
+    char *str = malloc(size + 1);
+    if (pread(fd, str, size, *offset) != (ssize_t) size) {
+        free(str);
+        return NULL;
+    }
+    str[size] = '\0';
+    *offset += (off_t) size;
+    return str;
+}
+
+/*
+ * Runs the test described by the context left by spawn_process, in the
+ * process that it spawned.
+ */
+static void resume_spawned_worker(int fd) {
+    struct spawn_context sctx;
+    off_t offset = sizeof (sctx);
+    if (pread(fd, &sctx, sizeof (sctx), 0) != (ssize_t) sizeof (sctx))
+        exit(-1);
+
+    char *suite_name = read_string(fd, &offset, sctx.suite_size);
+    char *test_name = read_string(fd, &offset, sctx.test_size);
+    char *cgroup = read_string(fd, &offset, sctx.cgroup_size);
+    close(fd);
+    if (!suite_name || !test_name || !cgroup)
+        exit(-1);
+
+    struct criterion_test *test = criterion_find_test(suite_name, test_name);
+    if (!test) {
+        criterion_perror("Could not find the test %s::%s in the spawned "
+                "worker.\n", suite_name, test_name);
+        exit(-1);
+    }
+
+    // the pointers of the runner mean nothing here, and are left unset
+    struct criterion_options *opts = &sctx.options;
+    opts->output_provider = criterion_options.output_provider;
+    opts->pattern = criterion_options.pattern;
+    opts->perf_counters = criterion_options.perf_counters;
+    opts->bench_save = criterion_options.bench_save;
+    opts->bench_compare = criterion_options.bench_compare;
+    opts->cpus = criterion_options.cpus;
+    opts->metrics_socket = criterion_options.metrics_socket;
+    opts->trace = criterion_options.trace;
+    criterion_options = *opts;
+    g_perf_counters = sctx.perf_counters;
+
+    struct criterion_suite implicit = { .name = test->category };
+    struct criterion_suite *suite = DEF(criterion_find_suite(suite_name), &implicit);
+
+    // the parameters may hold pointers, so generate them again
+    struct test_single_param param;
+    if (sctx.has_param) {
+        struct criterion_test_params params = test->data->param_();
+        select_param(test, &params, sctx.param_index, sctx.param_size,
+                &param);
+    }
+
+    struct pipe_handle pipe = { .fds = { -1, sctx.pipe_fd } };
+    g_worker_context = (struct worker_context) {
+        .test = test,
+        .suite = suite,
+        .func = run_test_child,
+        .pipe = &pipe,
+        .param = sctx.has_param ? &param : NULL,
+        .cgroup = *cgroup ? cgroup : NULL,
+    };
+
+    run_worker(&g_worker_context);
+    free(suite_name);
+    free(test_name);
+    free(cgroup);
+}
+# endif
 #endif
 
 #ifdef VANILLA_WIN32
@@ -150,6 +479,27 @@ struct wait_context {
     HANDLE proc_handle;
 };
 
+static uint64_t filetime_to_ns(FILETIME ft) {
+    return (((uint64_t) ft.dwHighDateTime << 32) | ft.dwLowDateTime) * 100;
+}
+
+static struct criterion_resource_usage get_win_usage(HANDLE handle) {
+    struct criterion_resource_usage usage = { .user_time = 0 };
+
+    FILETIME creation, exit, kernel, user;
+    if (GetProcessTimes(handle, &creation, &exit, &kernel, &user)) {
+        usage.user_time = filetime_to_ns(user);
+        usage.system_time = filetime_to_ns(kernel);
+    }
+
+    IO_COUNTERS io;
+    if (GetProcessIoCounters(handle, &io)) {
+        usage.read_bytes = io.ReadTransferCount;
+        usage.write_bytes = io.WriteTransferCount;
+    }
+    return usage;
+}
+
 static void CALLBACK handle_child_terminated(PVOID lpParameter,
                                              CR_UNUSED BOOLEAN TimerOrWaitFired) {
 
@@ -158,20 +508,22 @@ static void CALLBACK handle_child_terminated(PVOID lpParameter,
     struct wait_context *wctx = lpParameter;
 
     int status = get_win_status(wctx->proc_handle);
-    int kind = WORKER_TERMINATED;
-    struct worker_status ws = {
-        (s_proc_handle) { wctx->proc_handle }, get_status(status)
+    struct {
+        struct event_header header;
+        struct worker_status status;
+    } frame = {
+        .status = {
+            (s_proc_handle) { wctx->proc_handle }, get_status(status),
+            get_win_usage(wctx->proc_handle)
+        },
     };
-
-    unsigned long long pid_ull = (unsigned long long) GetProcessId(wctx->proc_handle);
-
-    char buf[sizeof (int) + sizeof (pid_ull) + sizeof (struct worker_status)];
-    memcpy(buf, &kind, sizeof (kind));
-    memcpy(buf + sizeof (kind), &pid_ull, sizeof (pid_ull));
-    memcpy(buf + sizeof (kind) + sizeof (pid_ull), &ws, sizeof (ws));
+    event_header_init(&frame.header, WORKER_TERMINATED,
+            (unsigned long long) GetProcessId(wctx->proc_handle),
+            sizeof (frame.status));
 
     DWORD written;
-    WriteFile(g_worker_pipe->fhs[1], buf, sizeof (buf), &written, NULL);
+    WriteFile(g_worker_pipe->fhs[1], &frame,
+            sizeof (frame.header) + sizeof (frame.status), &written, NULL);
 
     HANDLE whandle = wctx->wait_handle;
     free(lpParameter);
@@ -251,6 +603,15 @@ int resume_child(void) {
     free(param);
     return 1;
 #else
+# ifdef __linux__
+    const char *spawn_context = getenv(SPAWN_CONTEXT_ENV);
+    if (spawn_context) {
+        int fd = atoi(spawn_context);
+        unsetenv(SPAWN_CONTEXT_ENV);
+        resume_spawned_worker(fd);
+        return 1;
+    }
+# endif
 # if defined(__unix__) || defined(__APPLE__)
     struct sigaction sa;
     sa.sa_handler = &handle_sigchld;
@@ -383,6 +744,7 @@ failure:
         return (void *) -1;
     if (pid == 0)
         return NULL;
+    remember_child(pid);
 
     s_proc_handle *handle = smalloc(sizeof (s_proc_handle));
     *handle = (s_proc_handle) { pid };
@@ -390,6 +752,94 @@ failure:
 #endif
 }
 
+s_proc_handle *spawn_process(void) {
+#ifdef __linux__
+    // only the tests can be found back by the spawned worker
+    if (g_worker_context.func != run_test_child)
+        return NULL;
+
+    char **argv = get_self_argv();
+    if (!argv)
+        return NULL;
+
+    int fd = write_spawn_context();
+    if (fd == -1)
+        return (void *) -1;
+
+    size_t nb_env = 0;
+    while (environ[nb_env])
+        ++nb_env;
+
+    char env[sizeof (SPAWN_CONTEXT_ENV) + 16];
+    snprintf(env, sizeof (env), SPAWN_CONTEXT_ENV "=%d", fd);
+
+    char **envp = malloc(sizeof (char *) * (nb_env + 2));
+    memcpy(envp, environ, sizeof (char *) * nb_env);
+    envp[nb_env] = env;
+    envp[nb_env + 1] = NULL;
+
+    pid_t pid;
+    posix_spawn_file_actions_t actions;
+    int res = posix_spawn_file_actions_init(&actions);
+    if (!res) {
+        if (close_runner_fds(&actions, g_worker_context.pipe->fds[1], fd))
+            res = posix_spawn(&pid, "/proc/self/exe", &actions, NULL, argv,
+                    envp);
+        else
+            res = errno ? errno : ENOMEM;
+        posix_spawn_file_actions_destroy(&actions);
+    }
+    free(envp);
+    close(fd);
+    if (res) {
+        errno = res;
+        return (void *) -1;
+    }
+
+    remember_child(pid);
+    affinity_pin_process((unsigned long long) pid);
+
+    s_proc_handle *handle = smalloc(sizeof (s_proc_handle));
+    *handle = (s_proc_handle) { pid };
+    return handle;
+#else
+    return NULL;
+#endif
+}
+
+void set_child_subreaper(bool enabled) {
+#ifdef __linux__
+    prctl(PR_SET_CHILD_SUBREAPER, enabled ? 1 : 0);
+#else
+    (void) enabled;
+#endif
+}
+
+void hold_child_events(bool hold) {
+#ifdef VANILLA_WIN32
+    (void) hold;
+#else
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    pthread_sigmask(hold ? SIG_BLOCK : SIG_UNBLOCK, &mask, NULL);
+#endif
+}
+
+bool forget_child(unsigned long long pid) {
+#ifdef VANILLA_WIN32
+    (void) pid;
+#else
+    for (size_t i = 0; i < g_nb_children; ++i) {
+        if ((unsigned long long) g_children[i] == pid) {
+            g_children[i] = g_children[--g_nb_children];
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
 s_proc_handle *get_current_process() {
     s_proc_handle *handle = smalloc(sizeof (s_proc_handle));
 #ifdef VANILLA_WIN32
@@ -423,3 +873,14 @@ unsigned long long get_process_id_of(s_proc_handle *proc) {
     return (unsigned long long) proc->pid;
 #endif
 }
+
+int kill_process(s_proc_handle *proc, bool force) {
+#ifdef VANILLA_WIN32
+    // there is no polite way to stop a process here; make it look like
+    // it timed out on its own
+    (void) force;
+    return TerminateProcess(proc->handle, CR_EXCEPTION_TIMEOUT) ? 0 : -1;
+#else
+    return kill(proc->pid, force ? SIGKILL : SIGTERM);
+#endif
+}
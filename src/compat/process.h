@@ -26,6 +26,7 @@
 
 # include "criterion/types.h"
 # include "internal.h"
+# include "common.h"
 
 struct proc_handle {
 #ifdef VANILLA_WIN32
@@ -43,19 +44,48 @@ struct worker_context {
     cr_worker_func func;
     struct pipe_handle *pipe;
     struct test_single_param *param;
+    const char *cgroup;
+    bool suite_ready;       // the suite setup already ran in a snapshot
 };
 
-extern struct worker_context g_worker_context;
+extern CR_THREAD_LOCAL struct worker_context g_worker_context;
 
 int resume_child(void);
 
 s_proc_handle *fork_process();
+
+/*
+ * Starts a worker by executing the test binary again rather than forking,
+ * so that the cost does not depend on the size of the runner. Returns NULL
+ * when unsupported, and (void *) -1 on failure.
+ */
+s_proc_handle *spawn_process(void);
 void wait_process(s_proc_handle *handle, int *status);
 
+/*
+ * Has the processes orphaned below the caller reparented to it rather than
+ * to init, so that it still reaps the workers of a zygote or snapshot that
+ * died. Only supported on Linux.
+ */
+void set_child_subreaper(bool enabled);
+
+/*
+ * Returns whether the process was forked or spawned by the caller, rather
+ * than adopted, and stops keeping track of it. Always false on Windows.
+ */
+bool forget_child(unsigned long long pid);
+
+/*
+ * Holds SIGCHLD back in the calling thread, so that its handler does not
+ * run while the state it relies on changes.
+ */
+void hold_child_events(bool hold);
+
 s_proc_handle *get_current_process();
 bool is_current_process(s_proc_handle *proc);
 
 unsigned long long get_process_id(void);
 unsigned long long get_process_id_of(s_proc_handle *proc);
+int kill_process(s_proc_handle *proc, bool force);
 
 #endif /* !COMPAT_PROCESS_H_ */
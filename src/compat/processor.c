@@ -22,8 +22,13 @@
  * THE SOFTWARE.
  */
 
+#define _GNU_SOURCE
 #include "internal.h"
 
+#ifdef __linux__
+# include <sched.h>
+#endif
+
 size_t get_processor_count(void) {
 #ifdef _WIN32
     SYSTEM_INFO sysinfo;
@@ -46,6 +51,11 @@ size_t get_processor_count(void) {
         count = 1;
     return (size_t) count;
 #elif defined(__linux__)
+    // Only count the CPUs we may run on, as restricted by a cgroup cpuset
+    // or by taskset
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof (set), &set) == 0 && CPU_COUNT(&set) > 0)
+        return CPU_COUNT(&set);
     return sysconf(_SC_NPROCESSORS_ONLN);
 #else
 # error System not supported
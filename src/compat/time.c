@@ -90,6 +90,13 @@ int timer_end(double *time, struct timespec_compat *state) {
     return 1;
 }
 
+uint64_t get_timestamp_ns(void) {
+    struct timespec_compat ts;
+    if (gettime_compat(&ts) == -1)
+        return 0;
+    return (uint64_t) ts.tv_sec * GIGA + (uint64_t) ts.tv_nsec;
+}
+
 #if defined(_WIN32) || defined(__CYGWIN__)
 DWORD WINAPI win_raise_timeout(LPVOID ptr) {
     uint64_t *nanos = (uint64_t*) ptr;
@@ -14,6 +14,9 @@ struct timespec_compat {
 bool can_measure_time(void);
 int timer_start(struct timespec_compat *state);
 int timer_end(double *time, struct timespec_compat *state);
+
+// Monotonic timestamp in nanoseconds, or 0 if time cannot be measured.
+uint64_t get_timestamp_ns(void);
 int setup_timeout(uint64_t nanos);
 
 #endif /* !TIMER_H_ */
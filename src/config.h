@@ -0,0 +1,14 @@
+#ifndef CONFIG_H_IN_
+# define CONFIG_H_IN_
+
+/* #undef ENABLE_NLS */
+/* #undef HAVE_PCRE */
+/* #undef ENABLE_VALGRIND_ERRORS */
+#define HAVE_STRTOK_S 0
+#define HAVE_LINUX_PERF_EVENT_H 1
+
+# define LOCALEDIR "/usr/local/share/locale"
+# define PACKAGE "Criterion"
+# define VERSION "2.1.0"
+
+#endif /* !CONFIG_H_IN_ */
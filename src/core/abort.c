@@ -26,7 +26,8 @@
 #include "criterion/asprintf-compat.h"
 #include "io/event.h"
 
-jmp_buf g_pre_test;
+CR_THREAD_LOCAL jmp_buf g_pre_test;
+CR_THREAD_LOCAL jmp_buf *g_test_exit;
 
 void criterion_abort_test(void) {
     longjmp(g_pre_test, 1);
@@ -50,5 +51,8 @@ void criterion_test_die(const char *msg, ...) {
     free(buf);
     free(formatted_msg);
 
+    // the rest of the process must keep running
+    if (g_test_exit)
+        longjmp(*g_test_exit, 1);
     exit(0);
 }
@@ -26,8 +26,12 @@
 
 # include <criterion/abort.h>
 # include <setjmp.h>
+# include "common.h"
 
-extern jmp_buf g_pre_test;
+extern CR_THREAD_LOCAL jmp_buf g_pre_test;
+
+// Where a dying test goes when it shares its process with other tests
+extern CR_THREAD_LOCAL jmp_buf *g_test_exit;
 
 void criterion_test_die(const char *msg, ...);
 
@@ -0,0 +1,436 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "criterion/logging.h"
+#include "criterion/options.h"
+#include "string/strbuf.h"
+#include "baseline.h"
+#include "common.h"
+
+#define BASELINE_VERSION 1
+
+// two-sided 95% quantile of the normal distribution
+#define CI_Z 1.96
+
+// significance level of the regression test
+#define ALPHA 0.05
+
+struct baseline_entry {
+    char *suite;
+    char *name;
+    size_t nb_times;
+    double *times;
+    struct baseline_entry *next;
+};
+
+static struct baseline_entry *baseline;
+
+/*
+ * Minimal JSON reader, that only knows enough to read back the baselines
+ * written by baseline_save, while skipping anything it does not know.
+ */
+
+struct reader {
+    const char *cur;
+};
+
+static void skip_spaces(struct reader *r) {
+    while (*r->cur == ' ' || *r->cur == '\t' || *r->cur == '\n' || *r->cur == '\r')
+        ++r->cur;
+}
+
+static int expect(struct reader *r, char c) {
+    skip_spaces(r);
+    if (*r->cur != c)
+        return 0;
+    ++r->cur;
+    return 1;
+}
+
+static int read_string(struct reader *r, struct strbuf *out) {
+    if (!expect(r, '"'))
+        return 0;
+    for (; *r->cur && *r->cur != '"'; ++r->cur) {
+        if (*r->cur != '\\') {
+            if (out)
+                strbuf_putc(out, *r->cur);
+            continue;
+        }
+
+        char c = *++r->cur;
+        switch (c) {
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'u': {
+                char hex[5] = { 0 };
+                for (size_t i = 0; i < 4; ++i) {
+                    if (!r->cur[1])
+                        return 0;
+                    hex[i] = *++r->cur;
+                }
+                // identifiers are plain C identifiers, so only ASCII is
+                // expected here
+                c = (char) strtol(hex, NULL, 16);
+            } break;
+            case '\0': return 0;
+            default: break;
+        }
+        if (out)
+            strbuf_putc(out, c);
+    }
+    return expect(r, '"');
+}
+
+static int read_number(struct reader *r, double *out) {
+    skip_spaces(r);
+    char *end;
+    double val = strtod(r->cur, &end);
+    if (end == r->cur)
+        return 0;
+    r->cur = end;
+    if (out)
+        *out = val;
+    return 1;
+}
+
+static int skip_value(struct reader *r);
+
+static int skip_members(struct reader *r, char close, int keys) {
+    if (expect(r, close))
+        return 1;
+    do {
+        if (keys && (!read_string(r, NULL) || !expect(r, ':')))
+            return 0;
+        if (!skip_value(r))
+            return 0;
+    } while (expect(r, ','));
+    return expect(r, close);
+}
+
+static int skip_value(struct reader *r) {
+    skip_spaces(r);
+    switch (*r->cur) {
+        case '"': return read_string(r, NULL);
+        case '{': ++r->cur; return skip_members(r, '}', 1);
+        case '[': ++r->cur; return skip_members(r, ']', 0);
+        case 't': case 'f': case 'n':
+            while (*r->cur >= 'a' && *r->cur <= 'z')
+                ++r->cur;
+            return 1;
+        default: return read_number(r, NULL);
+    }
+}
+
+static int read_times(struct reader *r, struct baseline_entry *e) {
+    size_t capacity = 0;
+    if (!expect(r, '['))
+        return 0;
+    if (expect(r, ']'))
+        return 1;
+    do {
+        if (e->nb_times == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            e->times = realloc(e->times, capacity * sizeof (double));
+        }
+        if (!read_number(r, &e->times[e->nb_times]))
+            return 0;
+        ++e->nb_times;
+    } while (expect(r, ','));
+    return expect(r, ']');
+}
+
+static int read_entry(struct reader *r, struct baseline_entry *e) {
+    struct strbuf key = STRBUF_INIT;
+    int ok = expect(r, '{');
+    if (ok && expect(r, '}'))
+        return 0;
+
+    while (ok) {
+        strbuf_clear(&key);
+        ok = read_string(r, &key) && expect(r, ':');
+        if (!ok)
+            break;
+
+        const char *k = key.str ? key.str : "";
+        if (!strcmp(k, "suite") || !strcmp(k, "name")) {
+            struct strbuf val = STRBUF_INIT;
+            ok = read_string(r, &val);
+            char **dst = *k == 's' ? &e->suite : &e->name;
+            free(*dst);
+            *dst = val.str ? val.str : strdup("");
+        } else if (!strcmp(k, "times")) {
+            ok = read_times(r, e);
+        } else {
+            ok = skip_value(r);
+        }
+        if (ok && !expect(r, ','))
+            break;
+    }
+    ok = ok && expect(r, '}');
+    strbuf_free(&key);
+    return ok && e->suite && e->name;
+}
+
+static int read_benchmarks(struct reader *r) {
+    if (!expect(r, '['))
+        return 0;
+    if (expect(r, ']'))
+        return 1;
+
+    int ok;
+    do {
+        struct baseline_entry *e = calloc(1, sizeof (*e));
+        e->next = baseline;
+        baseline = e;
+        ok = read_entry(r, e);
+    } while (ok && expect(r, ','));
+    return ok && expect(r, ']');
+}
+
+static int read_baseline(struct reader *r) {
+    struct strbuf key = STRBUF_INIT;
+    int ok = expect(r, '{');
+    if (ok && expect(r, '}'))
+        return 1;
+
+    while (ok) {
+        strbuf_clear(&key);
+        ok = read_string(r, &key) && expect(r, ':');
+        if (!ok)
+            break;
+
+        if (key.str && !strcmp(key.str, "benchmarks"))
+            ok = read_benchmarks(r);
+        else
+            ok = skip_value(r);
+        if (ok && !expect(r, ','))
+            break;
+    }
+    ok = ok && expect(r, '}');
+    strbuf_free(&key);
+    return ok;
+}
+
+int baseline_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        criterion_perror("Could not open the benchmark baseline %s: %s.\n",
+                path, strerror(errno));
+        return 0;
+    }
+
+    struct strbuf buf = STRBUF_INIT;
+    char chunk[4096];
+    for (size_t read; (read = fread(chunk, 1, sizeof (chunk), f)) > 0;)
+        strbuf_append(&buf, chunk, read);
+    fclose(f);
+
+    struct reader r = { .cur = buf.str ? buf.str : "" };
+    int ok = read_baseline(&r);
+    strbuf_free(&buf);
+
+    if (!ok) {
+        criterion_perror("Could not parse the benchmark baseline %s.\n", path);
+        baseline_free();
+    }
+    return ok;
+}
+
+void baseline_free(void) {
+    for (struct baseline_entry *e = baseline, *next; e; e = next) {
+        next = e->next;
+        free(e->suite);
+        free(e->name);
+        free(e->times);
+        free(e);
+    }
+    baseline = NULL;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+struct ranked {
+    double value;
+    int group;
+};
+
+static int cmp_ranked(const void *a, const void *b) {
+    return cmp_double(&((const struct ranked *) a)->value,
+                      &((const struct ranked *) b)->value);
+}
+
+/*
+ * Two-sided p-value of the Mann-Whitney U test, through its normal
+ * approximation with tie correction.
+ */
+static double mann_whitney_p(const double *x, size_t n,
+                             const double *y, size_t m) {
+    size_t total = n + m;
+    struct ranked *all = malloc(total * sizeof (*all));
+    for (size_t i = 0; i < n; ++i)
+        all[i] = (struct ranked) { x[i], 0 };
+    for (size_t i = 0; i < m; ++i)
+        all[n + i] = (struct ranked) { y[i], 1 };
+    qsort(all, total, sizeof (*all), cmp_ranked);
+
+    double rank_sum = 0, ties = 0;
+    for (size_t i = 0, j; i < total; i = j) {
+        for (j = i + 1; j < total && all[j].value == all[i].value; ++j)
+            continue;
+        double t = (double) (j - i);
+        double rank = (i + 1 + j) / 2.0;  // average rank of the tied values
+        for (size_t k = i; k < j; ++k)
+            if (all[k].group == 0)
+                rank_sum += rank;
+        ties += t * t * t - t;
+    }
+    free(all);
+
+    double u = rank_sum - n * (n + 1) / 2.0;
+    double mean = n * m / 2.0;
+    double var = n * m / 12.0
+            * ((total + 1) - ties / ((double) total * (total - 1)));
+    if (var <= 0)
+        return 1;
+
+    double z = (fabs(u - mean) - 0.5) / sqrt(var);
+    return z <= 0 ? 1 : erfc(z / sqrt(2));
+}
+
+/*
+ * Hodges-Lehmann estimate of the ratio between the samples, and its
+ * confidence interval, taken from the order statistics of all the pairwise
+ * log-ratios. Returned as relative changes.
+ */
+static void estimate_change(const double *x, size_t n,
+                            const double *y, size_t m,
+                            struct criterion_bench_comparison *res) {
+    size_t nm = n * m;
+    double *ratios = malloc(nm * sizeof (double));
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i)
+        for (size_t j = 0; j < m; ++j)
+            if (x[i] > 0 && y[j] > 0)
+                ratios[k++] = log(x[i] / y[j]);
+    nm = k;
+
+    if (!nm) {
+        free(ratios);
+        return;
+    }
+    qsort(ratios, nm, sizeof (double), cmp_double);
+
+    double median = nm % 2 ? ratios[nm / 2]
+                           : (ratios[nm / 2 - 1] + ratios[nm / 2]) / 2;
+    double half = CI_Z * sqrt(n * m * (n + m + 1) / 12.0);
+    double lo = floor(nm / 2.0 - half);
+    size_t lo_i = lo < 0 ? 0 : (size_t) lo;
+    if (lo_i >= nm)
+        lo_i = nm - 1;
+
+    res->change      = exp(median) - 1;
+    res->change_low  = exp(ratios[lo_i]) - 1;
+    res->change_high = exp(ratios[nm - 1 - lo_i]) - 1;
+    free(ratios);
+}
+
+static struct baseline_entry *find_entry(struct criterion_test *test) {
+    for (struct baseline_entry *e = baseline; e; e = e->next) {
+        if (!strcmp(e->suite, test->category) && !strcmp(e->name, test->name))
+            return e;
+    }
+    return NULL;
+}
+
+void baseline_compare(struct criterion_test_stats *stats) {
+    struct criterion_bench_stats *bench = stats->bench;
+    struct baseline_entry *e = find_entry(stats->test);
+    if (!bench || !e || !e->nb_times || !bench->samples)
+        return;
+
+    struct criterion_bench_comparison *res = &bench->baseline;
+    *res = (struct criterion_bench_comparison) { .compared = true };
+
+    res->p_value = mann_whitney_p(bench->sample_times, bench->samples,
+            e->times, e->nb_times);
+    estimate_change(bench->sample_times, bench->samples,
+            e->times, e->nb_times, res);
+
+    res->regressed = res->p_value < ALPHA
+            && res->change > criterion_options.bench_threshold;
+    if (res->regressed)
+        stats->failed = 1;
+}
+
+static void put_entry(struct strbuf *buf, struct criterion_test_stats *ts,
+        const char *sep) {
+    struct criterion_bench_stats *bench = ts->bench;
+
+    strbuf_printf(buf, "%s\n    {\"suite\":", sep);
+    strbuf_put_json_string(buf, ts->test->category);
+    strbuf_puts(buf, ",\"name\":");
+    strbuf_put_json_string(buf, ts->test->name);
+    strbuf_printf(buf, ",\"iterations\":" CR_SIZE_T_FORMAT
+            ",\"median\":%.3f,\"times\":[",
+            bench->iterations, bench->median);
+    for (size_t i = 0; i < bench->samples; ++i)
+        strbuf_printf(buf, "%s%.3f", i ? "," : "", bench->sample_times[i]);
+    strbuf_puts(buf, "]}");
+}
+
+int baseline_save(const char *path, struct criterion_global_stats *stats) {
+    struct strbuf buf = STRBUF_INIT;
+    strbuf_printf(&buf, "{\"version\":%d,\"benchmarks\":[", BASELINE_VERSION);
+
+    const char *sep = "";
+    for (struct criterion_suite_stats *ss = stats->suites; ss; ss = ss->next) {
+        for (struct criterion_test_stats *ts = ss->tests; ts; ts = ts->next) {
+            if (!ts->bench)
+                continue;
+            put_entry(&buf, ts, sep);
+            sep = ",";
+        }
+    }
+    strbuf_puts(&buf, "\n]}\n");
+
+    FILE *f = fopen(path, "w");
+    int ok = f && fwrite(buf.str, 1, buf.size, f) == buf.size;
+    if (f && fclose(f))
+        ok = 0;
+    if (!ok)
+        criterion_perror("Could not save the benchmark baseline to %s: %s.\n",
+                path, strerror(errno));
+    strbuf_free(&buf);
+    return ok;
+}
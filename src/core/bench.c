@@ -0,0 +1,220 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "criterion/bench.h"
+#include "criterion/options.h"
+#include "compat/time.h"
+#include "io/event.h"
+#include "common.h"
+
+// two-sided 95% quantile of the normal distribution
+#define CI_Z 1.96
+
+enum bench_phase {
+    BENCH_IDLE,
+    BENCH_CALIBRATE,
+    BENCH_WARMUP,
+    BENCH_MEASURE,
+    BENCH_DONE,
+};
+
+static struct bench_state {
+    enum bench_phase phase;
+    size_t batch;           // iterations per sample
+    uint64_t start;         // start of the running batch, or of its last resume
+    uint64_t elapsed;       // time measured before the last pause
+    bool paused;
+
+    uint64_t target;        // target time of one sample
+    uint64_t warmup;        // target time of calibration and warmup
+    uint64_t warmed;
+
+    size_t nb_samples;
+    size_t taken;
+    double *samples;
+
+    enum criterion_bench_unit unit;
+    size_t throughput;
+} bench;
+
+void cr_bench_pause(void) {
+    if (bench.paused || bench.phase == BENCH_IDLE || bench.phase == BENCH_DONE)
+        return;
+    bench.elapsed += get_timestamp_ns() - bench.start;
+    bench.paused = true;
+}
+
+void cr_bench_resume(void) {
+    if (!bench.paused)
+        return;
+    bench.paused = false;
+    bench.start = get_timestamp_ns();
+}
+
+void cr_bench_throughput(enum criterion_bench_unit unit, size_t amount) {
+    bench.unit = unit;
+    bench.throughput = amount;
+}
+
+void cr_bench_escape_(CR_UNUSED const volatile void *ptr) {}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static double median_of_sorted(const double *values, size_t n) {
+    if (n % 2)
+        return values[n / 2];
+    return (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+static void send_results(void) {
+    size_t n = bench.taken;
+    size_t size = sizeof (struct criterion_bench_stats) + n * sizeof (double);
+    struct criterion_bench_stats *stats = malloc(size);
+    double *sorted = malloc(n * sizeof (double));
+
+    memcpy(sorted, bench.samples, n * sizeof (double));
+    qsort(sorted, n, sizeof (double), cmp_double);
+
+    *stats = (struct criterion_bench_stats) {
+        .samples    = n,
+        .iterations = bench.batch,
+        .median     = median_of_sorted(sorted, n),
+        .min        = sorted[0],
+        .max        = sorted[n - 1],
+        .unit       = bench.unit,
+        .throughput = bench.throughput,
+    };
+
+    // The order statistics around the median that bound its confidence
+    // interval, which does not assume any distribution of the samples.
+    double half_width = CI_Z * sqrt((double) n) / 2;
+    long lo = lround(n / 2.0 - half_width);
+    long hi = lround(n / 2.0 + half_width + 1);
+    stats->ci_low  = sorted[lo < 1 ? 0 : lo - 1];
+    stats->ci_high = sorted[hi > (long) n ? (long) n - 1 : hi - 1];
+
+    for (size_t i = 0; i < n; ++i)
+        sorted[i] = fabs(sorted[i] - stats->median);
+    qsort(sorted, n, sizeof (double), cmp_double);
+    stats->mad = median_of_sorted(sorted, n);
+
+    // the samples are sent right after the statistics, in order
+    memcpy(stats + 1, bench.samples, n * sizeof (double));
+    criterion_send_event(BENCH, stats, size);
+
+    free(sorted);
+    free(stats);
+}
+
+static size_t next_batch_size(size_t batch, uint64_t elapsed) {
+    // Aim slightly above the target so that the next batch is likely to
+    // be the last one, but never grow by more than 10x at once.
+    double factor = elapsed ? 1.2 * bench.target / elapsed : 10;
+    if (factor > 10)
+        factor = 10;
+    if (factor < 1.5)
+        factor = 1.5;
+    if (batch > SIZE_MAX / 10)
+        return batch;
+    return (size_t) (batch * factor);
+}
+
+// Accounts for a finished batch, returns whether another one is needed.
+static bool bench_step(uint64_t elapsed) {
+    switch (bench.phase) {
+        case BENCH_CALIBRATE: {
+            bench.warmed += elapsed;
+            size_t next = next_batch_size(bench.batch, elapsed);
+            if (elapsed < bench.target && next != bench.batch) {
+                bench.batch = next;
+                break;
+            }
+            bench.phase = bench.warmed >= bench.warmup
+                    ? BENCH_MEASURE : BENCH_WARMUP;
+        } break;
+        case BENCH_WARMUP:
+            bench.warmed += elapsed;
+            if (bench.warmed >= bench.warmup)
+                bench.phase = BENCH_MEASURE;
+            break;
+        case BENCH_MEASURE:
+            bench.samples[bench.taken++] = (double) elapsed / bench.batch;
+            return bench.taken < bench.nb_samples;
+        default: break;
+    }
+    return true;
+}
+
+static void bench_init(void) {
+    uint64_t total = (uint64_t) (criterion_options.bench_time * 1e9);
+
+    bench.nb_samples = criterion_options.bench_samples;
+    if (!bench.nb_samples)
+        bench.nb_samples = 1;
+    bench.samples    = malloc(bench.nb_samples * sizeof (double));
+    bench.target     = total / bench.nb_samples;
+    bench.warmup     = total / 10;
+    bench.batch      = 1;
+    bench.phase      = BENCH_CALIBRATE;
+}
+
+bool cr_bench_next_(size_t *iterations) {
+    uint64_t now = get_timestamp_ns();
+
+    switch (bench.phase) {
+        case BENCH_DONE:
+            return false;
+        case BENCH_IDLE:
+            if (!can_measure_time()) {
+                // Run the body once, so that it is still tested
+                bench.phase = BENCH_DONE;
+                *iterations = 1;
+                return true;
+            }
+            bench_init();
+            break;
+        default: {
+            uint64_t elapsed = bench.elapsed;
+            if (!bench.paused)
+                elapsed += now - bench.start;
+            if (!bench_step(elapsed)) {
+                send_results();
+                free(bench.samples);
+                bench.phase = BENCH_DONE;
+                return false;
+            }
+        } break;
+    }
+
+    *iterations = bench.batch;
+    bench.elapsed = 0;
+    bench.paused = false;
+    bench.start = get_timestamp_ns();
+    return true;
+}
@@ -24,26 +24,83 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "criterion/types.h"
 #include "criterion/stats.h"
 #include "criterion/logging.h"
 #include "criterion/options.h"
 #include "criterion/ordered-set.h"
 #include "report.h"
+#include "stats.h"
 #include "config.h"
 #include "compat/posix.h"
+#include "compat/time.h"
+#include "io/trace.h"
+#include "worker.h"
 
-static inline void nothing() {}
+#ifdef HAVE_ASYNC_HOOKS
+# include <pthread.h>
+#endif
+
+/*
+ * The hooks of each kind are gathered in a flat table, so that dispatching
+ * an event does not go through the linker sections and their placeholder
+ * entries, and an event without hooks costs a single test.
+ */
+struct report_hook {
+    f_report_hook hook;
+    f_criterion_hook callback;
+    void *userdata;
+};
+
+struct report_hook_table g_report_hooks[POST_ALL + 1];
 
-#define IMPL_CALL_REPORT_HOOKS(Kind)                                        \
-    CR_IMPL_SECTION_LIMITS(f_report_hook, CR_HOOK_SECTION(Kind));                 \
-    void call_report_hooks_##Kind(void *data) {                             \
-        for (f_report_hook *hook = GET_SECTION_START(CR_HOOK_SECTION(Kind));   \
-             hook < (f_report_hook*) GET_SECTION_END(CR_HOOK_SECTION(Kind));   \
-             ++hook) {                                                      \
-            (*hook ? *hook : nothing)(data);                                \
-        }                                                                   \
+// Keeps the sections defined when the tests do not declare any hook
+static void placeholder_hook(void) {}
+
+#define PLACEHOLDER_HOOK(Kind)                                              \
+    CR_SECTION_(CR_HOOK_SECTION_STRINGIFY(Kind))                            \
+    f_report_hook placeholder_hook_##Kind = placeholder_hook                \
+    CR_SECTION_SUFFIX_
+
+PLACEHOLDER_HOOK(PRE_ALL);
+PLACEHOLDER_HOOK(PRE_SUITE);
+PLACEHOLDER_HOOK(PRE_INIT);
+PLACEHOLDER_HOOK(PRE_TEST);
+PLACEHOLDER_HOOK(ASSERT);
+PLACEHOLDER_HOOK(THEORY_FAIL);
+PLACEHOLDER_HOOK(TEST_CRASH);
+PLACEHOLDER_HOOK(POST_TEST);
+PLACEHOLDER_HOOK(POST_FINI);
+PLACEHOLDER_HOOK(POST_SUITE);
+PLACEHOLDER_HOOK(POST_ALL);
+
+static void push_hook(e_report_status kind, struct report_hook hook) {
+    struct report_hook_table *t = &g_report_hooks[kind];
+    if (t->size == t->capacity) {
+        t->capacity = t->capacity ? t->capacity * 2 : 4;
+        t->hooks = realloc(t->hooks, t->capacity * sizeof (struct report_hook));
     }
+    t->hooks[t->size++] = hook;
+}
+
+static void push_section_hooks(e_report_status kind,
+                               f_report_hook *start,
+                               f_report_hook *end) {
+    for (f_report_hook *hook = start; hook < end; ++hook) {
+        if (*hook && *hook != (f_report_hook) placeholder_hook)
+            push_hook(kind, (struct report_hook) { .hook = *hook });
+    }
+}
+
+#define PUSH_SECTION_HOOKS(Kind)                                            \
+    push_section_hooks(Kind,                                                \
+            GET_SECTION_START(CR_HOOK_SECTION(Kind)),                       \
+            (f_report_hook*) GET_SECTION_END(CR_HOOK_SECTION(Kind)))
+
+#define IMPL_SECTION_LIMITS(Kind)                                           \
+    CR_DECL_SECTION_LIMITS(f_report_hook, CR_HOOK_SECTION(Kind));           \
+    CR_IMPL_SECTION_LIMITS(f_report_hook, CR_HOOK_SECTION(Kind))
 
 #ifdef _MSC_VER
 f_report_hook CR_SECTION_START_(CR_HOOK_SECTION(PRE_ALL));
@@ -71,27 +128,342 @@ f_report_hook CR_SECTION_END_(CR_HOOK_SECTION(POST_SUITE));
 f_report_hook CR_SECTION_END_(CR_HOOK_SECTION(POST_ALL));
 #endif
 
-IMPL_CALL_REPORT_HOOKS(PRE_ALL);
-IMPL_CALL_REPORT_HOOKS(PRE_SUITE);
-IMPL_CALL_REPORT_HOOKS(PRE_INIT);
-IMPL_CALL_REPORT_HOOKS(PRE_TEST);
-IMPL_CALL_REPORT_HOOKS(ASSERT);
-IMPL_CALL_REPORT_HOOKS(THEORY_FAIL);
-IMPL_CALL_REPORT_HOOKS(TEST_CRASH);
-IMPL_CALL_REPORT_HOOKS(POST_TEST);
-IMPL_CALL_REPORT_HOOKS(POST_FINI);
-IMPL_CALL_REPORT_HOOKS(POST_SUITE);
-IMPL_CALL_REPORT_HOOKS(POST_ALL);
-
-ReportHook(PRE_ALL)(CR_UNUSED struct criterion_test_set *arg) {}
-ReportHook(PRE_SUITE)(CR_UNUSED struct criterion_suite_set *arg) {}
-ReportHook(PRE_INIT)(CR_UNUSED struct criterion_test *arg) {}
-ReportHook(PRE_TEST)(CR_UNUSED struct criterion_test *arg) {}
-ReportHook(ASSERT)(CR_UNUSED struct criterion_assert_stats *arg) {}
-ReportHook(THEORY_FAIL)(CR_UNUSED struct criterion_theory_stats *arg) {}
-ReportHook(TEST_CRASH)(CR_UNUSED struct criterion_test_stats *arg) {}
-ReportHook(POST_TEST)(CR_UNUSED struct criterion_test_stats *arg) {}
-ReportHook(POST_FINI)(CR_UNUSED struct criterion_test_stats *arg) {}
-ReportHook(POST_SUITE)(CR_UNUSED struct criterion_suite_stats *arg) {}
-ReportHook(POST_ALL)(CR_UNUSED struct criterion_global_stats *arg) {}
+IMPL_SECTION_LIMITS(PRE_ALL);
+IMPL_SECTION_LIMITS(PRE_SUITE);
+IMPL_SECTION_LIMITS(PRE_INIT);
+IMPL_SECTION_LIMITS(PRE_TEST);
+IMPL_SECTION_LIMITS(ASSERT);
+IMPL_SECTION_LIMITS(THEORY_FAIL);
+IMPL_SECTION_LIMITS(TEST_CRASH);
+IMPL_SECTION_LIMITS(POST_TEST);
+IMPL_SECTION_LIMITS(POST_FINI);
+IMPL_SECTION_LIMITS(POST_SUITE);
+IMPL_SECTION_LIMITS(POST_ALL);
+
+/*
+ * The hooks declared with ReportHook come first, followed by the ones
+ * registered at runtime, in the order of their registration.
+ */
+static void init_report_hooks(void) {
+    static bool initialized;
+    if (initialized)
+        return;
+    initialized = true;
+
+    PUSH_SECTION_HOOKS(PRE_ALL);
+    PUSH_SECTION_HOOKS(PRE_SUITE);
+    PUSH_SECTION_HOOKS(PRE_INIT);
+    PUSH_SECTION_HOOKS(PRE_TEST);
+    PUSH_SECTION_HOOKS(ASSERT);
+    PUSH_SECTION_HOOKS(THEORY_FAIL);
+    PUSH_SECTION_HOOKS(TEST_CRASH);
+    PUSH_SECTION_HOOKS(POST_TEST);
+    PUSH_SECTION_HOOKS(POST_FINI);
+    PUSH_SECTION_HOOKS(POST_SUITE);
+    PUSH_SECTION_HOOKS(POST_ALL);
+}
+
+static bool valid_hook_kind(e_report_status kind) {
+    return (int) kind >= PRE_ALL && kind <= POST_ALL;
+}
+
+int criterion_register_hook(e_report_status kind,
+                            f_criterion_hook callback,
+                            void *userdata) {
+    if (!valid_hook_kind(kind) || !callback)
+        return 0;
+
+    init_report_hooks();
+    push_hook(kind, (struct report_hook) {
+            .callback = callback,
+            .userdata = userdata,
+        });
+    return 1;
+}
+
+int criterion_unregister_hook(e_report_status kind,
+                              f_criterion_hook callback,
+                              void *userdata) {
+    if (!valid_hook_kind(kind))
+        return 0;
+
+    struct report_hook_table *t = &g_report_hooks[kind];
+    for (size_t i = 0; i < t->size; ++i) {
+        struct report_hook *h = &t->hooks[i];
+        if (h->callback == callback && h->userdata == userdata) {
+            memmove(h, h + 1, (t->size - i - 1) * sizeof (struct report_hook));
+            --t->size;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void run_report_hooks(e_report_status kind, void *data,
+                             unsigned track) {
+    struct report_hook_table *t = &g_report_hooks[kind];
+    uint64_t start = get_timestamp_ns();
+
+    // the table is indexed anew on each call, as a hook may register others
+    size_t i;
+    for (i = 0; i < t->size; ++i) {
+        struct report_hook *h = &t->hooks[i];
+        if (h->callback)
+            h->callback(data, h->userdata);
+        else
+            h->hook(data);
+    }
+
+    g_runner_counters.hooks.calls += i;
+    if (!start)
+        return;
+    uint64_t end = get_timestamp_ns();
+    g_runner_counters.hooks.time += end - start;
+
+    if (g_trace_enabled) {
+        char name[32];
+        snprintf(name, sizeof (name), "hooks %s", trace_event_name(kind));
+        trace_span(track, name, start, end);
+    }
+}
+
+#ifdef HAVE_ASYNC_HOOKS
+/*
+ * With --async-hooks, the hooks run on a thread of their own, so that a
+ * slow hook does not hold back the reaping and spawning of the workers.
+ * The runner queues a copy of the parameter of each phase, as the stats
+ * it points to keep changing afterwards, and blocks once the queue is
+ * full. The queue is drained before POST_ALL, whose hooks run in the
+ * runner as usual.
+ */
+struct report_item {
+    e_report_status kind;
+    void *data;
+};
+
+struct theory_snapshot {
+    struct criterion_theory_stats theory;
+    struct criterion_test_stats stats;
+};
+
+static struct {
+    bool running;
+    bool stopping;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    struct report_item *items;
+    size_t capacity;
+    size_t head;
+    size_t size;
+} g_async = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER,
+    .not_full = PTHREAD_COND_INITIALIZER,
+};
+
+static void *snapshot_of(e_report_status kind, void *data) {
+    switch (kind) {
+        case ASSERT: {
+            struct criterion_assert_stats *copy = malloc(sizeof (*copy));
+            *copy = *(struct criterion_assert_stats *) data;
+            copy->message = strdup(copy->message);
+            return copy;
+        }
+        case THEORY_FAIL: {
+            struct criterion_theory_stats *ths = data;
+            struct theory_snapshot *copy = malloc(sizeof (*copy));
+            copy->stats = *ths->stats;
+            copy->theory.formatted_args = strdup(ths->formatted_args);
+            copy->theory.stats = &copy->stats;
+            return copy;
+        }
+        case TEST_CRASH:
+        case POST_TEST:
+        case POST_FINI: {
+            struct criterion_test_stats *copy = malloc(sizeof (*copy));
+            *copy = *(struct criterion_test_stats *) data;
+            return copy;
+        }
+        case POST_SUITE: {
+            struct criterion_suite_stats *copy = malloc(sizeof (*copy));
+            *copy = *(struct criterion_suite_stats *) data;
+            return copy;
+        }
+        default:
+            // the tests, suites and test set do not change during the run
+            return data;
+    }
+}
+
+static void free_snapshot(e_report_status kind, void *data) {
+    switch (kind) {
+        case ASSERT:
+            free((void *) ((struct criterion_assert_stats *) data)->message);
+            free(data);
+            break;
+        case THEORY_FAIL:
+            free((void *) ((struct theory_snapshot *) data)->theory.formatted_args);
+            free(data);
+            break;
+        case TEST_CRASH:
+        case POST_TEST:
+        case POST_FINI:
+        case POST_SUITE:
+            free(data);
+            break;
+        default: break;
+    }
+}
+
+static void *async_hooks_main(CR_UNUSED void *arg) {
+    pthread_mutex_lock(&g_async.lock);
+    for (;;) {
+        while (!g_async.size && !g_async.stopping)
+            pthread_cond_wait(&g_async.not_empty, &g_async.lock);
+        if (!g_async.size)
+            break;
+
+        struct report_item item = g_async.items[g_async.head];
+        g_async.head = (g_async.head + 1) % g_async.capacity;
+        --g_async.size;
+        pthread_cond_signal(&g_async.not_full);
+        pthread_mutex_unlock(&g_async.lock);
+
+        void *data = item.data;
+        if (item.kind == THEORY_FAIL)
+            data = &((struct theory_snapshot *) data)->theory;
+        run_report_hooks(item.kind, data, TRACE_HOOKS);
+        free_snapshot(item.kind, item.data);
+
+        pthread_mutex_lock(&g_async.lock);
+    }
+    pthread_mutex_unlock(&g_async.lock);
+    return NULL;
+}
+
+/*
+ * The runner still forks the snapshots, and the workers when there is no
+ * zygote: a hook must not be left holding the lock of a standard stream
+ * in those.
+ */
+static void lock_std_streams(void) {
+    if (!g_async.running)
+        return;
+    flockfile(stdout);
+    flockfile(stderr);
+}
+
+static void unlock_std_streams(void) {
+    if (!g_async.running)
+        return;
+    funlockfile(stderr);
+    funlockfile(stdout);
+}
+
+static void start_async_hooks(size_t capacity) {
+    static bool atfork_set;
+    if (!atfork_set) {
+        atfork_set = !pthread_atfork(lock_std_streams, unlock_std_streams,
+                unlock_std_streams);
+    }
+
+    g_async.items = malloc(capacity * sizeof (struct report_item));
+    g_async.capacity = capacity;
+    g_async.head = 0;
+    g_async.size = 0;
+    g_async.stopping = false;
+
+    int res = pthread_create(&g_async.thread, NULL, async_hooks_main, NULL);
+    if (res) {
+        criterion_perror("Could not start the report hook thread: %s. "
+                "Running the hooks in the runner.\n", strerror(res));
+        free(g_async.items);
+        return;
+    }
+    g_async.running = true;
+}
+
+static void queue_report_hooks(e_report_status kind, void *data) {
+    struct report_item item = { kind, snapshot_of(kind, data) };
+
+    pthread_mutex_lock(&g_async.lock);
+    if (g_async.size == g_async.capacity) {
+        uint64_t start = get_timestamp_ns();
+        while (g_async.size == g_async.capacity)
+            pthread_cond_wait(&g_async.not_full, &g_async.lock);
+        ++g_runner_counters.hook_waits.calls;
+        if (start)
+            g_runner_counters.hook_waits.time += get_timestamp_ns() - start;
+    }
+    g_async.items[(g_async.head + g_async.size) % g_async.capacity] = item;
+    ++g_async.size;
+    pthread_cond_signal(&g_async.not_empty);
+    pthread_mutex_unlock(&g_async.lock);
+}
+
+void report_drain(void) {
+    if (!g_async.running)
+        return;
+
+    pthread_mutex_lock(&g_async.lock);
+    g_async.stopping = true;
+    pthread_cond_signal(&g_async.not_empty);
+    pthread_mutex_unlock(&g_async.lock);
+
+    pthread_join(g_async.thread, NULL);
+    g_async.running = false;
+    free(g_async.items);
+    g_async.items = NULL;
+}
+
+size_t report_queue_depth(void) {
+    pthread_mutex_lock(&g_async.lock);
+    size_t size = g_async.size;
+    pthread_mutex_unlock(&g_async.lock);
+    return size;
+}
+#else
+void report_drain(void) {}
+
+size_t report_queue_depth(void) {
+    return 0;
+}
+#endif
+
+void report_init(void) {
+    init_report_hooks();
+}
+
+void report_start_async(void) {
+#ifdef HAVE_ASYNC_HOOKS
+    if (criterion_options.async_hooks && !g_async.running)
+        start_async_hooks(criterion_options.async_hooks);
+#endif
+}
+
+void log_done_(const char *type, uint64_t start) {
+    ++g_runner_counters.logs.calls;
+    if (!start)
+        return;
+    uint64_t end = get_timestamp_ns();
+    g_runner_counters.logs.time += end - start;
 
+    if (g_trace_enabled) {
+        char name[48];
+        snprintf(name, sizeof (name), "log %s", type);
+        trace_span(TRACE_RUNNER, name, start, end);
+    }
+}
+
+void call_report_hooks(e_report_status kind, void *data) {
+#ifdef HAVE_ASYNC_HOOKS
+    // POST_ALL has nothing left to wait for
+    if (g_async.running && kind != POST_ALL && is_runner()) {
+        queue_report_hooks(kind, data);
+        return;
+    }
+#endif
+    run_report_hooks(kind, data, TRACE_RUNNER);
+}
@@ -26,27 +26,52 @@
 
 # include "criterion/hooks.h"
 # include "criterion/options.h"
+# include "compat/time.h"
+# include "io/output.h"
 
-# define report(Kind, Data) call_report_hooks_##Kind(Data)
-
-# define DECL_CALL_REPORT_HOOKS(Kind)                         \
-    CR_DECL_SECTION_LIMITS(f_report_hook, CR_HOOK_SECTION(Kind));   \
-    void call_report_hooks_##Kind(void *data)
-
-DECL_CALL_REPORT_HOOKS(PRE_ALL);
-DECL_CALL_REPORT_HOOKS(PRE_SUITE);
-DECL_CALL_REPORT_HOOKS(PRE_INIT);
-DECL_CALL_REPORT_HOOKS(PRE_TEST);
-DECL_CALL_REPORT_HOOKS(ASSERT);
-DECL_CALL_REPORT_HOOKS(THEORY_FAIL);
-DECL_CALL_REPORT_HOOKS(TEST_CRASH);
-DECL_CALL_REPORT_HOOKS(POST_TEST);
-DECL_CALL_REPORT_HOOKS(POST_FINI);
-DECL_CALL_REPORT_HOOKS(POST_SUITE);
-DECL_CALL_REPORT_HOOKS(POST_ALL);
-
-#define log(Type, ...) \
-    log_(criterion_options.output_provider->log_ ## Type, __VA_ARGS__);
+# if defined(__unix__) || defined(__APPLE__)
+#  define HAVE_ASYNC_HOOKS 1
+# endif
+
+struct report_hook;
+
+struct report_hook_table {
+    struct report_hook *hooks;
+    size_t size;
+    size_t capacity;
+};
+
+extern struct report_hook_table g_report_hooks[POST_ALL + 1];
+
+// The kinds without any hook are skipped without a call
+# define report(Kind, Data)                                 \
+    (g_report_hooks[Kind].size                              \
+        ? call_report_hooks(Kind, Data) : (void) 0)
+
+void report_init(void);
+
+/*
+ * Starts the hook thread of --async-hooks. This comes after the zygote is
+ * forked, which would otherwise inherit whatever the hooks hold.
+ */
+void report_start_async(void);
+void report_drain(void);
+
+// The phases queued for the hooks with --async-hooks
+size_t report_queue_depth(void);
+void call_report_hooks(e_report_status kind, void *data);
+void log_done_(const char *type, uint64_t start);
+
+// Each call is counted, and shows up on the runner track of --trace
+#define log(Type, ...) do {                                                 \
+        uint64_t log_start_ = get_timestamp_ns();                           \
+        for (struct criterion_output *o_ = g_outputs; o_; o_ = o_->next) {  \
+            set_current_output(o_);                                         \
+            log_(o_->provider->log_ ## Type, __VA_ARGS__);                  \
+        }                                                                   \
+        set_current_output(NULL);                                           \
+        log_done_(#Type, log_start_);                                       \
+    } while (0)
 #define log_(Log, ...) \
     (Log ? Log(__VA_ARGS__) : nothing());
 
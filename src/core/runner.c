@@ -27,17 +27,29 @@
 #include <errno.h>
 #include <csptr/smalloc.h>
 #include <valgrind/valgrind.h>
+#if defined(__unix__) || defined(__APPLE__)
+# include <sys/resource.h>
+#endif
 #include "criterion/criterion.h"
 #include "criterion/options.h"
 #include "criterion/ordered-set.h"
 #include "criterion/logging.h"
 #include "compat/time.h"
 #include "compat/posix.h"
-#include "compat/processor.h"
+#include "compat/perf.h"
+#include "compat/affinity.h"
+#include "compat/cgroup.h"
+#include "compat/pressure.h"
 #include "wrappers/wrap.h"
+#include "thread_pool.h"
+#include "snapshot.h"
+#include "zygote.h"
 #include "string/i18n.h"
 #include "io/event.h"
+#include "io/metrics.h"
+#include "io/trace.h"
 #include "runner_coroutine.h"
+#include "baseline.h"
 #include "stats.h"
 #include "runner.h"
 #include "report.h"
@@ -60,6 +72,17 @@ static msg_t msg_valgrind_early_exit = N_("%1$sWarning! Criterion has detected "
 static msg_t msg_valgrind_jobs = N_("%1$sWarning! Criterion has detected "
         "that it is running under valgrind, but the number of jobs have been "
         "explicitely set. Reports might appear confusing!%2$s\n");
+
+static msg_t msg_perf_unavailable = N_("%1$sWarning! The following "
+        "performance counters are not available and will not be measured: "
+        "%2$s (%3$s).%4$s\n");
+
+static msg_t msg_jobs_start = N_("Adaptive jobs: starting with %1$lu "
+        "workers, and up to %2$lu.\n");
+
+static msg_t msg_jobs_change = N_("Adaptive jobs: %1$lu -> %2$lu workers "
+        "(CPU pressure: %3$.0f%%, memory pressure: %4$.0f%%, "
+        "memory available: %5$.0f%%).\n");
 #else
 static msg_t msg_valgrind_early_exit = "%sWarning! Criterion has detected "
         "that it is running under valgrind, but the no_early_exit option is "
@@ -68,6 +91,17 @@ static msg_t msg_valgrind_early_exit = "%sWarning! Criterion has detected "
 static msg_t msg_valgrind_jobs = "%sWarning! Criterion has detected "
         "that it is running under valgrind, but the number of jobs have been "
         "explicitely set. Reports might appear confusing!%s\n";
+
+static msg_t msg_perf_unavailable = "%sWarning! The following "
+        "performance counters are not available and will not be measured: "
+        "%s (%s).%s\n";
+
+static msg_t msg_jobs_start = "Adaptive jobs: starting with %lu "
+        "workers, and up to %lu.\n";
+
+static msg_t msg_jobs_change = "Adaptive jobs: %lu -> %lu workers "
+        "(CPU pressure: %.0f%%, memory pressure: %.0f%%, "
+        "memory available: %.0f%%).\n";
 #endif
 
 
@@ -121,6 +155,23 @@ void criterion_register_test(struct criterion_test_set *set,
     ++set->tests;
 }
 
+struct criterion_test *criterion_find_test(const char *suite, const char *name) {
+    FOREACH_TEST_SEC(test) {
+        if (*test && !strcmp((*test)->category, suite)
+                && !strcmp((*test)->name, name))
+            return *test;
+    }
+    return NULL;
+}
+
+struct criterion_suite *criterion_find_suite(const char *name) {
+    FOREACH_SUITE_SEC(s) {
+        if (*s && !strcmp((*s)->name, name))
+            return *s;
+    }
+    return NULL;
+}
+
 struct criterion_test_set *criterion_init(void) {
     struct criterion_ordered_set *suites = new_ordered_set(cmp_suite, dtor_suite_set);
 
@@ -162,6 +213,63 @@ f_wrapper *g_wrappers[] = {
     [CR_LANG_CPP]   = cpp_wrap,
 };
 
+double get_test_timeout(struct criterion_test *test,
+                        struct criterion_suite *suite) {
+    if (test->data->timeout != 0)
+        return test->data->timeout;
+    if (suite->data && suite->data->timeout != 0)
+        return suite->data->timeout;
+    return criterion_options.timeout;
+}
+
+struct cgroup_limits get_test_limits(struct criterion_test *test,
+                                    struct criterion_suite *suite) {
+    struct criterion_test_extra_data *sd = suite->data;
+    struct cgroup_limits limits = {
+        .memory = criterion_options.memory_limit,
+        .cpus = criterion_options.cpu_quota,
+    };
+    if (test->data->memory_limit)
+        limits.memory = test->data->memory_limit;
+    else if (sd && sd->memory_limit)
+        limits.memory = sd->memory_limit;
+    if (test->data->cpu_quota > 0)
+        limits.cpus = test->data->cpu_quota;
+    else if (sd && sd->cpu_quota > 0)
+        limits.cpus = sd->cpu_quota;
+    return limits;
+}
+
+enum criterion_isolation get_test_isolation(struct criterion_test *test,
+                                           struct criterion_suite *suite) {
+    struct criterion_test_extra_data *sd = suite->data;
+    enum criterion_isolation isolation = criterion_options.isolation;
+    if (test->data->isolation)
+        isolation = test->data->isolation;
+    else if (sd && sd->isolation)
+        isolation = sd->isolation;
+
+#ifdef HAVE_THREAD_POOL
+    if (isolation != CR_ISOLATION_THREAD)
+        return CR_ISOLATION_PROCESS;
+
+    // the expected signals and exit codes, the resource limits, the
+    // benchmarks and the suite snapshots all need a process of their own,
+    // and the parameters may point to memory allocated after the pool was
+    // started
+    struct cgroup_limits limits = get_test_limits(test, suite);
+    if (test->data->signal || test->data->exit_code
+            || test->data->kind_ != CR_TEST_NORMAL
+            || limits.memory || limits.cpus > 0
+            || snapshot_enabled(suite)
+            || RUNNING_ON_VALGRIND)
+        return CR_ISOLATION_PROCESS;
+    return CR_ISOLATION_THREAD;
+#else
+    return CR_ISOLATION_PROCESS;
+#endif
+}
+
 void run_test_child(struct criterion_test *test,
                     struct criterion_suite *suite) {
 
@@ -169,10 +277,11 @@ void run_test_child(struct criterion_test *test,
     VALGRIND_ENABLE_ERROR_REPORTING;
 #endif
 
-    if (suite->data && suite->data->timeout != 0 && test->data->timeout == 0)
-        setup_timeout((uint64_t) (suite->data->timeout * 1e9));
-    else if (test->data->timeout != 0)
-        setup_timeout((uint64_t) (test->data->timeout * 1e9));
+    // the timer would fire for the whole process: the tests that share it
+    // only have the timeouts the runner enforces
+    double timeout = get_test_timeout(test, suite);
+    if (timeout > 0 && !g_test_exit)
+        setup_timeout((uint64_t) (timeout * 1e9));
 
     g_wrappers[test->data->lang_](test, suite);
 }
@@ -188,41 +297,102 @@ void run_test_child(struct criterion_test *test,
 
 s_pipe_handle *g_worker_pipe;
 
+// counts a test whose worker died before it could report it
+static void register_test(struct execution_context *ctx) {
+    if (ctx->registered)
+        return;
+    stat_push_event(ctx->stats,
+            ctx->suite_stats,
+            ctx->test_stats,
+            &(struct event) { .kind = PRE_INIT });
+    ctx->registered = true;
+}
+
 static void handle_worker_terminated(struct event *ev,
         struct execution_context *ctx) {
 
     struct worker_status *ws = ev->data;
     struct process_status status = ws->status;
 
-    if (status.kind == SIGNAL) {
-        if (status.status == SIGPROF) {
-            ctx->test_stats->timed_out = true;
-            double elapsed_time = ctx->test->data->timeout;
-            if (elapsed_time == 0 && ctx->suite->data)
-                elapsed_time = ctx->suite->data->timeout;
-            push_event(POST_TEST, .data = &elapsed_time);
+    ctx->test_stats->resource_usage = ws->usage;
+
+    // the cgroup of the worker also accounts for the processes it spawned
+    struct cgroup_usage cg = { .memory_peak = 0 };
+    if (ctx->cgroup && cgroup_release(ctx->cgroup, &cg)) {
+        struct criterion_resource_usage *usage = &ctx->test_stats->resource_usage;
+        usage->memory_peak = cg.memory_peak;
+        usage->throttled_time = cg.throttled_time;
+        if (cg.user_time || cg.system_time) {
+            usage->user_time = cg.user_time;
+            usage->system_time = cg.system_time;
+        }
+    }
+    ctx->cgroup = NULL;
+    ctx->test_stats->timestamps.exit = ev->timestamp;
+    ctx->test_stats->timestamps.reap = get_timestamp_ns();
+    stat_push_timings(ctx->stats, ctx->suite_stats, ctx->test_stats);
+
+    if (ctx->cleaned_up) {
+        report(POST_FINI, ctx->test_stats);
+        log(post_fini, ctx->test_stats);
+    }
+
+    // the worker was killed by --fail-fast: a test that did not finish is
+    // cancelled rather than failed, whatever its worker died of.
+    if (ctx->cancelled) {
+        if (!ctx->normal_finish) {
+            register_test(ctx);
+            stat_push_cancel(ctx->stats, ctx->suite_stats, ctx->test_stats);
+            log(test_cancel, ctx->test_stats);
+        } else if (!ctx->cleaned_up) {
             push_event(POST_FINI);
-            log(test_timeout, ctx->test_stats);
-            return;
+            log(post_fini, ctx->test_stats);
         }
+        return;
+    }
+
+    // a worker the runner had to kill is reported as timed out, whatever
+    // the way it died, unless it managed to complete the test in between
+    bool timed_out = status.kind == SIGNAL && status.status == SIGPROF;
+    if (ctx->timed_out && !ctx->cleaned_up)
+        timed_out = true;
+
+    // the kernel killed the worker for exceeding its memory limit
+    bool oom_killed = cg.oom_killed && status.kind == SIGNAL;
+    ctx->test_stats->oom_killed = oom_killed;
+    if (oom_killed)
+        timed_out = false;
+
+    if (timed_out) {
+        ctx->test_stats->timed_out = true;
+        struct post_test_data data = {
+            .elapsed_time = get_test_timeout(ctx->test, ctx->suite),
+        };
+        push_event(POST_TEST, .data = &data);
+        push_event(POST_FINI);
+        log(test_timeout, ctx->test_stats);
+        return;
+    }
 
+    if (status.kind == SIGNAL) {
         if (ctx->normal_finish || !ctx->test_started) {
-            log(other_crash, ctx->test_stats);
             if (!ctx->test_started) {
+                register_test(ctx);
                 stat_push_event(ctx->stats,
                         ctx->suite_stats,
                         ctx->test_stats,
                         &(struct event) { .kind = TEST_CRASH });
             }
+            log(other_crash, ctx->test_stats);
             return;
         }
         ctx->test_stats->signal = status.status;
-        if (ctx->test->data->signal == 0) {
+        if (ctx->test->data->signal == 0 || oom_killed) {
             push_event(TEST_CRASH);
             log(test_crash, ctx->test_stats);
         } else {
-            double elapsed_time = 0;
-            push_event(POST_TEST, .data = &elapsed_time);
+            struct post_test_data data = { .elapsed_time = 0 };
+            push_event(POST_TEST, .data = &data);
             log(post_test, ctx->test_stats);
             push_event(POST_FINI);
             log(post_fini, ctx->test_stats);
@@ -230,8 +400,8 @@ static void handle_worker_terminated(struct event *ev,
     } else {
         if (ctx->aborted) {
             if (!ctx->normal_finish) {
-                double elapsed_time = 0;
-                push_event(POST_TEST, .data = &elapsed_time);
+                struct post_test_data data = { .elapsed_time = 0 };
+                push_event(POST_TEST, .data = &data);
                 log(post_test, ctx->test_stats);
             }
             if (!ctx->cleaned_up) {
@@ -241,13 +411,14 @@ static void handle_worker_terminated(struct event *ev,
             return;
         }
         if ((ctx->normal_finish && !ctx->cleaned_up) || !ctx->test_started) {
-            log(abnormal_exit, ctx->test_stats);
             if (!ctx->test_started) {
+                register_test(ctx);
                 stat_push_event(ctx->stats,
                         ctx->suite_stats,
                         ctx->test_stats,
                         &(struct event) { .kind = TEST_CRASH });
             }
+            log(abnormal_exit, ctx->test_stats);
             return;
         }
         ctx->test_stats->exit_code = status.status;
@@ -256,8 +427,8 @@ static void handle_worker_terminated(struct event *ev,
                 push_event(TEST_CRASH);
                 log(abnormal_exit, ctx->test_stats);
             } else {
-                double elapsed_time = 0;
-                push_event(POST_TEST, .data = &elapsed_time);
+                struct post_test_data data = { .elapsed_time = 0 };
+                push_event(POST_TEST, .data = &data);
                 log(post_test, ctx->test_stats);
                 push_event(POST_FINI);
                 log(post_fini, ctx->test_stats);
@@ -266,16 +437,22 @@ static void handle_worker_terminated(struct event *ev,
     }
 }
 
-static void handle_event(struct event *ev) {
+static void dispatch_event(struct event *ev) {
     struct execution_context *ctx = &ev->worker->ctx;
     if (ev->kind < WORKER_TERMINATED)
         stat_push_event(ctx->stats, ctx->suite_stats, ctx->test_stats, ev);
     switch (ev->kind) {
         case PRE_INIT:
+            ctx->registered = true;
+            ctx->test_stats->timestamps.pre_init = ev->timestamp;
+            // the timeout counts from the start of the test, not of its worker
+            if (ctx->deadline && !ctx->timed_out)
+                set_test_deadline(ctx, ev->timestamp, 0);
             report(PRE_INIT, ctx->test);
             log(pre_init, ctx->test);
             break;
         case PRE_TEST:
+            ctx->test_stats->timestamps.pre_test = ev->timestamp;
             report(PRE_TEST, ctx->test);
             log(pre_test, ctx->test);
             ctx->test_started = true;
@@ -297,14 +474,24 @@ static void handle_event(struct event *ev) {
             ctx->test_stats->failed = 1;
             ctx->aborted = true;
             break;
+        case BENCH:
+            // the statistics now belong to the test stats
+            free(ctx->test_stats->bench);
+            ctx->test_stats->bench = ev->data;
+            ev->data = NULL;
+            if (criterion_options.bench_compare)
+                baseline_compare(ctx->test_stats);
+            break;
         case POST_TEST:
+            ctx->test_stats->timestamps.post_test = ev->timestamp;
             report(POST_TEST, ctx->test_stats);
             log(post_test, ctx->test_stats);
             ctx->normal_finish = true;
             break;
         case POST_FINI:
-            report(POST_FINI, ctx->test_stats);
-            log(post_fini, ctx->test_stats);
+            // POST_FINI is reported once the worker has been reaped, so
+            // that hooks and outputs get the complete timings of the test
+            ctx->test_stats->timestamps.post_fini = ev->timestamp;
             ctx->cleaned_up = true;
             break;
         case WORKER_TERMINATED:
@@ -313,23 +500,74 @@ static void handle_event(struct event *ev) {
     }
 }
 
+static void handle_event(struct event *ev) {
+    uint64_t start = get_timestamp_ns();
+    dispatch_event(ev);
+
+    ++g_runner_counters.events.calls;
+    if (!start)
+        return;
+    uint64_t end = get_timestamp_ns();
+    g_runner_counters.events.time += end - start;
+
+    if (g_trace_enabled) {
+        trace_span(TRACE_RUNNER, trace_event_name(ev->kind), start, end);
+        if (ev->kind == WORKER_TERMINATED)
+            trace_test(ev->worker_index, ev->worker->ctx.test_stats);
+    }
+}
+
+struct pattern_list {
+    const char **patterns;
+    size_t size;
+};
+
+static struct pattern_list g_included_patterns;
+static struct pattern_list g_excluded_patterns;
+
+void criterion_add_test_pattern(const char *pattern, bool exclude) {
+    struct pattern_list *l = exclude
+        ? &g_excluded_patterns
+        : &g_included_patterns;
+    l->patterns = realloc(l->patterns, sizeof (char *) * (l->size + 1));
+    l->patterns[l->size++] = pattern;
+}
+
 #ifdef HAVE_PCRE
 void disable_unmatching(struct criterion_test_set *set) {
+    struct pattern_list *inc = &g_included_patterns;
+    struct pattern_list *exc = &g_excluded_patterns;
+
+    // the patterns of the command line override the one of the environment
+    const char *include[inc->size + 1];
+    size_t nb_include = 0;
+    if (criterion_options.pattern && !inc->size)
+        include[nb_include++] = criterion_options.pattern;
+    for (size_t i = 0; i < inc->size; ++i)
+        include[nb_include++] = inc->patterns[i];
+
+    if (!nb_include && !exc->size)
+        return;
+
+    // all the patterns are compiled once into a single matcher
+    const char *errmsg;
+    struct extmatch_matcher *m = extmatch_compile(include, nb_include,
+            exc->patterns, exc->size, &errmsg);
+    if (!m) {
+        criterion_perror("Invalid test pattern: %s.\n", errmsg);
+        exit(1);
+    }
+
     FOREACH_SET(struct criterion_suite_set *s, set->suites) {
         if ((s->suite.data && s->suite.data->disabled) || !s->tests)
             continue;
 
         FOREACH_SET(struct criterion_test *test, s->tests) {
-            const char *errmsg;
-            int ret = extmatch(criterion_options.pattern, test->data->identifier_, &errmsg);
-            if (ret == -10) {
-                printf("pattern error: %s\n", errmsg);
-                exit(1);
-            } else if (ret < 0) {
+            if (!extmatch_matches(m, test->data->identifier_))
                 test->data->disabled = true;
-            }
         }
     }
+    extmatch_free(m);
 }
 #endif
 
@@ -342,6 +580,7 @@ struct criterion_test_set *criterion_initialize(void) {
     if (RUNNING_ON_VALGRIND) {
         criterion_options.no_early_exit = 1;
         criterion_options.jobs = 1;
+        criterion_options.adaptive_jobs = false;
     }
 
     if (resume_child()) // (windows only) resume from the fork
@@ -353,72 +592,664 @@ struct criterion_test_set *criterion_initialize(void) {
 void criterion_finalize(struct criterion_test_set *set) {
     sfree(set);
 
+    free(g_included_patterns.patterns);
+    free(g_excluded_patterns.patterns);
+    g_included_patterns = (struct pattern_list) { .size = 0 };
+    g_excluded_patterns = (struct pattern_list) { .size = 0 };
+
 #ifndef ENABLE_VALGRIND_ERRORS
     VALGRIND_ENABLE_ERROR_REPORTING;
 #endif
 }
 
+// Scopes cancelled by --fail-fast: suites or parameterized tests, depending
+// on the scope, unless the whole run is.
+static bool g_run_cancelled;
+static const void **g_cancelled_scopes;
+static size_t g_nb_cancelled_scopes;
+
+static bool is_scope_cancelled(const void *scope) {
+    for (size_t i = 0; i < g_nb_cancelled_scopes; ++i)
+        if (g_cancelled_scopes[i] == scope)
+            return true;
+    return false;
+}
+
+bool is_test_cancelled(struct criterion_test *test,
+                       struct criterion_suite *suite) {
+    return g_run_cancelled
+        || is_scope_cancelled(test)
+        || is_scope_cancelled(suite);
+}
+
+static const void *fail_fast_scope(struct execution_context *ctx) {
+    switch (criterion_options.fail_fast_scope) {
+        case CR_FAIL_FAST_SUITE: return ctx->suite;
+        case CR_FAIL_FAST_PARAM: return ctx->test;
+        default: return NULL;
+    }
+}
+
+// only the events that settle the outcome of a test can trigger fail-fast
+static bool ends_test(int kind) {
+    return kind == POST_TEST || kind == TEST_CRASH || kind == WORKER_TERMINATED;
+}
+
+static void handle_fail_fast(struct worker_set *workers, struct worker *failed) {
+    struct execution_context *fctx = &failed->ctx;
+    struct criterion_test_stats *ts = fctx->test_stats;
+    if (fctx->cancelled || !(ts->failed || ts->failed_asserts))
+        return;
+
+    // only the other instances of a parameterized test can be cancelled
+    if (criterion_options.fail_fast_scope == CR_FAIL_FAST_PARAM
+            && fctx->test->data->kind_ != CR_TEST_PARAMETERIZED)
+        return;
+
+    const void *scope = fail_fast_scope(fctx);
+    if (scope ? is_scope_cancelled(scope) : g_run_cancelled)
+        return;
+
+    if (scope) {
+        g_cancelled_scopes = realloc(g_cancelled_scopes,
+                sizeof (void *) * (g_nb_cancelled_scopes + 1));
+        g_cancelled_scopes[g_nb_cancelled_scopes++] = scope;
+    } else {
+        g_run_cancelled = true;
+    }
+
+    for (size_t i = 0; i < workers->max_workers; ++i) {
+        struct worker *w = workers->workers[i];
+        if (!w || w == failed || w->ctx.cleaned_up)
+            continue;
+        if (scope && fail_fast_scope(&w->ctx) != scope)
+            continue;
+
+        w->ctx.cancelled = true;
+        if (kill_worker(w, true) == -1 && errno != ESRCH) {
+            criterion_perror("Could not kill the worker of the cancelled "
+                    "test %s::%s: %s.\n", w->ctx.suite->name,
+                    w->ctx.test->name, strerror(errno));
+        }
+    }
+}
+
+static void reset_fail_fast(void) {
+    free(g_cancelled_scopes);
+    g_cancelled_scopes = NULL;
+    g_nb_cancelled_scopes = 0;
+    g_run_cancelled = false;
+}
+
+// grace period between the SIGTERM and the SIGKILL of an overdue worker
+#define TIMEOUT_KILL_GRACE_NS 1000000000ull
+
+// kills the workers whose test overstayed its timeout, and returns the time
+// left until the next deadline, or -1 if there is none to watch.
+static int64_t enforce_timeouts(struct worker_set *workers) {
+    uint64_t now = get_timestamp_ns();
+    int64_t next = -1;
+    for (size_t i = 0; i < workers->max_workers; ++i) {
+        struct worker *w = workers->workers[i];
+        if (!w || !w->ctx.deadline)
+            continue;
+
+        struct execution_context *ctx = &w->ctx;
+        if (now >= ctx->deadline) {
+            // ask politely first, then stop waiting for an answer
+            bool force = ctx->kills > 0;
+            if (kill_worker(w, force) == -1 && errno != ESRCH) {
+                criterion_perror("Could not kill the worker of the timed "
+                        "out test %s::%s: %s.\n", ctx->suite->name,
+                        ctx->test->name, strerror(errno));
+            }
+            ctx->timed_out = true;
+            ++ctx->kills;
+            ctx->deadline = force ? 0 : now + TIMEOUT_KILL_GRACE_NS;
+            if (!ctx->deadline)
+                continue;
+        }
+
+        int64_t left = (int64_t) (ctx->deadline - now);
+        if (next == -1 || left < next)
+            next = left;
+    }
+    return next;
+}
+
+struct job_control {
+    bool adaptive;
+    size_t target;          // number of workers to keep running
+    size_t max;
+    uint64_t next_sample;
+    struct pressure_sample last;
+};
+
+// Thresholds of the adaptive jobs, as fractions of the sampling interval
+// spent with some task stalled, and of the memory usable by the tests.
+#define JOBS_SAMPLE_INTERVAL_NS 500000000ull
+#define JOBS_CPU_PRESSURE_HIGH  0.40
+#define JOBS_CPU_PRESSURE_LOW   0.10
+#define JOBS_MEM_PRESSURE_HIGH  0.05
+#define JOBS_MEM_AVAILABLE_LOW  0.10
+
+static void init_job_control(struct job_control *jobs) {
+    size_t cpus = affinity_worker_cpus();
+    *jobs = (struct job_control) {
+        .adaptive = criterion_options.adaptive_jobs && !criterion_options.jobs,
+        .target = DEF(criterion_options.jobs, cpus),
+    };
+    if (!jobs->adaptive) {
+        jobs->max = jobs->target;
+        return;
+    }
+
+    // start from what the CPU quota lets us run, and allow twice as many
+    // workers as CPUs for the tests that mostly wait
+    size_t quota = pressure_cpu_quota();
+    if (quota && quota < cpus)
+        jobs->target = quota;
+    jobs->max = jobs->target * 2;
+
+    pressure_sample(&jobs->last);
+    jobs->next_sample = jobs->last.timestamp + JOBS_SAMPLE_INTERVAL_NS;
+    criterion_pinfo(CRITERION_PREFIX_DASHES, _(msg_jobs_start),
+            (unsigned long) jobs->target, (unsigned long) jobs->max);
+}
+
+static double stall_ratio(uint64_t prev, uint64_t cur, uint64_t elapsed_ns) {
+    if (cur <= prev || !elapsed_ns)
+        return 0;
+    return (cur - prev) * 1000. / elapsed_ns;
+}
+
+/*
+ * Grows or shrinks the number of workers from the CPU and memory pressure
+ * since the last sample. Running workers are never stopped: the runner only
+ * refrains from spawning new ones until the count drops below the target.
+ */
+static void adjust_jobs(struct job_control *jobs, size_t active, bool pending) {
+    uint64_t now = get_timestamp_ns();
+    if (!jobs->adaptive || now < jobs->next_sample)
+        return;
+    jobs->next_sample = now + JOBS_SAMPLE_INTERVAL_NS;
+
+    struct pressure_sample s;
+    if (!pressure_sample(&s))
+        return;
+
+    double cpu = 0, mem = 0, avail = 1;
+    if (s.has_psi && jobs->last.has_psi) {
+        uint64_t elapsed = s.timestamp - jobs->last.timestamp;
+        cpu = stall_ratio(jobs->last.cpu_stall, s.cpu_stall, elapsed);
+        mem = stall_ratio(jobs->last.mem_stall, s.mem_stall, elapsed);
+    }
+    if (s.mem_total)
+        avail = (double) s.mem_available / s.mem_total;
+    jobs->last = s;
+
+    size_t target = jobs->target;
+    if (mem > JOBS_MEM_PRESSURE_HIGH || avail < JOBS_MEM_AVAILABLE_LOW)
+        target = target / 2;
+    else if (cpu > JOBS_CPU_PRESSURE_HIGH)
+        target = target - 1;
+    else if (cpu < JOBS_CPU_PRESSURE_LOW && pending && active >= target)
+        target = target + 1;
+
+    if (target < 1)
+        target = 1;
+    if (target > jobs->max)
+        target = jobs->max;
+    if (target == jobs->target)
+        return;
+
+    criterion_pinfo(CRITERION_PREFIX_DASHES, _(msg_jobs_change),
+            (unsigned long) jobs->target, (unsigned long) target,
+            cpu * 100, mem * 100, avail * 100);
+    jobs->target = target;
+}
+
+// Time left until the next pressure sample, or -1 if there is none to take
+static int64_t job_control_timeout(struct job_control *jobs) {
+    if (!jobs->adaptive)
+        return -1;
+    uint64_t now = get_timestamp_ns();
+    return now < jobs->next_sample ? (int64_t) (jobs->next_sample - now) : 0;
+}
+
+/*
+ * Waits for the next worker event. Returns NULL without an event when the
+ * adaptive jobs need to sample the pressure; idle is then set.
+ */
+static struct event *wait_next_event(struct worker_set *workers,
+                                     struct event_reader *events,
+                                     struct job_control *jobs,
+                                     bool *idle) {
+    *idle = false;
+    int fds[workers->max_workers + 1];
+    for (;;) {
+        int64_t timeout = enforce_timeouts(workers);
+        int64_t sample = job_control_timeout(jobs);
+        if (sample >= 0 && (timeout < 0 || sample < timeout))
+            timeout = sample;
+
+        // the tests waiting for the setup of their suite get their worker
+        // as soon as the snapshot replies
+        bool replies;
+        size_t nb_fds = snapshot_pending_fds(fds, workers->max_workers + 1);
+        int res = metrics_wait(events, fds, nb_fds, &replies, timeout);
+        if (replies)
+            snapshot_resolve(workers);
+        if (res > 0)
+            break;
+        if (res < 0) {
+            criterion_perror("Could not wait on the event pipe: %s.\n",
+                    strerror(errno));
+            abort();
+        }
+        if (sample >= 0 && !job_control_timeout(jobs)) {
+            *idle = true;
+            return NULL;
+        }
+    }
+    return worker_read_event(workers, events);
+}
+
+static bool handle_pool_terminated(struct worker_set *workers,
+                                   struct event *ev,
+                                   size_t *active);
+
+/*
+ * A test spawned after the snapshot of its suite died during the setup is
+ * over at once, as the runner already knows what the snapshot died of.
+ */
+static bool finish_failed_setup(struct worker_set *workers,
+                                struct worker *w,
+                                size_t *active) {
+    struct worker_status *ws = w->pool ? snapshot_status(w->pool) : NULL;
+    if (!ws)
+        return false;
+
+    struct worker_status status = *ws;
+    struct event ev = {
+        .kind = WORKER_TERMINATED,
+        .pid = w->pool,
+        .timestamp = get_timestamp_ns(),
+        .data = &status,
+    };
+    handle_pool_terminated(workers, &ev, active);
+    return true;
+}
+
+/*
+ * Spawns workers into the free slots until the target is met, or until
+ * there are no tests left. Returns false in the spawned workers.
+ */
+static bool spawn_workers(struct worker_set *workers, size_t *active,
+                          size_t target, ccrContext *ctx) {
+    bool finished;
+    do {
+        finished = false;
+        for (size_t i = 0; i < workers->max_workers; ++i) {
+            if (*active >= target || !*ctx)
+                break;
+            if (workers->workers[i])
+                continue;
+
+            affinity_set_slot(i);
+            uint64_t start = g_trace_enabled ? get_timestamp_ns() : 0;
+            workers->workers[i] = run_next_test(NULL, NULL, ctx);
+            if (!is_runner())
+                return false;
+            if (workers->workers[i]) {
+                trace_span(TRACE_RUNNER, "spawn", start, get_timestamp_ns());
+                ++*active;
+                finished |= finish_failed_setup(workers, workers->workers[i],
+                        active);
+            }
+        }
+    } while (finished);
+    return true;
+}
+
+/*
+ * With --no-fork, the tests run one after the other in the runner itself,
+ * their events going straight to handle_event. Nothing survives a crash
+ * there, so the runner only says which test took it down.
+ */
+static struct worker *g_inline_worker;
+
+static const int inline_crash_signals[] = {
+    SIGSEGV, SIGFPE, SIGILL, SIGABRT,
+#ifdef SIGBUS
+    SIGBUS,
+#endif
+};
+
+static void handle_inline_crash(int sig) {
+    struct execution_context *ctx = &g_inline_worker->ctx;
+    criterion_perror("Test %s::%s crashed with signal %d, ending the run "
+            "since the tests are not forked.\n", ctx->suite->name,
+            ctx->test->name, sig);
+
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void handle_inline_exit(void) {
+    if (!g_inline_worker)
+        return;
+    struct execution_context *ctx = &g_inline_worker->ctx;
+    criterion_perror("Test %s::%s exited the runner, ending the run "
+            "since the tests are not forked.\n", ctx->suite->name,
+            ctx->test->name);
+}
+
+static void handle_inline_event(struct event *ev) {
+    ev->worker = g_inline_worker;
+    handle_event(ev);
+}
+
+static void get_runner_usage(struct criterion_resource_usage *usage) {
+    *usage = (struct criterion_resource_usage) { .user_time = 0 };
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == -1)
+        return;
+    usage->user_time = (uint64_t) ru.ru_utime.tv_sec * 1000000000ull
+        + (uint64_t) ru.ru_utime.tv_usec * 1000;
+    usage->system_time = (uint64_t) ru.ru_stime.tv_sec * 1000000000ull
+        + (uint64_t) ru.ru_stime.tv_usec * 1000;
+#endif
+}
+
+static void run_inline_child(struct criterion_test *test,
+                             struct criterion_suite *suite) {
+    jmp_buf test_exit;
+    g_test_exit = &test_exit;
+    if (!setjmp(test_exit))
+        run_test_child(test, suite);
+    g_test_exit = NULL;
+}
+
+void run_test_inline(struct execution_context *ctx) {
+    struct worker w = {
+        .id = get_process_id(),
+        .ctx = *ctx,
+    };
+    g_inline_worker = &w;
+    g_worker_context = (struct worker_context) {
+        .test = ctx->test,
+        .suite = ctx->suite,
+        .func = run_test_child,
+        .param = ctx->param,
+    };
+
+    struct criterion_resource_usage start, end;
+    get_runner_usage(&start);
+    w.ctx.test_stats->timestamps.spawn = get_timestamp_ns();
+
+    run_inline_child(ctx->test, ctx->suite);
+
+    get_runner_usage(&end);
+    struct worker_status ws = {
+        .status = { .kind = EXIT_STATUS },
+        .usage = {
+            .user_time = end.user_time - start.user_time,
+            .system_time = end.system_time - start.system_time,
+        },
+    };
+    handle_event(&(struct event) {
+            .kind = WORKER_TERMINATED,
+            .pid = w.id,
+            .timestamp = get_timestamp_ns(),
+            .data = &ws,
+            .worker = &w,
+        });
+
+    if (criterion_options.fail_fast)
+        handle_fail_fast(&(struct worker_set) { .max_workers = 0 }, &w);
+
+    g_inline_worker = NULL;
+    sfree(w.ctx.test_stats);
+    sfree(w.ctx.suite_stats);
+    sfree(w.ctx.stats);
+}
+
+static void run_tests_inline(struct criterion_test_set *set,
+                             struct criterion_global_stats *stats) {
+
+    stats->jobs = 1;
+    static bool exit_handler_set;
+    if (!exit_handler_set)
+        exit_handler_set = !atexit(handle_inline_exit);
+
+    void (*prev[sizeof (inline_crash_signals) / sizeof (int)])(int);
+    for (size_t i = 0; i < sizeof (inline_crash_signals) / sizeof (int); ++i)
+        prev[i] = signal(inline_crash_signals[i], handle_inline_crash);
+    g_event_sink = handle_inline_event;
+
+    ccrContext ctx = 0;
+    run_next_test(set, stats, &ctx);
+    while (ctx)
+        run_next_test(NULL, NULL, &ctx);
+
+    g_event_sink = NULL;
+    for (size_t i = 0; i < sizeof (inline_crash_signals) / sizeof (int); ++i)
+        signal(inline_crash_signals[i], prev[i]);
+    reset_fail_fast();
+}
+
+/*
+ * Finishes the tests that were running in a thread pool when it died. The
+ * test that brought the pool down has already reported its own crash when
+ * it could; the events of the others died with their threads, and they get
+ * a process of their own to run again, unless they had already timed out,
+ * been cancelled, or got to report something. Returns false in the spawned
+ * workers.
+ *
+ * The same goes for the tests of a suite whose snapshot died during the
+ * suite setup, except that they never started, and share its fate.
+ */
+static bool handle_pool_terminated(struct worker_set *workers,
+                                   struct event *ev,
+                                   size_t *active) {
+    for (size_t i = 0; i < workers->max_workers; ++i) {
+        struct worker *w = workers->workers[i];
+        if (!w || w->pool != ev->pid)
+            continue;
+
+        struct execution_context *ctx = &w->ctx;
+        bool snapshot = snapshot_enabled(ctx->suite);
+        if (!snapshot && !ctx->timed_out && !ctx->cancelled
+                && !ctx->registered) {
+            // the new worker takes the statistics over
+            struct execution_context retry = *ctx;
+            ctx->stats = NULL;
+            ctx->suite_stats = NULL;
+            ctx->test_stats = NULL;
+            sfree(w);
+
+            affinity_set_slot(i);
+            workers->workers[i] = spawn_test_worker(&retry, run_test_child,
+                    g_worker_pipe);
+            if (!is_runner())
+                return false;
+            continue;
+        }
+
+        if (!ctx->registered && !ctx->cancelled) {
+            handle_event(&(struct event) {
+                    .kind = PRE_INIT, .worker = w, .timestamp = ev->timestamp });
+            if (!snapshot)
+                handle_event(&(struct event) {
+                        .kind = PRE_TEST, .worker = w, .timestamp = ev->timestamp });
+        }
+
+        struct event wev = *ev;
+        wev.worker = w;
+        wev.worker_index = i;
+        handle_event(&wev);
+        if (criterion_options.fail_fast)
+            handle_fail_fast(workers, w);
+
+        sfree(w);
+        workers->workers[i] = NULL;
+        --*active;
+    }
+    return true;
+}
+
 static void run_tests_async(struct criterion_test_set *set,
                             struct criterion_global_stats *stats) {
 
     ccrContext ctx = 0;
 
-    size_t nb_workers = DEF(criterion_options.jobs, get_processor_count());
+    struct job_control jobs;
+    init_job_control(&jobs);
+
+    // jobs.max only bounds the adaptive target: report what actually ran
+    size_t nb_workers = jobs.max;
+    stats->jobs = 0;
     struct worker_set workers = {
         .max_workers = nb_workers,
         .workers = calloc(nb_workers, sizeof (struct worker*)),
     };
 
     size_t active_workers = 0;
+    thread_pool_init(nb_workers);
 
     s_pipe_file_handle *event_pipe = pipe_in_handle(g_worker_pipe, PIPE_DUP);
+    struct event_reader *events = event_reader_new(event_pipe);
     struct event *ev = NULL;
 
+    // the socket only lives as long as the workers report to the runner
+    if (criterion_options.metrics_socket)
+        metrics_start(criterion_options.metrics_socket, stats, &workers,
+                set->tests);
+
     // initialization of coroutine
     run_next_test(set, stats, &ctx);
 
-    for (size_t i = 0; i < nb_workers; ++i) {
-        workers.workers[i] = run_next_test(NULL, NULL, &ctx);
-        if (!is_runner())
-            goto cleanup;
-
-        if (!ctx)
-            break;
-        ++active_workers;
-    }
-
-    if (!active_workers)
+    if (!spawn_workers(&workers, &active_workers, jobs.target, &ctx))
         goto cleanup;
+    stats->jobs = active_workers;
 
-    while ((ev = worker_read_event(&workers, event_pipe)) != NULL) {
-        handle_event(ev);
-        size_t wi = ev->worker_index;
-        if (ev->kind == WORKER_TERMINATED) {
-            sfree(workers.workers[wi]);
-            workers.workers[wi] = ctx ? run_next_test(NULL, NULL, &ctx) : NULL;
+    while (active_workers || thread_pool_drain() || snapshot_drain()) {
+        bool idle;
+        ev = wait_next_event(&workers, events, &jobs, &idle);
+        if (!ev && !idle)
+            break;
 
-            if (!is_runner())
+        if (ev && !ev->worker) {
+            if (!handle_pool_terminated(&workers, ev, &active_workers))
                 goto cleanup;
-
-            if (workers.workers[wi] == NULL)
+            sfree(ev);
+            ev = NULL;
+        } else if (ev) {
+            handle_event(ev);
+            if (criterion_options.fail_fast && ends_test(ev->kind))
+                handle_fail_fast(&workers, ev->worker);
+            if (ev->kind == WORKER_TERMINATED) {
+                snapshot_release(ev->worker->ctx.suite);
+                sfree(workers.workers[ev->worker_index]);
+                workers.workers[ev->worker_index] = NULL;
                 --active_workers;
+            }
+            sfree(ev);
+            ev = NULL;
+        }
+
+        adjust_jobs(&jobs, active_workers, ctx != 0);
+        if (!spawn_workers(&workers, &active_workers, jobs.target, &ctx))
+            goto cleanup;
+        if (active_workers > stats->jobs)
+            stats->jobs = active_workers;
+
+        if (g_trace_enabled) {
+            trace_counter(TRACE_ACTIVE_WORKERS, active_workers);
+            trace_counter(TRACE_PENDING_BYTES, event_reader_buffered(events));
+            trace_counter(TRACE_HOOK_QUEUE, report_queue_depth());
         }
-        sfree(ev);
-        if (!active_workers)
-            break;
     }
-    ev = NULL;
 
 cleanup:
+    metrics_stop();
+    sfree(events);
     sfree(event_pipe);
     sfree(ev);
     for (size_t i = 0; i < nb_workers; ++i)
         sfree(workers.workers[i]);
     free(workers.workers);
     ccrAbort(ctx);
+    reset_fail_fast();
+}
+
+static void setup_perf_counters(void) {
+    g_perf_counters = 0;
+    if (!criterion_options.perf_counters)
+        return;
+
+    unsigned requested;
+    const char *unknown = perf_parse_counters(criterion_options.perf_counters,
+            &requested);
+    if (unknown) {
+        criterion_perror("Unknown performance counter: %s.\n", unknown);
+        return;
+    }
+
+    // Probe the counters once, rather than having every worker fail
+    struct perf_group group;
+    unsigned available = perf_group_open(&group, requested);
+    int error = errno;
+    perf_group_close(&group);
+
+    if (available != requested) {
+        char names[128] = "";
+        for (unsigned c = 1; c <= requested; c <<= 1) {
+            if (!(requested & c) || (available & c))
+                continue;
+            if (*names)
+                strncat(names, ", ", sizeof (names) - strlen(names) - 1);
+            strncat(names, perf_counter_name(c), sizeof (names) - strlen(names) - 1);
+        }
+        criterion_pimportant(CRITERION_PREFIX_DASHES,
+                _(msg_perf_unavailable), CR_FG_BOLD, names,
+                error == EACCES || error == EPERM
+                    ? "check /proc/sys/kernel/perf_event_paranoid"
+                    : strerror(error),
+                CR_RESET);
+    }
+    g_perf_counters = available;
+}
+
+static bool has_test_limits(struct criterion_test_set *set) {
+    FOREACH_SET(struct criterion_suite_set *s, set->suites) {
+        if (!s->tests)
+            continue;
+
+        FOREACH_SET(struct criterion_test *test, s->tests) {
+            struct cgroup_limits limits = get_test_limits(test, &s->suite);
+            if (limits.memory || limits.cpus > 0)
+                return true;
+        }
+    }
+    return false;
 }
 
 static int criterion_run_all_tests_impl(struct criterion_test_set *set) {
+    if (criterion_options.bench_compare
+            && !baseline_load(criterion_options.bench_compare))
+        return 0;
+
+    if (!affinity_init())
+        return 0;
+
+    init_outputs();
+    report_init();
+    if (criterion_options.trace)
+        trace_open(criterion_options.trace);
+
     report(PRE_ALL, set);
     log(pre_all, set);
 
@@ -431,6 +1262,8 @@ static int criterion_run_all_tests_impl(struct criterion_test_set *set) {
                     _(msg_valgrind_jobs), CR_FG_BOLD, CR_RESET);
     }
 
+    setup_perf_counters();
+
     fflush(NULL); // flush everything before forking
 
     g_worker_pipe = stdpipe();
@@ -441,26 +1274,57 @@ static int criterion_run_all_tests_impl(struct criterion_test_set *set) {
     }
 
     struct criterion_global_stats *stats = stats_init();
-    run_tests_async(set, stats);
+    uint64_t start_time = get_timestamp_ns();
+    if (criterion_options.no_fork) {
+        report_start_async();
+        run_tests_inline(set, stats);
+    } else {
+        // the zygote, the snapshots and the thread pool must all start in
+        // the subtree of the run, and their workers outlive them if they die
+        if (has_test_limits(set))
+            cgroup_setup();
+        set_child_subreaper(true);
+
+        if (zygote_start()) {
+            report_start_async();
+            run_tests_async(set, stats);
+            zygote_stop();
+        }
+    }
+    if (start_time)
+        stats->wall_time = get_timestamp_ns() - start_time;
 
     int result = is_runner() ? stats->tests_failed == 0 : -1;
 
     if (!is_runner())
         goto cleanup;
 
+    cgroup_cleanup();
+    report_drain();
+    stats->runner = g_runner_counters;
     report(POST_ALL, stats);
     log(post_all, stats);
+    trace_close();
+
+    if (criterion_options.bench_save
+            && !baseline_save(criterion_options.bench_save, stats))
+        result = 0;
+    close_outputs();
 
 cleanup:
+    baseline_free();
+    set_child_subreaper(false);
+    hold_child_events(true);
     sfree(g_worker_pipe);
+    g_worker_pipe = NULL;
+    hold_child_events(false);
     sfree(stats);
     return result;
 }
 
 int criterion_run_all_tests(struct criterion_test_set *set) {
     #ifdef HAVE_PCRE
-    if (criterion_options.pattern)
-        disable_unmatching(set);
+    disable_unmatching(set);
     #endif
 
     set_runner_process();
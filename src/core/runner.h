@@ -26,12 +26,23 @@
 
 # include "criterion/types.h"
 # include "compat/pipe.h"
+# include "compat/cgroup.h"
 
 CR_DECL_SECTION_LIMITS(struct criterion_test*, cr_tst);
 CR_DECL_SECTION_LIMITS(struct criterion_suite*, cr_sts);
 
 struct criterion_test_set *criterion_init(void);
+struct criterion_test *criterion_find_test(const char *suite, const char *name);
+struct criterion_suite *criterion_find_suite(const char *name);
+struct execution_context;
+
 void run_test_child(struct criterion_test *test, struct criterion_suite *suite);
+void run_test_inline(struct execution_context *ctx);
+bool is_test_cancelled(struct criterion_test *test, struct criterion_suite *suite);
+void criterion_add_test_pattern(const char *pattern, bool exclude);
+double get_test_timeout(struct criterion_test *test, struct criterion_suite *suite);
+struct cgroup_limits get_test_limits(struct criterion_test *test, struct criterion_suite *suite);
+enum criterion_isolation get_test_isolation(struct criterion_test *test, struct criterion_suite *suite);
 
 # define FOREACH_TEST_SEC(Test)                                         \
     for (struct criterion_test **Test = GET_SECTION_START(cr_tst);      \
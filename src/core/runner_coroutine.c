@@ -25,11 +25,13 @@
 #include <stdio.h>
 #include <csptr/smalloc.h>
 #include "criterion/logging.h"
+#include "criterion/options.h"
 #include "runner_coroutine.h"
 #include "worker.h"
 #include "stats.h"
 #include "runner.h"
 #include "report.h"
+#include "snapshot.h"
 
 static INLINE void nothing(void) {}
 
@@ -62,6 +64,12 @@ static struct worker *run_test(struct criterion_global_stats *stats,
         .suite_stats = sref(suite_stats),
         .param = param,
     };
+    if (criterion_options.no_fork) {
+        run_test_inline(&ctx);
+        return NULL;
+    }
+    if (get_test_isolation(ctx.test, ctx.suite) == CR_ISOLATION_THREAD)
+        return spawn_thread_worker(&ctx, run_test_child);
     return spawn_test_worker(&ctx, run_test_child, g_worker_pipe);
 }
 
@@ -99,6 +107,21 @@ static int skip_disabled(struct run_next_context *ctx) {
     return 0;
 }
 
+static int skip_cancelled(struct run_next_context *ctx) {
+    if (!is_test_cancelled(ctx->test, ctx->suite_stats->suite))
+        return 0;
+
+    ctx->test_stats = test_stats_init(ctx->test);
+    stat_push_event(ctx->stats,
+            ctx->suite_stats,
+            ctx->test_stats,
+            &(struct event) { .kind = PRE_INIT });
+    stat_push_cancel(ctx->stats, ctx->suite_stats, ctx->test_stats);
+    log(test_cancel, ctx->test_stats);
+    sfree(ctx->test_stats);
+    return 1;
+}
+
 struct worker *run_next_test(struct criterion_test_set *p_set,
                              struct criterion_global_stats *p_stats,
                              ccrContParam) {
@@ -136,11 +159,19 @@ struct worker *run_next_test(struct criterion_test_set *p_set,
 
                 ctx->params = ctx->test->data->param_();
                 for (ctx->i = 0; ctx->i < ctx->params.length; ++ctx->i) {
+                    if (skip_cancelled(ctx))
+                        continue;
+
                     ctx->test_stats = test_stats_init(ctx->test);
 
+                    // without a cleanup, the parameters own no memory
                     struct test_single_param param = {
-                        ctx->params.size,
-                        (char *) ctx->params.params + ctx->i * ctx->params.size
+                        .size = ctx->params.size,
+                        .ptr = (char *) ctx->params.params
+                            + ctx->i * ctx->params.size,
+                        .index = ctx->i,
+                        .copyable = !ctx->params.cleanup
+                            && ctx->test->data->lang_ == CR_LANG_C,
                     };
 
                     struct worker *worker = run_test(ctx->stats,
@@ -154,11 +185,11 @@ struct worker *run_next_test(struct criterion_test_set *p_set,
                 if (ctx->params.cleanup)
                     ctx->params.cleanup(&ctx->params);
             } else {
-                ctx->test_stats = test_stats_init(ctx->test);
-
-                if (skip_disabled(ctx))
+                if (skip_disabled(ctx) || skip_cancelled(ctx))
                     continue;
 
+                ctx->test_stats = test_stats_init(ctx->test);
+
                 struct worker *worker = run_test(ctx->stats,
                         ctx->suite_stats,
                         ctx->test_stats,
@@ -168,6 +199,8 @@ struct worker *run_next_test(struct criterion_test_set *p_set,
             }
         }
 
+        snapshot_seal(&ctx->suite_set->suite);
+
         report(POST_SUITE, ctx->suite_stats);
         log(post_suite, ctx->suite_stats);
 
@@ -0,0 +1,386 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define CRITERION_LOGGING_COLORS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <csptr/smalloc.h>
+
+#include "criterion/logging.h"
+#include "criterion/options.h"
+#include "string/i18n.h"
+#include "snapshot.h"
+#include "zygote.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+# include <signal.h>
+# include <unistd.h>
+# include <poll.h>
+# include <sys/socket.h>
+
+// Pending test ids, that can collide neither with a pid nor a thread test
+# define SNAPSHOT_TEST_ID_BIT (1ull << 62)
+
+typedef const char *const msg_t;
+
+# ifdef ENABLE_NLS
+static msg_t msg_teardown_crash = N_("%1$sWarning! The suite `%2$s` crashed "
+        "during its teardown.%3$s\n");
+static msg_t msg_teardown_exit = N_("%1$sWarning! The suite `%2$s` exited "
+        "during its teardown.%3$s\n");
+# else
+static msg_t msg_teardown_crash = "%sWarning! The suite `%s` crashed "
+        "during its teardown.%s\n";
+static msg_t msg_teardown_exit = "%sWarning! The suite `%s` exited "
+        "during its teardown.%s\n";
+# endif
+
+struct snapshot {
+    struct criterion_suite *suite;
+    s_proc_handle *proc;
+    int fd;                 // -1 once dismissed or dead
+    size_t workers;         // workers forked from the snapshot still running
+    unsigned long long *queue; // ids of the tests awaiting their worker,
+    size_t queued;          // in the order of the requests
+    size_t capacity;
+    bool ready;             // the suite setup completed
+    bool sealed;            // all the tests of the suite were spawned
+    bool reaped;
+    struct worker_status status;
+    struct snapshot *next;
+};
+
+static struct snapshot *g_snapshots;
+static unsigned long long g_next_test_id;
+
+/* Snapshot side */
+
+static void discard_event(CR_UNUSED struct event *ev) {}
+
+static void snapshot_main(int fd, struct criterion_suite *suite) {
+    // the tests must not keep the other snapshots alive
+    for (struct snapshot *s = g_snapshots; s; s = s->next) {
+        if (s->fd != -1)
+            close(s->fd);
+    }
+
+    // nothing on the runner side could tell which test these events
+    // belong to
+    g_event_sink = discard_event;
+    if (suite->data->init)
+        suite->data->init();
+    g_event_sink = NULL;
+
+    // do not let the tests inherit the output of the setup
+    fflush(NULL);
+
+    if (zygote_serve(fd, true) && suite->data->fini)
+        suite->data->fini();
+
+    fflush(NULL);
+    _Exit(0);
+}
+
+/* Runner side */
+
+bool snapshot_enabled(struct criterion_suite *suite) {
+    return suite->data && suite->data->snapshot_init
+        && !criterion_options.no_fork;
+}
+
+static struct snapshot *find_snapshot(struct criterion_suite *suite) {
+    for (struct snapshot *s = g_snapshots; s; s = s->next) {
+        if (s->suite == suite)
+            return s;
+    }
+    return NULL;
+}
+
+static struct snapshot *start_snapshot(struct criterion_suite *suite) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        criterion_perror("Could not create the socket of the snapshot of "
+                "suite %s: %s.\n", suite->name, strerror(errno));
+        abort();
+    }
+
+    s_proc_handle *proc = fork_process();
+    if (proc == (void *) -1) {
+        criterion_perror("Could not fork the current process and start the "
+                "snapshot of suite %s: %s.\n", suite->name, strerror(errno));
+        abort();
+    } else if (proc == NULL) {
+        close(fds[0]);
+        snapshot_main(fds[1], suite);
+    }
+    close(fds[1]);
+
+    struct snapshot *s = malloc(sizeof (struct snapshot));
+    *s = (struct snapshot) {
+        .suite = suite,
+        .proc = proc,
+        .fd = fds[0],
+        .next = g_snapshots,
+    };
+    g_snapshots = s;
+    return s;
+}
+
+static void dismiss_snapshot(struct snapshot *s) {
+    if (s->fd == -1)
+        return;
+    zygote_dismiss(s->fd);
+    s->fd = -1;
+}
+
+// The tests still queued are then finalized along with the snapshot
+static void close_snapshot(struct snapshot *s) {
+    if (s->fd != -1)
+        close(s->fd);
+    s->fd = -1;
+    s->queued = 0;
+}
+
+static unsigned long long queue_request(struct snapshot *s) {
+    if (s->queued == s->capacity) {
+        s->capacity = s->capacity ? s->capacity * 2 : 8;
+        s->queue = realloc(s->queue, s->capacity * sizeof (*s->queue));
+    }
+    unsigned long long id = SNAPSHOT_TEST_ID_BIT | ++g_next_test_id;
+    s->queue[s->queued++] = id;
+    return id;
+}
+
+s_proc_handle *snapshot_spawn(struct worker_context *ctx,
+                              unsigned long long *pending) {
+    struct snapshot *s = find_snapshot(ctx->suite);
+    if (!s)
+        s = start_snapshot(ctx->suite);
+
+    s_proc_handle *proc = NULL;
+    if (s->fd != -1 && s->ready && !s->queued) {
+        proc = zygote_request(s->fd, ctx);
+    } else if (s->fd != -1 && zygote_send(s->fd, ctx)) {
+        // the test waits for the suite setup without holding the runner
+        // up, under an id of its own until the reply comes
+        *pending = queue_request(s);
+        proc = smalloc(sizeof (s_proc_handle));
+        *proc = *s->proc;
+        return proc;
+    }
+
+    if (proc == (void *) -1)
+        return proc;
+    if (proc) {
+        ++s->workers;
+        return proc;
+    }
+
+    // the suite setup failed, or the snapshot died since: the test shares
+    // its fate
+    close_snapshot(s);
+    *pending = SNAPSHOT_TEST_ID_BIT | ++g_next_test_id;
+    proc = smalloc(sizeof (s_proc_handle));
+    *proc = *s->proc;
+    return proc;
+}
+
+static struct worker *find_pending(struct worker_set *workers,
+                                   unsigned long long id) {
+    for (size_t i = 0; i < workers->max_workers; ++i) {
+        struct worker *w = workers->workers[i];
+        if (w && w->id == id)
+            return w;
+    }
+    return NULL;
+}
+
+static bool read_replies(struct snapshot *s, struct worker_set *workers) {
+    bool bound = false;
+    struct pollfd pfd = { .fd = s->fd, .events = POLLIN };
+    while (s->queued && poll(&pfd, 1, 0) > 0) {
+        s_proc_handle *proc = zygote_receive(s->fd);
+        if (!proc) {
+            close_snapshot(s);
+            break;
+        }
+        if (proc == (void *) -1) {
+            criterion_perror("Could not fork the current process and start "
+                    "a worker: %s.\n", strerror(errno));
+            abort();
+        }
+
+        unsigned long long id = s->queue[0];
+        memmove(s->queue, s->queue + 1, --s->queued * sizeof (*s->queue));
+        s->ready = true;
+
+        struct worker *w = find_pending(workers, id);
+        if (!w) {
+            // the test was given up on in the meantime
+            kill(proc->pid, SIGKILL);
+            sfree(proc);
+            continue;
+        }
+        w->id = get_process_id_of(proc);
+        w->pool = 0;
+        sfree(w->proc);
+        w->proc = proc;
+        ++s->workers;
+        bound = true;
+    }
+    return bound;
+}
+
+bool snapshot_resolve(struct worker_set *workers) {
+    bool bound = false;
+    for (struct snapshot *s = g_snapshots; s; s = s->next) {
+        if (s->queued && s->fd != -1)
+            bound |= read_replies(s, workers);
+    }
+    return bound;
+}
+
+size_t snapshot_pending_fds(int *fds, size_t size) {
+    size_t nb = 0;
+    for (struct snapshot *s = g_snapshots; s && nb < size; s = s->next) {
+        if (s->queued && s->fd != -1)
+            fds[nb++] = s->fd;
+    }
+    return nb;
+}
+
+bool snapshot_pending(unsigned long long id) {
+    return id & SNAPSHOT_TEST_ID_BIT;
+}
+
+int snapshot_stop(unsigned long long pid, bool force) {
+    struct snapshot *s = g_snapshots;
+    while (s && get_process_id_of(s->proc) != pid)
+        s = s->next;
+    if (!s || s->reaped)
+        return 0;
+
+    // the tests waiting for the suite setup time out along with it, as a
+    // worker would die of its own timer
+    return kill(s->proc->pid, force ? SIGKILL : SIGPROF);
+}
+
+void snapshot_seal(struct criterion_suite *suite) {
+    struct snapshot *s = find_snapshot(suite);
+    if (!s)
+        return;
+    s->sealed = true;
+    if (!s->workers && !s->queued)
+        dismiss_snapshot(s);
+}
+
+void snapshot_release(struct criterion_suite *suite) {
+    struct snapshot *s = find_snapshot(suite);
+    if (s && s->workers && !--s->workers && s->sealed && !s->queued)
+        dismiss_snapshot(s);
+}
+
+bool snapshot_reap(struct event *ev) {
+    struct snapshot *s = g_snapshots;
+    while (s && (s->reaped || get_process_id_of(s->proc) != ev->pid))
+        s = s->next;
+    if (!s)
+        return false;
+
+    s->reaped = true;
+    s->status = *(struct worker_status *) ev->data;
+    close_snapshot(s);
+
+    // the failures of the setup are reported along with the tests
+    struct process_status *st = &s->status.status;
+    if (s->ready && st->kind == SIGNAL)
+        criterion_pimportant(CRITERION_PREFIX_DASHES, _(msg_teardown_crash),
+                CR_FG_BOLD, s->suite->name, CR_RESET);
+    else if (s->ready && st->kind == EXIT_STATUS && st->status)
+        criterion_pimportant(CRITERION_PREFIX_DASHES, _(msg_teardown_exit),
+                CR_FG_BOLD, s->suite->name, CR_RESET);
+    return true;
+}
+
+struct worker_status *snapshot_status(unsigned long long pid) {
+    for (struct snapshot *s = g_snapshots; s; s = s->next) {
+        if (s->reaped && get_process_id_of(s->proc) == pid)
+            return &s->status;
+    }
+    return NULL;
+}
+
+bool snapshot_drain(void) {
+    bool running = false;
+    for (struct snapshot *s = g_snapshots; s; s = s->next) {
+        dismiss_snapshot(s);
+        running |= !s->reaped;
+    }
+    return running;
+}
+
+#else
+
+bool snapshot_enabled(CR_UNUSED struct criterion_suite *suite) {
+    return false;
+}
+
+s_proc_handle *snapshot_spawn(CR_UNUSED struct worker_context *ctx,
+                              CR_UNUSED unsigned long long *pending) {
+    return NULL;
+}
+
+bool snapshot_resolve(CR_UNUSED struct worker_set *workers) {
+    return false;
+}
+
+size_t snapshot_pending_fds(CR_UNUSED int *fds, CR_UNUSED size_t size) {
+    return 0;
+}
+
+bool snapshot_pending(CR_UNUSED unsigned long long id) {
+    return false;
+}
+
+int snapshot_stop(CR_UNUSED unsigned long long pid, CR_UNUSED bool force) {
+    return 0;
+}
+
+void snapshot_seal(CR_UNUSED struct criterion_suite *suite) {}
+void snapshot_release(CR_UNUSED struct criterion_suite *suite) {}
+
+bool snapshot_reap(CR_UNUSED struct event *ev) {
+    return false;
+}
+
+struct worker_status *snapshot_status(CR_UNUSED unsigned long long pid) {
+    return NULL;
+}
+
+bool snapshot_drain(void) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef SNAPSHOT_H_
+# define SNAPSHOT_H_
+
+# include <stdbool.h>
+# include "criterion/types.h"
+# include "io/event.h"
+# include "worker.h"
+
+/*
+ * The suites with .snapshot_init run their setup once, in a snapshot
+ * process forked from the runner, which then forks their tests so that
+ * they share the initialized memory copy-on-write. The snapshot runs the
+ * suite teardown once all of them are done.
+ */
+bool snapshot_enabled(struct criterion_suite *suite);
+
+/*
+ * Has the snapshot of the suite fork a worker for the given context,
+ * starting the snapshot first if need be. Until the suite setup completed,
+ * or if it failed, returns a handle on the snapshot and sets *pending to
+ * the id standing for the test until snapshot_resolve binds it to its
+ * worker, or the snapshot gets reaped. Returns (void *) -1 if the fork
+ * failed.
+ */
+s_proc_handle *snapshot_spawn(struct worker_context *ctx,
+                              unsigned long long *pending);
+
+/*
+ * Binds the pending tests whose worker was forked to it, from the replies
+ * the snapshots sent so far. Returns whether any test was bound.
+ */
+bool snapshot_resolve(struct worker_set *workers);
+
+// The sockets the replies for the pending tests come from
+size_t snapshot_pending_fds(int *fds, size_t size);
+
+// Whether the id stands for a test waiting for its snapshot
+bool snapshot_pending(unsigned long long id);
+
+// Stops the snapshot with the given pid, for a test pending on it
+int snapshot_stop(unsigned long long pid, bool force);
+
+// All the tests of the suite have been spawned
+void snapshot_seal(struct criterion_suite *suite);
+
+// A worker of the suite terminated
+void snapshot_release(struct criterion_suite *suite);
+
+/*
+ * Records the status of a terminated snapshot. Returns false if the event
+ * is not about a snapshot.
+ */
+bool snapshot_reap(struct event *ev);
+
+// The status of a snapshot once it has been reaped, or NULL
+struct worker_status *snapshot_status(unsigned long long pid);
+
+/*
+ * Dismisses the remaining snapshots, and returns whether some of them
+ * still have to terminate.
+ */
+bool snapshot_drain(void);
+
+#endif /* !SNAPSHOT_H_ */
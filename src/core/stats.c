@@ -21,9 +21,11 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  */
+#include <stdlib.h>
 #include <string.h>
 #include <csptr/smalloc.h>
 #include "criterion/common.h"
+#include "compat/time.h"
 #include "stats.h"
 #include "common.h"
 
@@ -34,6 +36,8 @@ typedef struct criterion_suite_stats  s_suite_stats;
 typedef struct criterion_test_stats   s_test_stats;
 typedef struct criterion_assert_stats s_assert_stats;
 
+struct criterion_runner_counters g_runner_counters;
+
 static void push_pre_suite(s_glob_stats *stats,
 		           s_suite_stats *sstats,
 		           s_test_stats *tstats,
@@ -103,6 +107,7 @@ static void destroy_test_stats(void *ptr, CR_UNUSED void *meta) {
         next = a->next;
         sfree(a);
     }
+    free(stats->bench);
 }
 
 s_test_stats *test_stats_init(struct criterion_test *t) {
@@ -142,7 +147,12 @@ void stat_push_event(s_glob_stats *stats,
     assert(data->kind > 0);
     assert(data->kind <= (signed long long) (sizeof (handles) / sizeof (void (*)(void))));
 
+    uint64_t start = get_timestamp_ns();
     handles[data->kind](stats, suite, test, data->data);
+
+    ++g_runner_counters.stats.calls;
+    if (start)
+        g_runner_counters.stats.time += get_timestamp_ns() - start;
 }
 
 static void push_pre_suite(s_glob_stats *stats,
@@ -207,9 +217,10 @@ static void push_post_test(s_glob_stats *stats,
                            s_suite_stats *suite,
                            s_test_stats *test,
                            void *ptr) {
-    double *data = ptr;
+    struct post_test_data *data = ptr;
 
-    test->elapsed_time = (float) *data;
+    test->elapsed_time = (float) data->elapsed_time;
+    test->perf_counters = data->perf_counters;
     if (test->failed_asserts > 0
             || test->timed_out
             || test->signal != test->test->data->signal
@@ -238,3 +249,43 @@ static void push_test_crash(s_glob_stats *stats,
     ++stats->tests_failed;
     ++stats->tests_crashed;
 }
+
+void stat_push_cancel(s_glob_stats *stats,
+                      s_suite_stats *suite,
+                      s_test_stats *test) {
+    test->cancelled = true;
+    ++suite->tests_cancelled;
+    ++stats->tests_cancelled;
+}
+
+static INLINE uint64_t phase_time(uint64_t start, uint64_t end) {
+    return start && end && end > start ? end - start : 0;
+}
+
+static INLINE void add_phase_times(struct criterion_phase_times *dst,
+                                   struct criterion_phase_times *src) {
+    dst->startup += src->startup;
+    dst->init    += src->init;
+    dst->test    += src->test;
+    dst->fini    += src->fini;
+    dst->exit    += src->exit;
+    dst->reap    += src->reap;
+}
+
+void stat_push_timings(s_glob_stats *stats,
+                       s_suite_stats *suite,
+                       s_test_stats *test) {
+    struct criterion_test_timestamps *ts = &test->timestamps;
+
+    test->phase_times = (struct criterion_phase_times) {
+        .startup = phase_time(ts->spawn,     ts->pre_init),
+        .init    = phase_time(ts->pre_init,  ts->pre_test),
+        .test    = phase_time(ts->pre_test,  ts->post_test),
+        .fini    = phase_time(ts->post_test, ts->post_fini),
+        .exit    = phase_time(ts->post_fini, ts->exit),
+        .reap    = phase_time(ts->exit,      ts->reap),
+    };
+
+    add_phase_times(&suite->phase_times, &test->phase_times);
+    add_phase_times(&stats->phase_times, &test->phase_times);
+}
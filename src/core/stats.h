@@ -27,6 +27,9 @@
 # include "criterion/stats.h"
 # include "io/event.h"
 
+// Counted as the runner goes, and copied in the global stats at the end
+extern struct criterion_runner_counters g_runner_counters;
+
 struct criterion_global_stats *stats_init(void);
 struct criterion_test_stats *test_stats_init(struct criterion_test *t);
 struct criterion_suite_stats *suite_stats_init(struct criterion_suite *s);
@@ -34,5 +37,11 @@ void stat_push_event(struct criterion_global_stats *stats,
                      struct criterion_suite_stats *suite,
                      struct criterion_test_stats *test,
                      struct event *data);
+void stat_push_timings(struct criterion_global_stats *stats,
+                       struct criterion_suite_stats *suite,
+                       struct criterion_test_stats *test);
+void stat_push_cancel(struct criterion_global_stats *stats,
+                      struct criterion_suite_stats *suite,
+                      struct criterion_test_stats *test);
 
 #endif /* !STATS_H_ */
@@ -80,7 +80,7 @@ void cr_theory_free(struct criterion_theory_context *ctx) {
     dcFree(ctx->vm);
 }
 
-static jmp_buf theory_jmp;
+static CR_THREAD_LOCAL jmp_buf theory_jmp;
 
 void cr_theory_abort(void) {
     longjmp(theory_jmp, 1);
@@ -0,0 +1,375 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <csptr/smalloc.h>
+
+#include "criterion/logging.h"
+#include "criterion/redirect.h"
+#include "compat/pipe-internal.h"
+#include "compat/process.h"
+#include "compat/time.h"
+#include "io/event.h"
+#include "io/output.h"
+#include "abort.h"
+#include "common.h"
+#include "thread_pool.h"
+
+#ifdef HAVE_THREAD_POOL
+# include <setjmp.h>
+# include <signal.h>
+# include <unistd.h>
+# include <pthread.h>
+# include <sys/resource.h>
+
+struct thread_command {
+    cr_worker_func func;
+    struct criterion_test *test;
+    struct criterion_suite *suite;
+    unsigned long long id;
+};
+
+// Test ids have their top bit set, so that they never collide with a pid
+# define THREAD_TEST_ID_BIT (1ull << 63)
+
+// Room left to the crash handler when a test overflows its stack
+# define CRASH_STACK_SIZE (64 * 1024)
+
+struct thread_pool {
+    s_proc_handle *proc;
+    unsigned long long pid;
+    s_pipe_handle *commands;
+    bool retired;
+    struct thread_pool *next;
+};
+
+// The live pool comes first, the retired ones wait to be reaped
+static struct thread_pool *g_pools;
+static size_t g_nb_threads = 1;
+static unsigned long long g_next_test_id;
+
+/* Pool side */
+
+struct thread_test {
+    unsigned long long id;
+    struct criterion_resource_usage start;
+    jmp_buf exit;
+};
+
+static CR_THREAD_LOCAL struct thread_test g_current;
+static pthread_mutex_t g_commands_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+static uint64_t timeval_ns(struct timeval tv) {
+    return (uint64_t) tv.tv_sec * 1000000000ull + (uint64_t) tv.tv_usec * 1000;
+}
+
+// Resource usage of the calling thread, the pool sharing everything else
+static void thread_usage(struct criterion_resource_usage *usage) {
+    *usage = (struct criterion_resource_usage) { .user_time = 0 };
+# ifdef RUSAGE_THREAD
+    struct rusage ru;
+    if (getrusage(RUSAGE_THREAD, &ru) == -1)
+        return;
+
+    usage->user_time            = timeval_ns(ru.ru_utime);
+    usage->system_time          = timeval_ns(ru.ru_stime);
+    usage->minor_faults         = (uint64_t) ru.ru_minflt;
+    usage->major_faults         = (uint64_t) ru.ru_majflt;
+    usage->voluntary_switches   = (uint64_t) ru.ru_nvcsw;
+    usage->involuntary_switches = (uint64_t) ru.ru_nivcsw;
+# endif
+}
+
+// Async-signal-safe, like the SIGCHLD handler of the runner
+static void send_terminated(unsigned long long id, struct process_status status) {
+    struct {
+        struct event_header header;
+        struct worker_status status;
+    } frame = { .status = { .status = status } };
+    struct worker_status *ws = &frame.status;
+    ws->proc.pid = getpid();
+
+    struct criterion_resource_usage *start = &g_current.start;
+    thread_usage(&ws->usage);
+    ws->usage.user_time            -= start->user_time;
+    ws->usage.system_time          -= start->system_time;
+    ws->usage.minor_faults         -= start->minor_faults;
+    ws->usage.major_faults         -= start->major_faults;
+    ws->usage.voluntary_switches   -= start->voluntary_switches;
+    ws->usage.involuntary_switches -= start->involuntary_switches;
+
+    event_header_init(&frame.header, WORKER_TERMINATED, id, sizeof (*ws));
+    pipe_write(&frame, sizeof (frame.header) + sizeof (*ws), g_event_pipe);
+}
+
+/*
+ * A crash takes the whole pool down, but the test that caused it still
+ * gets to report what it did: the runner then only has to deal with the
+ * tests of the other threads.
+ */
+static void handle_crash(int sig) {
+    unsigned long long id = g_current.id;
+    g_current.id = 0;
+    if (id) {
+        event_capture_flush();
+        send_terminated(id, (struct process_status) {
+                .kind = SIGNAL,
+                .status = sig,
+            });
+    }
+
+    // the handler has been reset, the signal now kills the pool
+    raise(sig);
+}
+
+static bool read_command(int fd, struct thread_command *cmd) {
+    size_t done = 0;
+
+    pthread_mutex_lock(&g_commands_lock);
+    while (done < sizeof (*cmd)) {
+        ssize_t res = read(fd, (char *) cmd + done, sizeof (*cmd) - done);
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            break;
+        done += res;
+    }
+    pthread_mutex_unlock(&g_commands_lock);
+
+    // a command without a test tells the thread to exit
+    return done == sizeof (*cmd) && cmd->test;
+}
+
+static void run_thread_test(struct thread_command *cmd) {
+    g_worker_context = (struct worker_context) {
+        .test = cmd->test,
+        .suite = cmd->suite,
+        .func = cmd->func,
+        .pipe = g_worker_pipe,
+    };
+
+    thread_usage(&g_current.start);
+    event_capture_begin(cmd->id);
+    g_current.id = cmd->id;
+
+    g_test_exit = &g_current.exit;
+    if (!setjmp(g_current.exit))
+        cmd->func(cmd->test, cmd->suite);
+    g_test_exit = NULL;
+
+    g_current.id = 0;
+    fflush(NULL); // the output of the test must not die with another one
+    event_capture_flush();
+    send_terminated(cmd->id, (struct process_status) { .kind = EXIT_STATUS });
+    event_capture_end();
+}
+
+static void *pool_thread(void *arg) {
+    int fd = *(int *) arg;
+
+    stack_t stack = {
+        .ss_sp = malloc(CRASH_STACK_SIZE),
+        .ss_size = CRASH_STACK_SIZE,
+    };
+    if (stack.ss_sp)
+        sigaltstack(&stack, NULL);
+
+    struct thread_command cmd;
+    while (read_command(fd, &cmd))
+        run_thread_test(&cmd);
+
+    stack.ss_flags = SS_DISABLE;
+    sigaltstack(&stack, NULL);
+    free(stack.ss_sp);
+    return NULL;
+}
+
+static CR_NORETURN void pool_main(s_pipe_handle *commands) {
+    // the tests may wait for their own children
+    signal(SIGCHLD, SIG_DFL);
+
+    struct sigaction sa = {
+        .sa_handler = handle_crash,
+        .sa_flags = SA_ONSTACK | SA_RESETHAND,
+    };
+    sigemptyset(&sa.sa_mask);
+    for (size_t i = 0; i < sizeof (crash_signals) / sizeof (int); ++i)
+        sigaction(crash_signals[i], &sa, NULL);
+
+    cr_redirect_stdin();
+    g_event_pipe = pipe_out_handle(g_worker_pipe, PIPE_CLOSE);
+
+    close(commands->fds[1]);
+    int fd = commands->fds[0];
+
+    pthread_t *threads = malloc(sizeof (pthread_t) * g_nb_threads);
+    size_t started = 0;
+    for (; started < g_nb_threads; ++started) {
+        int res = pthread_create(&threads[started], NULL, pool_thread, &fd);
+        if (res) {
+            criterion_perror("Could not start a thread of the pool: %s.\n",
+                    strerror(res));
+            if (!started)
+                abort();
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+    free(threads);
+
+    fflush(NULL);
+    _Exit(0);
+}
+
+/* Runner side */
+
+void thread_pool_init(size_t nb_threads) {
+    g_nb_threads = DEF(nb_threads, 1);
+}
+
+static struct thread_pool *start_pool(void) {
+    // the runner keeps the read end too, so that it never gets a SIGPIPE
+    // from writing to a pool that just died
+    s_pipe_handle *commands = stdpipe();
+    if (!commands) {
+        criterion_perror("Could not create the command pipe of the thread "
+                "pool: %s.\n", strerror(errno));
+        abort();
+    }
+
+    // do not let the pool inherit pending output and write it twice
+    flush_outputs();
+
+    s_proc_handle *proc = fork_process();
+    if (proc == (void *) -1) {
+        criterion_perror("Could not fork the current process and start a "
+                "thread pool: %s.\n", strerror(errno));
+        abort();
+    } else if (proc == NULL) {
+        pool_main(commands);
+    }
+
+    struct thread_pool *pool = malloc(sizeof (struct thread_pool));
+    *pool = (struct thread_pool) {
+        .proc = proc,
+        .pid = get_process_id_of(proc),
+        .commands = commands,
+        .next = g_pools,
+    };
+    g_pools = pool;
+    return pool;
+}
+
+static void send_command(struct thread_pool *pool, struct thread_command *cmd) {
+    if (write(pool->commands->fds[1], cmd, sizeof (*cmd)) < (ssize_t) sizeof (*cmd)) {
+        criterion_perror("Could not send a test to the thread pool: %s.\n",
+                strerror(errno));
+        abort();
+    }
+}
+
+unsigned long long thread_pool_submit(cr_worker_func func,
+                                      struct criterion_test *test,
+                                      struct criterion_suite *suite,
+                                      s_proc_handle **pool_proc) {
+    struct thread_pool *pool = g_pools && !g_pools->retired
+        ? g_pools
+        : start_pool();
+
+    struct thread_command cmd = {
+        .func = func,
+        .test = test,
+        .suite = suite,
+        .id = THREAD_TEST_ID_BIT | ++g_next_test_id,
+    };
+    send_command(pool, &cmd);
+
+    *pool_proc = smalloc(sizeof (s_proc_handle));
+    **pool_proc = *pool->proc;
+    return cmd.id;
+}
+
+void thread_pool_retire(unsigned long long pid) {
+    for (struct thread_pool *p = g_pools; p; p = p->next)
+        if (p->pid == pid)
+            p->retired = true;
+}
+
+bool thread_pool_reap(unsigned long long pid) {
+    for (struct thread_pool **p = &g_pools; *p; p = &(*p)->next) {
+        struct thread_pool *pool = *p;
+        if (pool->pid != pid)
+            continue;
+
+        *p = pool->next;
+        close(pool->commands->fds[0]);
+        close(pool->commands->fds[1]);
+        sfree(pool->commands);
+        sfree(pool->proc);
+        free(pool);
+        return true;
+    }
+    return false;
+}
+
+bool thread_pool_drain(void) {
+    struct thread_pool *pool = g_pools;
+    if (pool && !pool->retired) {
+        struct thread_command quit = { .test = NULL };
+        for (size_t i = 0; i < g_nb_threads; ++i)
+            send_command(pool, &quit);
+        pool->retired = true;
+    }
+    return g_pools != NULL;
+}
+
+#else
+
+void thread_pool_init(CR_UNUSED size_t nb_threads) {}
+
+unsigned long long thread_pool_submit(CR_UNUSED cr_worker_func func,
+                                      CR_UNUSED struct criterion_test *test,
+                                      CR_UNUSED struct criterion_suite *suite,
+                                      CR_UNUSED s_proc_handle **pool_proc) {
+    criterion_perror("Thread pools are not supported on this platform.\n");
+    abort();
+}
+
+void thread_pool_retire(CR_UNUSED unsigned long long pid) {}
+
+bool thread_pool_reap(CR_UNUSED unsigned long long pid) {
+    return false;
+}
+
+bool thread_pool_drain(void) {
+    return false;
+}
+
+#endif
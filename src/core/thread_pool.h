@@ -0,0 +1,44 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef THREAD_POOL_H_
+# define THREAD_POOL_H_
+
+# include <stdbool.h>
+# include "criterion/common.h"
+# include "worker.h"
+
+# if defined(__unix__) || defined(__APPLE__)
+#  define HAVE_THREAD_POOL 1
+# endif
+
+void thread_pool_init(size_t nb_threads);
+unsigned long long thread_pool_submit(cr_worker_func func,
+                                      struct criterion_test *test,
+                                      struct criterion_suite *suite,
+                                      s_proc_handle **pool_proc);
+void thread_pool_retire(unsigned long long pid);
+bool thread_pool_reap(unsigned long long pid);
+bool thread_pool_drain(void);
+
+#endif /* !THREAD_POOL_H_ */
@@ -24,13 +24,23 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <signal.h>
 #include <csptr/smalloc.h>
 
 #include "criterion/types.h"
 #include "criterion/options.h"
 #include "criterion/redirect.h"
 #include "io/event.h"
+#include "io/output.h"
 #include "compat/posix.h"
+#include "compat/time.h"
+#include "compat/affinity.h"
+#include "compat/cgroup.h"
+#include "runner.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "zygote.h"
 #include "worker.h"
 
 static s_proc_handle *g_current_proc;
@@ -56,19 +66,49 @@ static void close_process(void *ptr, CR_UNUSED void *meta) {
     sfree(proc->proc);
 }
 
-struct event *worker_read_event(struct worker_set *workers, s_pipe_file_handle *pipe) {
-    struct event *ev = read_event(pipe);
+static bool bind_event(struct worker_set *workers, struct event *ev) {
+    for (size_t i = 0; i < workers->max_workers; ++i) {
+        if (!workers->workers[i])
+            continue;
+
+        if (workers->workers[i]->id == ev->pid) {
+            ev->worker = workers->workers[i];
+            ev->worker_index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct event *worker_read_event(struct worker_set *workers,
+                                struct event_reader *events) {
+    struct event *ev = event_reader_next(events);
     if (ev) {
         ev->worker_index = -1;
-        for (size_t i = 0; i < workers->max_workers; ++i) {
-            if (!workers->workers[i])
-                continue;
 
-            if (get_process_id_of(workers->workers[i]->proc) == ev->pid) {
-                ev->worker = workers->workers[i];
-                ev->worker_index = i;
+        // a process the runner reaped without having started it was left
+        // behind by a test, and adopted by the runner as a subreaper
+        bool adopted = false;
+        if (ev->kind == WORKER_TERMINATED) {
+            struct worker_status *ws = ev->data;
+            adopted = !forget_child(ev->pid)
+                && ws->reaper == get_process_id();
+        }
+
+        // the worker of a test pending on a snapshot is only known once
+        // the reply of the snapshot was read, which came before any event
+        if (bind_event(workers, ev)
+                || (snapshot_resolve(workers) && bind_event(workers, ev)))
+            return ev;
+
+        // the tests still bound to a dead pool or snapshot are the runner's
+        // business, and a dead zygote only means that the runner forks by
+        // itself
+        if (ev->kind == WORKER_TERMINATED) {
+            ev->worker = NULL;
+            if (thread_pool_reap(ev->pid) || zygote_reap(ev->pid)
+                    || snapshot_reap(ev) || adopted)
                 return ev;
-            }
         }
         criterion_perror("Could not link back the event PID to the active workers.\n");
         criterion_perror("The event pipe might have been corrupted.\n");
@@ -77,7 +117,24 @@ struct event *worker_read_event(struct worker_set *workers, s_pipe_file_handle *
     return NULL;
 }
 
+int kill_worker(struct worker *w, bool force) {
+    // a thread cannot be stopped alone: the whole pool goes down with it
+    if (w->pool)
+        thread_pool_retire(w->pool);
+    // neither can a test waiting for the setup of its suite
+    if (snapshot_pending(w->id))
+        return snapshot_stop(w->pool, force);
+    return kill_process(w->proc, force);
+}
+
 void run_worker(struct worker_context *ctx) {
+#ifdef SIGCHLD
+    // the tests may wait for their own children
+    signal(SIGCHLD, SIG_DFL);
+#endif
+    affinity_pin_worker();
+    if (ctx->cgroup)
+        cgroup_enter(ctx->cgroup);
     cr_redirect_stdin();
     g_event_pipe = pipe_out_handle(ctx->pipe, PIPE_CLOSE);
 
@@ -90,6 +147,44 @@ void run_worker(struct worker_context *ctx) {
     _Exit(0);
 }
 
+/*
+ * Picks the parameter of a worker that generated the parameters again, as
+ * those of the runner are out of its reach. A generator that does not return
+ * the same parameters every time would hand the worker another parameter
+ * than the one the runner reports, if any: the test crashes instead.
+ */
+void select_param(struct criterion_test *test,
+        struct criterion_test_params *params, size_t index, size_t size,
+        struct test_single_param *param) {
+    if (index >= params->length || params->size != size) {
+        criterion_perror("The parameter generator of %s::%s did not return "
+                "the same parameters in the worker as in the runner.\n",
+                test->category, test->name);
+        abort();
+    }
+    *param = (struct test_single_param) {
+        .size = size,
+        .ptr = (char *) params->params + index * size,
+        .index = index,
+    };
+}
+
+// time left to a worker to start its test, on top of the timeout
+#define WORKER_STARTUP_MARGIN_NS 5000000000ull
+
+void set_test_deadline(struct execution_context *ctx, uint64_t start,
+                       uint64_t margin) {
+    // the runner kills the worker itself if the test overstays its timeout
+    double timeout = get_test_timeout(ctx->test, ctx->suite);
+    if (timeout > 0 && start)
+        ctx->deadline = start + margin + (uint64_t) (timeout * 1e9);
+}
+
+static void start_test_clock(struct execution_context *ctx, uint64_t margin) {
+    ctx->test_stats->timestamps.spawn = get_timestamp_ns();
+    set_test_deadline(ctx, ctx->test_stats->timestamps.spawn, margin);
+}
+
 struct worker *spawn_test_worker(struct execution_context *ctx,
                                   cr_worker_func func,
                                   s_pipe_handle *pipe) {
@@ -103,28 +198,87 @@ struct worker *spawn_test_worker(struct execution_context *ctx,
 
     struct worker *ptr = NULL;
 
-    s_proc_handle *proc = fork_process();
+    // do not let the worker inherit pending output and write it twice
+    flush_outputs();
+
+    // a loaded machine may be slow to start the worker: the deadline is set
+    // again once the test starts, at PRE_INIT
+    start_test_clock(ctx, WORKER_STARTUP_MARGIN_NS);
+
+    // the kernel enforces the memory and CPU limits of the test
+    struct cgroup_limits limits = get_test_limits(ctx->test, ctx->suite);
+    ctx->cgroup = limits.memory || limits.cpus > 0
+        ? cgroup_create(&limits)
+        : NULL;
+    g_worker_context.cgroup = ctx->cgroup;
+
+    uint64_t start = get_timestamp_ns();
+    s_proc_handle *proc = NULL;
+    unsigned long long pending = 0;
+    if (snapshot_enabled(ctx->suite))
+        proc = snapshot_spawn(&g_worker_context, &pending);
+    if (!proc && criterion_options.spawn_workers)
+        proc = spawn_process();
+    if (!proc)
+        proc = zygote_spawn(&g_worker_context);
+    if (!proc)
+        proc = fork_process();
     if (proc == (void *) -1) {
         criterion_perror("Could not fork the current process and start a worker: %s.\n", strerror(errno));
         abort();
     } else if (proc == NULL) {
         run_worker(&g_worker_context);
+        free(ctx->cgroup);
         sfree(ctx->test_stats);
         sfree(ctx->suite_stats);
         sfree(ctx->stats);
         return NULL;
     }
 
+    ++g_runner_counters.spawns.calls;
+    if (start)
+        g_runner_counters.spawns.time += get_timestamp_ns() - start;
+
     ptr = smalloc(
             .size = sizeof (struct worker),
             .kind = SHARED,
             .dtor = close_process);
 
     *ptr = (struct worker) {
+        .id = get_process_id_of(proc),
         .proc = proc,
         .in = pipe_in_handle(pipe, PIPE_DUP),
         .ctx = *ctx,
     };
+
+    // a test whose suite setup failed is finalized with the snapshot
+    if (pending) {
+        ptr->id = pending;
+        ptr->pool = get_process_id_of(proc);
+    }
+    return ptr;
+}
+
+struct worker *spawn_thread_worker(struct execution_context *ctx,
+                                   cr_worker_func func) {
+    // the events of a pooled test only come once it is over, but the thread
+    // starts it right away
+    start_test_clock(ctx, 0);
+
+    s_proc_handle *pool;
+    unsigned long long id = thread_pool_submit(func, ctx->test, ctx->suite, &pool);
+
+    struct worker *ptr = smalloc(
+            .size = sizeof (struct worker),
+            .kind = SHARED,
+            .dtor = close_process);
+
+    *ptr = (struct worker) {
+        .id = id,
+        .pool = get_process_id_of(pool),
+        .proc = pool,
+        .ctx = *ctx,
+    };
     return ptr;
 }
 
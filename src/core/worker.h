@@ -26,12 +26,15 @@
 
 # include <stdbool.h>
 # include "criterion/types.h"
+# include "criterion/stats.h"
 # include "compat/process.h"
 # include "compat/pipe.h"
 
 struct test_single_param {
     size_t size;
     void *ptr;
+    size_t index;
+    bool copyable;      // holds no pointer to memory the generator allocated
 };
 
 struct execution_context {
@@ -39,6 +42,12 @@ struct execution_context {
     bool normal_finish;
     bool cleaned_up;
     bool aborted;
+    bool timed_out;
+    bool registered;
+    bool cancelled;
+    unsigned kills;
+    uint64_t deadline;
+    char *cgroup;
     struct criterion_global_stats *stats;
     struct criterion_test *test;
     struct criterion_test_stats *test_stats;
@@ -49,6 +58,8 @@ struct execution_context {
 
 struct worker {
     int active;
+    unsigned long long id;      // pid of the worker, or test id in its pool
+    unsigned long long pool;    // pid of the thread pool running the test
     s_proc_handle *proc;
     s_pipe_file_handle *in;
     struct execution_context ctx;
@@ -68,6 +79,8 @@ struct process_status {
 struct worker_status {
     s_proc_handle proc;
     struct process_status status;
+    struct criterion_resource_usage usage;
+    unsigned long long reaper;  // pid of the process that waited for it
 };
 
 struct worker_set {
@@ -75,9 +88,17 @@ struct worker_set {
     size_t max_workers;
 };
 
+struct event;
+struct event_reader;
+
 extern s_pipe_handle *g_worker_pipe;
 
 void run_worker(struct worker_context *ctx);
+void select_param(struct criterion_test *test,
+        struct criterion_test_params *params, size_t index, size_t size,
+        struct test_single_param *param);
+void set_test_deadline(struct execution_context *ctx, uint64_t start,
+                       uint64_t margin);
 void set_runner_process(void);
 void unset_runner_process(void);
 bool is_runner(void);
@@ -86,6 +107,10 @@ struct process_status get_status(int status);
 struct worker *spawn_test_worker(struct execution_context *ctx,
                                   cr_worker_func func,
                                   s_pipe_handle *pipe);
-struct event *worker_read_event(struct worker_set *workers, s_pipe_file_handle *pipe);
+struct worker *spawn_thread_worker(struct execution_context *ctx,
+                                   cr_worker_func func);
+struct event *worker_read_event(struct worker_set *workers,
+                                struct event_reader *events);
+int kill_worker(struct worker *w, bool force);
 
 #endif /* !PROCESS_H_ */
@@ -26,6 +26,7 @@
 #include "core/worker.h"
 #include "core/report.h"
 #include "compat/time.h"
+#include "compat/perf.h"
 #include "io/event.h"
 #include "wrap.h"
 
@@ -34,14 +35,18 @@ static INLINE void nothing(void) {}
 void c_wrap(struct criterion_test *test, struct criterion_suite *suite) {
 
     criterion_send_event(PRE_INIT, NULL, 0);
-    if (suite->data)
+    if (suite->data && !g_worker_context.suite_ready)
         (suite->data->init ? suite->data->init : nothing)();
     (test->data->init ? test->data->init : nothing)();
+    struct perf_group perf;
+    perf_group_open(&perf, g_perf_counters);
+
     criterion_send_event(PRE_TEST, NULL, 0);
 
     struct timespec_compat ts;
     if (!setjmp(g_pre_test)) {
         timer_start(&ts);
+        perf_group_enable(&perf);
         if (test->test) {
             if (!test->data->param_) {
                 test->test();
@@ -52,13 +57,18 @@ void c_wrap(struct criterion_test *test, struct criterion_suite *suite) {
         }
     }
 
-    double elapsed_time;
-    if (!timer_end(&elapsed_time, &ts))
-        elapsed_time = -1;
+    perf_group_disable(&perf);
+
+    struct post_test_data data;
+    if (!timer_end(&data.elapsed_time, &ts))
+        data.elapsed_time = -1;
+
+    perf_group_read(&perf, &data.perf_counters);
+    perf_group_close(&perf);
 
-    criterion_send_event(POST_TEST, &elapsed_time, sizeof(double));
+    criterion_send_event(POST_TEST, &data, sizeof (data));
     (test->data->fini ? test->data->fini : nothing)();
-    if (suite->data)
+    if (suite->data && !g_worker_context.suite_ready)
         (suite->data->fini ? suite->data->fini : nothing)();
     criterion_send_event(POST_FINI, NULL, 0);
 
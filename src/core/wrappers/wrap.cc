@@ -30,7 +30,9 @@ extern "C" {
 #include "core/abort.h"
 #include "core/report.h"
 #include "core/worker.h"
+#include "io/event.h"
 #include "compat/time.h"
+#include "compat/perf.h"
 #include "wrap.h"
 #include "common.h"
 
@@ -40,7 +42,7 @@ void cpp_wrap(struct criterion_test *test, struct criterion_suite *suite) {
 
     criterion_send_event(PRE_INIT, NULL, 0);
     try {
-        if (suite->data)
+        if (suite->data && !g_worker_context.suite_ready)
             (suite->data->init ? suite->data->init : nothing)();
         (test->data->init ? test->data->init : nothing)();
     } catch (const std::exception &e) {
@@ -48,11 +50,15 @@ void cpp_wrap(struct criterion_test *test, struct criterion_suite *suite) {
     } catch (...) {
         criterion_test_die("Caught some unexpected exception during the test initialization.");
     }
+    struct perf_group perf;
+    perf_group_open(&perf, g_perf_counters);
+
     criterion_send_event(PRE_TEST, NULL, 0);
 
     struct timespec_compat ts;
     if (!setjmp(g_pre_test)) {
         timer_start(&ts);
+        perf_group_enable(&perf);
         if (test->test) {
             try {
                 if (!test->data->param_) {
@@ -69,14 +75,19 @@ void cpp_wrap(struct criterion_test *test, struct criterion_suite *suite) {
         }
     }
 
-    double elapsed_time;
-    if (!timer_end(&elapsed_time, &ts))
-        elapsed_time = -1;
+    perf_group_disable(&perf);
+
+    struct post_test_data data;
+    if (!timer_end(&data.elapsed_time, &ts))
+        data.elapsed_time = -1;
+
+    perf_group_read(&perf, &data.perf_counters);
+    perf_group_close(&perf);
 
-    criterion_send_event(POST_TEST, &elapsed_time, sizeof(double));
+    criterion_send_event(POST_TEST, &data, sizeof (data));
     try {
         (test->data->fini ? test->data->fini : nothing)();
-        if (suite->data)
+        if (suite->data && !g_worker_context.suite_ready)
             (suite->data->fini ? suite->data->fini : nothing)();
     } catch (const std::exception &e) {
         criterion_test_die("Caught an unexpected exception during the test finalization: %s.", e.what());
@@ -0,0 +1,352 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <csptr/smalloc.h>
+
+#include "criterion/options.h"
+#include "compat/affinity.h"
+#include "compat/posix.h"
+#include "io/event.h"
+#include "worker.h"
+#include "zygote.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+# include <unistd.h>
+# include <sys/socket.h>
+# include <sys/wait.h>
+
+# ifndef PATH_MAX
+#  define PATH_MAX 4096
+# endif
+
+# ifdef MSG_NOSIGNAL
+#  define SEND_FLAGS MSG_NOSIGNAL
+# else
+#  define SEND_FLAGS 0
+# endif
+
+struct zygote_command {
+    cr_worker_func func;
+    struct criterion_test *test;
+    struct criterion_suite *suite;
+    size_t param_index;
+    size_t param_size;
+    bool has_param;
+    bool param_copied;      // the parameter follows the path of the cgroup
+    size_t slot;
+    size_t cgroup_size;     // the path of the cgroup follows, if any
+};
+
+struct zygote_reply {
+    long long pid;
+    int error;
+};
+
+struct zygote {
+    s_proc_handle *proc;
+    int fd;                 // -1 once the zygote is gone
+};
+
+static struct zygote g_zygote = { .fd = -1 };
+
+static bool read_full(int fd, void *buf, size_t size) {
+    for (size_t done = 0; done < size;) {
+        ssize_t res = read(fd, (char *) buf + done, size - done);
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            return false;
+        done += res;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const void *buf, size_t size) {
+    for (size_t done = 0; done < size;) {
+        ssize_t res = send(fd, (const char *) buf + done, size - done, SEND_FLAGS);
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            return false;
+        done += res;
+    }
+    return true;
+}
+
+/*
+ * The parameters are generated by the runner after the zygote was forked.
+ * Those that own no memory are sent along with the command; for the others,
+ * the zygote generates its own, once per test, and the runner only tells it
+ * which one to use.
+ */
+struct zygote_params {
+    struct criterion_test *test;
+    struct criterion_test_params params;
+    struct zygote_params *next;
+};
+
+static struct zygote_params *g_params;
+
+static struct criterion_test_params *get_params(struct criterion_test *test) {
+    for (struct zygote_params *p = g_params; p; p = p->next)
+        if (p->test == test)
+            return &p->params;
+
+    struct zygote_params *p = malloc(sizeof (struct zygote_params));
+    *p = (struct zygote_params) {
+        .test = test,
+        .params = test->data->param_(),
+        .next = g_params,
+    };
+    g_params = p;
+    return &p->params;
+}
+
+bool zygote_serve(int fd, bool suite_ready) {
+    static char cgroup[PATH_MAX];
+    static struct test_single_param param;
+    static char *copied;
+    static size_t copied_capacity;
+
+    struct zygote_command cmd;
+    while (read_full(fd, &cmd, sizeof (cmd)) && cmd.test) {
+        if (cmd.cgroup_size >= sizeof (cgroup)
+                || !read_full(fd, cgroup, cmd.cgroup_size))
+            break;
+        cgroup[cmd.cgroup_size] = '\0';
+
+        struct criterion_test_params *params = NULL;
+        if (cmd.has_param && cmd.param_copied) {
+            if (cmd.param_size > copied_capacity) {
+                copied_capacity = cmd.param_size;
+                copied = realloc(copied, copied_capacity);
+            }
+            if (!read_full(fd, copied, cmd.param_size))
+                break;
+            param = (struct test_single_param) {
+                .size = cmd.param_size,
+                .ptr = copied,
+                .index = cmd.param_index,
+                .copyable = true,
+            };
+        } else if (cmd.has_param) {
+            params = get_params(cmd.test);
+        }
+
+        g_worker_context = (struct worker_context) {
+            .test = cmd.test,
+            .suite = cmd.suite,
+            .func = cmd.func,
+            .pipe = g_worker_pipe,
+            .param = cmd.has_param ? &param : NULL,
+            .cgroup = cmd.cgroup_size ? cgroup : NULL,
+            .suite_ready = suite_ready,
+        };
+        affinity_set_slot(cmd.slot);
+
+        // The worker waits until its pid was sent, and its termination is
+        // only reported after that: the requester may not be waiting for
+        // the reply, and could not tell whose events those are before.
+        int go[2];
+        if (pipe(go) == -1)
+            go[0] = go[1] = -1;
+        hold_child_events(true);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fd);
+            close(go[1]);
+            char c;
+            while (read(go[0], &c, 1) == -1 && errno == EINTR)
+                continue;
+            close(go[0]);
+            hold_child_events(false);
+            if (params)
+                select_param(cmd.test, params, cmd.param_index,
+                        cmd.param_size, &param);
+            run_worker(&g_worker_context);
+            return false;
+        }
+
+        struct zygote_reply reply = { .pid = pid, .error = errno };
+        bool sent = write_full(fd, &reply, sizeof (reply));
+        close(go[0]);
+        close(go[1]);
+        hold_child_events(false);
+        if (!sent)
+            break;
+    }
+    return true;
+}
+
+bool zygote_start(void) {
+    if (criterion_options.no_fork || criterion_options.spawn_workers)
+        return true;
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+        return true;
+
+    s_proc_handle *proc = fork_process();
+    if (proc == (void *) -1) {
+        close(fds[0]);
+        close(fds[1]);
+        return true;
+    } else if (proc == NULL) {
+        close(fds[0]);
+        zygote_serve(fds[1], false);
+        close(fds[1]);
+        return false;
+    }
+
+    close(fds[1]);
+    g_zygote = (struct zygote) { .proc = proc, .fd = fds[0] };
+    return true;
+}
+
+bool zygote_send(int fd, struct worker_context *ctx) {
+    struct zygote_command cmd = {
+        .func = ctx->func,
+        .test = ctx->test,
+        .suite = ctx->suite,
+        .param_index = ctx->param ? ctx->param->index : 0,
+        .param_size = ctx->param ? ctx->param->size : 0,
+        .has_param = ctx->param != NULL,
+        .param_copied = ctx->param && ctx->param->copyable,
+        .slot = affinity_get_slot(),
+        .cgroup_size = ctx->cgroup ? strlen(ctx->cgroup) : 0,
+    };
+
+    return write_full(fd, &cmd, sizeof (cmd))
+        && write_full(fd, ctx->cgroup, cmd.cgroup_size)
+        && (!cmd.param_copied
+            || write_full(fd, ctx->param->ptr, cmd.param_size));
+}
+
+s_proc_handle *zygote_receive(int fd) {
+    struct zygote_reply reply;
+    if (!read_full(fd, &reply, sizeof (reply)))
+        return NULL;
+
+    if (reply.pid <= 0) {
+        errno = reply.error;
+        return (void *) -1;
+    }
+
+    s_proc_handle *proc = smalloc(sizeof (s_proc_handle));
+    *proc = (s_proc_handle) { (pid_t) reply.pid };
+    return proc;
+}
+
+s_proc_handle *zygote_request(int fd, struct worker_context *ctx) {
+    if (!zygote_send(fd, ctx))
+        return NULL;
+    return zygote_receive(fd);
+}
+
+void zygote_dismiss(int fd) {
+    // the processes forked in the meantime may still hold the socket, so
+    // its end cannot be relied upon
+    struct zygote_command cmd = { .test = NULL };
+    write_full(fd, &cmd, sizeof (cmd));
+    close(fd);
+}
+
+s_proc_handle *zygote_spawn(struct worker_context *ctx) {
+    if (g_zygote.fd == -1)
+        return NULL;
+
+    s_proc_handle *proc = zygote_request(g_zygote.fd, ctx);
+    if (!proc) {
+        // the runner forks the workers itself from now on
+        close(g_zygote.fd);
+        g_zygote.fd = -1;
+    }
+    return proc;
+}
+
+bool zygote_reap(unsigned long long pid) {
+    if (!g_zygote.proc || get_process_id_of(g_zygote.proc) != pid)
+        return false;
+
+    if (g_zygote.fd != -1)
+        close(g_zygote.fd);
+    sfree(g_zygote.proc);
+    g_zygote = (struct zygote) { .fd = -1 };
+    return true;
+}
+
+void zygote_stop(void) {
+    if (g_zygote.proc) {
+        // reap the zygote here: its SIGCHLD could otherwise come once the
+        // event pipe is gone
+        hold_child_events(true);
+        if (g_zygote.fd != -1)
+            zygote_dismiss(g_zygote.fd);
+        waitpid(g_zygote.proc->pid, NULL, 0);
+        hold_child_events(false);
+    }
+    sfree(g_zygote.proc);
+    g_zygote = (struct zygote) { .fd = -1 };
+}
+
+#else
+
+bool zygote_serve(CR_UNUSED int fd, CR_UNUSED bool suite_ready) {
+    return true;
+}
+
+bool zygote_send(CR_UNUSED int fd, CR_UNUSED struct worker_context *ctx) {
+    return false;
+}
+
+s_proc_handle *zygote_receive(CR_UNUSED int fd) {
+    return NULL;
+}
+
+s_proc_handle *zygote_request(CR_UNUSED int fd,
+                              CR_UNUSED struct worker_context *ctx) {
+    return NULL;
+}
+
+void zygote_dismiss(CR_UNUSED int fd) {}
+
+bool zygote_start(void) {
+    return true;
+}
+
+s_proc_handle *zygote_spawn(CR_UNUSED struct worker_context *ctx) {
+    return NULL;
+}
+
+bool zygote_reap(CR_UNUSED unsigned long long pid) {
+    return false;
+}
+
+void zygote_stop(void) {}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ZYGOTE_H_
+# define ZYGOTE_H_
+
+# include <stdbool.h>
+# include "compat/process.h"
+
+/*
+ * Forks the zygote, a copy of the runner taken before it grows, from which
+ * the workers get forked instead. Returns false in the zygote and in the
+ * workers it spawns, once they are done.
+ */
+bool zygote_start(void);
+
+/*
+ * Has the zygote fork a worker for the given context. Returns NULL if there
+ * is no zygote to ask, and (void *) -1 if the fork failed.
+ */
+s_proc_handle *zygote_spawn(struct worker_context *ctx);
+
+bool zygote_reap(unsigned long long pid);
+
+/*
+ * The fork server behind the zygote, which the suite snapshots share.
+ * zygote_serve forks a worker for each request read from fd until it gets
+ * dismissed, and returns true in the server then, and false in the workers
+ * once they are done. suite_ready tells the workers that the suite setup
+ * already ran in the server.
+ */
+bool zygote_serve(int fd, bool suite_ready);
+
+/*
+ * Asks the server at the other end of fd to fork a worker for the given
+ * context, and waits for it. Returns NULL if the server is gone, and
+ * (void *) -1 if the fork failed.
+ */
+s_proc_handle *zygote_request(int fd, struct worker_context *ctx);
+
+/*
+ * The two halves of zygote_request, for the requests whose reply is not
+ * waited for. The server replies in the order of the requests, and the
+ * events of a worker never come before its reply.
+ */
+bool zygote_send(int fd, struct worker_context *ctx);
+s_proc_handle *zygote_receive(int fd);
+void zygote_dismiss(int fd);
+void zygote_stop(void);
+
+#endif /* !ZYGOTE_H_ */
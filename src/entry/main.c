@@ -29,6 +29,7 @@
 #include "criterion/criterion.h"
 #include "criterion/options.h"
 #include "criterion/ordered-set.h"
+#include "criterion/output.h"
 #include "core/runner.h"
 #include "config.h"
 #include "common.h"
@@ -42,7 +43,9 @@
 #ifdef HAVE_PCRE
 # define PATTERN_USAGE                                      \
     "    --pattern [PATTERN]: run tests matching the "      \
-            "given pattern\n"
+            "given pattern (may be repeated)\n"             \
+    "    --exclude [PATTERN]: skip tests matching the "     \
+            "given pattern (may be repeated)\n"
 #else
 # define PATTERN_USAGE
 #endif
@@ -55,8 +58,13 @@
     "    -v or --version: prints the version of criterion " \
             "these tests have been linked against\n"        \
     "    -l or --list: prints all the tests in a list\n"    \
-    "    -jN or --jobs N: use N concurrent jobs\n"          \
-    "    -f or --fail-fast: exit after the first failure\n" \
+    "    -jN or --jobs N: use N concurrent jobs, or "       \
+            "auto to adjust them to the CPU and memory "    \
+            "pressure\n"                                    \
+    "    -f or --fail-fast[=SCOPE]: cancel the rest of "    \
+            "the tests after the first failure, in the "    \
+            "whole run, the suite, or the parameterized "   \
+            "test (run, suite or param; run by default)\n"  \
     "    --ascii: don't use fancy unicode symbols "         \
             "or colors in the output\n"                     \
     "    -S or --short-filename: only display the base "    \
@@ -64,12 +72,62 @@
     PATTERN_USAGE                                           \
     "    --tap: enables TAP formatting\n"                   \
     "    --xml: enables XML formatting\n"                   \
+    "    --json: enables newline-delimited JSON "           \
+            "formatting\n"                                  \
+    "    --binary: enables length-prefixed binary "         \
+            "formatting\n"                                  \
+    "    --output=PROVIDER[:DEST]: also report with "       \
+            "PROVIDER to DEST (a file, fd:N, "              \
+            "or stderr by default)\n"                       \
+    "    --perf-counters[=LIST]: measure the given "        \
+            "hardware counters over each test "             \
+            "(Linux only)\n"                                \
+    "    --bench-time=SECONDS: time spent measuring "       \
+            "each benchmark (0.2 by default)\n"             \
+    "    --bench-samples=N: number of samples taken "       \
+            "for each benchmark (20 by default)\n"          \
+    "    --bench-save=FILE: save the benchmark results "    \
+            "to FILE\n"                                     \
+    "    --bench-compare=FILE: compare the benchmarks "     \
+            "with the results saved in FILE\n"              \
+    "    --bench-threshold=PERCENT: fail on slowdowns "     \
+            "above PERCENT (5 by default)\n"                \
+    "    --pin-workers: pin each worker to its own CPU\n"   \
+    "    --cpus=LIST: only run the workers on the CPUs "    \
+            "of LIST (e.g. 0-3,8)\n"                        \
+    "    --reserve-cpus=N: keep N CPUs for the runner\n"    \
+    "    --timeout=SECONDS: time out the tests that do "    \
+            "not set their own timeout after SECONDS\n"     \
+    "    --memory-limit=SIZE: kill the tests that do not "  \
+            "set their own limit once they use more than "  \
+            "SIZE bytes (K, M or G suffixes allowed)\n"     \
+    "    --cpu-quota=CPUS: limit the tests that do not "    \
+            "set their own quota to CPUS worth of CPU "     \
+            "time\n"                                        \
+    "    --isolation=MODE: run the tests that do not "      \
+            "set their own isolation in a process or "      \
+            "in a thread (process by default)\n"            \
     "    --always-succeed: always exit with 0\n"            \
     "    --no-early-exit: do not exit the test worker "     \
             "prematurely after the test\n"                  \
+    "    --no-fork: run the tests one after the other in "  \
+            "the runner process, e.g. under a debugger\n"   \
+    "    --spawn-workers: start each worker as a fresh "    \
+            "process instead of forking the runner\n"       \
+    "    --async-hooks[=N]: run the report hooks on a "     \
+            "thread of their own, queuing up to N events "  \
+            "(1024 by default)\n"                           \
+    "    --metrics-socket=PATH: serve the progress of "     \
+            "the run over HTTP on the unix socket PATH\n"   \
+    "    --trace=PATH: write the timeline of the run to "   \
+            "PATH as Chrome trace events\n"                 \
+    "    --summary=perf: analyse where the time of the "    \
+            "run went once it is over\n"                    \
     "    --verbose[=level]: sets verbosity to level "       \
             "(1 by default)\n"
 
+# define DEFAULT_PERF_COUNTERS "cycles,instructions,cache-misses,branch-misses"
+
 int print_usage(char *progname) {
     fprintf(stderr, USAGE, progname);
     return 0;
@@ -127,23 +185,119 @@ int atou(const char *str) {
     return res < 0 ? 0 : res;
 }
 
+// Parses a size in bytes, with an optional K, M or G binary suffix
+static size_t parse_size(const char *str) {
+    char *end;
+    double size = strtod(str, &end);
+    switch (*end) {
+        case 'G': case 'g': size *= 1024; // fallthrough
+        case 'M': case 'm': size *= 1024; // fallthrough
+        case 'K': case 'k': size *= 1024; break;
+        default: break;
+    }
+    return size > 0 ? (size_t) size : 0;
+}
+
+static bool set_fail_fast(const char *scope) {
+    static const char *const scopes[] = {
+        [CR_FAIL_FAST_RUN]   = "run",
+        [CR_FAIL_FAST_SUITE] = "suite",
+        [CR_FAIL_FAST_PARAM] = "param",
+    };
+    for (size_t i = 0; i < sizeof (scopes) / sizeof (*scopes); ++i) {
+        if (!strcmp(scope, scopes[i])) {
+            criterion_options.fail_fast = true;
+            criterion_options.fail_fast_scope = (enum criterion_fail_fast_scope) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void set_jobs(const char *jobs) {
+    criterion_options.adaptive_jobs = !strcmp(jobs, "auto");
+    criterion_options.jobs = criterion_options.adaptive_jobs ? 0 : atou(jobs);
+}
+
+static bool set_isolation(const char *mode) {
+    static const char *const modes[] = {
+        [CR_ISOLATION_PROCESS] = "process",
+        [CR_ISOLATION_THREAD]  = "thread",
+    };
+    for (size_t i = CR_ISOLATION_PROCESS; i < sizeof (modes) / sizeof (*modes); ++i) {
+        if (!strcmp(mode, modes[i])) {
+            criterion_options.isolation = (enum criterion_isolation) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool set_summary(const char *kind) {
+    static const char *const kinds[] = {
+        [CR_SUMMARY_PERF] = "perf",
+    };
+    for (size_t i = CR_SUMMARY_PERF; i < sizeof (kinds) / sizeof (*kinds); ++i) {
+        if (!strcmp(kind, kinds[i])) {
+            criterion_options.summary = (enum criterion_summary) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void add_output(const char *arg) {
+    char *provider = strdup(arg);
+    char *path = strchr(provider, ':');
+    if (path)
+        *path++ = '\0';
+
+    bool added = criterion_add_output(provider, path);
+    free(provider);
+    if (!added)
+        exit(1);
+}
+
 int criterion_handle_args(int argc, char *argv[], bool handle_unknown_arg) {
     static struct option opts[] = {
         {"verbose",         optional_argument,  0, 'b'},
         {"version",         no_argument,        0, 'v'},
         {"tap",             no_argument,        0, 't'},
         {"xml",             no_argument,        0, 'x'},
+        {"json",            no_argument,        0, 'J'},
+        {"binary",          no_argument,        0, 'B'},
         {"help",            no_argument,        0, 'h'},
         {"list",            no_argument,        0, 'l'},
         {"ascii",           no_argument,        0, 'k'},
         {"jobs",            required_argument,  0, 'j'},
-        {"fail-fast",       no_argument,        0, 'f'},
+        {"fail-fast",       optional_argument,  0, 'f'},
         {"short-filename",  no_argument,        0, 'S'},
 #ifdef HAVE_PCRE
         {"pattern",         required_argument,  0, 'p'},
+        {"exclude",         required_argument,  0, 'X'},
 #endif
+        {"output",          required_argument,  0, 'O'},
+        {"perf-counters",   optional_argument,  0, 'P'},
+        {"bench-time",      required_argument,  0, 'M'},
+        {"bench-samples",   required_argument,  0, 'R'},
+        {"bench-save",      required_argument,  0, 'W'},
+        {"bench-compare",   required_argument,  0, 'C'},
+        {"bench-threshold", required_argument,  0, 'H'},
+        {"pin-workers",     no_argument,        0, 'I'},
+        {"cpus",            required_argument,  0, 'U'},
+        {"reserve-cpus",    required_argument,  0, 'E'},
+        {"timeout",         required_argument,  0, 'T'},
+        {"memory-limit",    required_argument,  0, 'L'},
+        {"cpu-quota",       required_argument,  0, 'Q'},
+        {"isolation",       required_argument,  0, 'N'},
         {"always-succeed",  no_argument,        0, 'y'},
         {"no-early-exit",   no_argument,        0, 'z'},
+        {"no-fork",         no_argument,        0, 'F'},
+        {"spawn-workers",   no_argument,        0, 'G'},
+        {"async-hooks",     optional_argument,  0, 'A'},
+        {"metrics-socket",  required_argument,  0, 'K'},
+        {"trace",           required_argument,  0, 'D'},
+        {"summary",         required_argument,  0, 'Y'},
         {0,                 0,                  0,  0 }
     };
 
@@ -157,11 +311,22 @@ int criterion_handle_args(int argc, char *argv[], bool handle_unknown_arg) {
 
     char *env_always_succeed    = getenv("CRITERION_ALWAYS_SUCCEED");
     char *env_no_early_exit     = getenv("CRITERION_NO_EARLY_EXIT");
+    char *env_no_fork           = getenv("CRITERION_NO_FORK");
+    char *env_spawn_workers     = getenv("CRITERION_SPAWN_WORKERS");
+    char *env_async_hooks       = getenv("CRITERION_ASYNC_HOOKS");
+    char *env_metrics_socket    = getenv("CRITERION_METRICS_SOCKET");
+    char *env_trace             = getenv("CRITERION_TRACE");
+    char *env_summary           = getenv("CRITERION_SUMMARY");
     char *env_fail_fast         = getenv("CRITERION_FAIL_FAST");
     char *env_use_ascii         = getenv("CRITERION_USE_ASCII");
     char *env_jobs              = getenv("CRITERION_JOBS");
     char *env_logging_threshold = getenv("CRITERION_VERBOSITY_LEVEL");
     char *env_short_filename    = getenv("CRITERION_SHORT_FILENAME");
+    char *env_perf_counters     = getenv("CRITERION_PERF_COUNTERS");
+    char *env_timeout           = getenv("CRITERION_TIMEOUT");
+    char *env_memory_limit      = getenv("CRITERION_MEMORY_LIMIT");
+    char *env_cpu_quota         = getenv("CRITERION_CPU_QUOTA");
+    char *env_isolation         = getenv("CRITERION_ISOLATION");
 
     bool is_term_dumb = !strcmp("dumb", DEF(getenv("TERM"), "dumb"));
 
@@ -170,25 +335,61 @@ int criterion_handle_args(int argc, char *argv[], bool handle_unknown_arg) {
         opt->always_succeed    = !strcmp("1", env_always_succeed);
     if (env_no_early_exit)
         opt->no_early_exit     = !strcmp("1", env_no_early_exit);
-    if (env_fail_fast)
-        opt->fail_fast         = !strcmp("1", env_fail_fast);
+    if (env_no_fork)
+        opt->no_fork           = !strcmp("1", env_no_fork);
+    if (env_spawn_workers)
+        opt->spawn_workers     = !strcmp("1", env_spawn_workers);
+    if (env_async_hooks)
+        opt->async_hooks       = atou(env_async_hooks);
+    if (env_metrics_socket)
+        opt->metrics_socket    = env_metrics_socket;
+    if (env_trace)
+        opt->trace             = env_trace;
     if (env_use_ascii)
         opt->use_ascii         = !strcmp("1", env_use_ascii) || is_term_dumb;
     if (env_jobs)
-        opt->jobs              = atou(env_jobs);
+        set_jobs(env_jobs);
     if (env_logging_threshold)
         opt->logging_threshold = atou(env_logging_threshold);
     if (env_short_filename)
         opt->short_filename    = !strcmp("1", env_short_filename);
+    if (env_perf_counters)
+        opt->perf_counters     = env_perf_counters;
+    if (env_timeout)
+        opt->timeout           = atof(env_timeout);
+    if (env_memory_limit)
+        opt->memory_limit      = parse_size(env_memory_limit);
+    if (env_cpu_quota)
+        opt->cpu_quota         = atof(env_cpu_quota);
+    if (env_isolation && !set_isolation(env_isolation)) {
+        fprintf(stderr, "Unknown isolation mode: %s\n", env_isolation);
+        exit(1);
+    }
+    if (env_fail_fast && !strcmp("0", env_fail_fast))
+        opt->fail_fast         = false;
+    else if (env_fail_fast && !set_fail_fast(!strcmp("1", env_fail_fast)
+                ? "run" : env_fail_fast)) {
+        fprintf(stderr, "Unknown fail-fast scope: %s\n", env_fail_fast);
+        exit(1);
+    }
+    if (env_summary && !set_summary(env_summary)) {
+        fprintf(stderr, "Unknown summary: %s\n", env_summary);
+        exit(1);
+    }
 
 #ifdef HAVE_PCRE
     char *env_pattern = getenv("CRITERION_TEST_PATTERN");
     if (env_pattern)
         opt->pattern = env_pattern;
+    char *env_exclude = getenv("CRITERION_TEST_EXCLUDE");
+    if (env_exclude)
+        criterion_add_test_pattern(env_exclude, true);
 #endif
 
     bool use_tap = !strcmp("1", DEF(getenv("CRITERION_ENABLE_TAP"), "0"));
     bool use_xml = !strcmp("1", DEF(getenv("CRITERION_ENABLE_XML"), "0"));
+    bool use_json = !strcmp("1", DEF(getenv("CRITERION_ENABLE_JSON"), "0"));
+    bool use_binary = !strcmp("1", DEF(getenv("CRITERION_ENABLE_BINARY"), "0"));
 
     opt->measure_time = !!strcmp("1", DEF(getenv("CRITERION_DISABLE_TIME_MEASUREMENTS"), "0"));
 
@@ -200,15 +401,53 @@ int criterion_handle_args(int argc, char *argv[], bool handle_unknown_arg) {
             case 'b': criterion_options.logging_threshold = atou(DEF(optarg, "1")); break;
             case 'y': criterion_options.always_succeed    = true; break;
             case 'z': criterion_options.no_early_exit     = true; break;
+            case 'F': criterion_options.no_fork           = true; break;
+            case 'G': criterion_options.spawn_workers     = true; break;
+            case 'A': criterion_options.async_hooks       = atou(DEF(optarg, "1024")); break;
+            case 'K': criterion_options.metrics_socket    = optarg; break;
+            case 'D': criterion_options.trace             = optarg; break;
             case 'k': criterion_options.use_ascii         = true; break;
-            case 'j': criterion_options.jobs              = atou(optarg); break;
-            case 'f': criterion_options.fail_fast         = true; break;
+            case 'j': set_jobs(optarg); break;
+            case 'f':
+                if (!set_fail_fast(DEF(optarg, "run"))) {
+                    fprintf(stderr, "Unknown fail-fast scope: %s\n", optarg);
+                    exit(1);
+                }
+                break;
             case 'S': criterion_options.short_filename    = true; break;
+            case 'P': criterion_options.perf_counters     = DEF(optarg, DEFAULT_PERF_COUNTERS); break;
+            case 'M': criterion_options.bench_time        = atof(optarg); break;
+            case 'R': criterion_options.bench_samples     = atou(optarg); break;
+            case 'W': criterion_options.bench_save        = optarg; break;
+            case 'C': criterion_options.bench_compare     = optarg; break;
+            case 'H': criterion_options.bench_threshold   = atof(optarg) / 100; break;
+            case 'I': criterion_options.pin_workers       = true; break;
+            case 'U': criterion_options.cpus              = optarg; break;
+            case 'E': criterion_options.reserved_cpus     = atou(optarg); break;
+            case 'T': criterion_options.timeout           = atof(optarg); break;
+            case 'L': criterion_options.memory_limit      = parse_size(optarg); break;
+            case 'Q': criterion_options.cpu_quota         = atof(optarg); break;
+            case 'N':
+                if (!set_isolation(optarg)) {
+                    fprintf(stderr, "Unknown isolation mode: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'Y':
+                if (!set_summary(optarg)) {
+                    fprintf(stderr, "Unknown summary: %s\n", optarg);
+                    exit(1);
+                }
+                break;
 #ifdef HAVE_PCRE
-            case 'p': criterion_options.pattern           = optarg; break;
+            case 'p': criterion_add_test_pattern(optarg, false); break;
+            case 'X': criterion_add_test_pattern(optarg, true); break;
 #endif
             case 't': use_tap = true; break;
             case 'x': use_xml = true; break;
+            case 'O': add_output(optarg); break;
+            case 'J': use_json = true; break;
+            case 'B': use_binary = true; break;
             case 'l': do_list_tests = true; break;
             case 'v': do_print_version = true; break;
             case 'h': do_print_usage = true; break;
@@ -220,6 +459,10 @@ int criterion_handle_args(int argc, char *argv[], bool handle_unknown_arg) {
         criterion_options.output_provider = CR_TAP_LOGGING;
     else if (use_xml)
         criterion_options.output_provider = CR_XML_LOGGING;
+    else if (use_json)
+        criterion_options.output_provider = CR_JSON_LOGGING;
+    else if (use_binary)
+        criterion_options.output_provider = CR_BINARY_LOGGING;
     if (do_print_usage)
         return print_usage(argv[0]);
     if (do_print_version)
@@ -27,4 +27,7 @@ struct criterion_options criterion_options = {
     .logging_threshold = CRITERION_IMPORTANT,
     .output_provider   = &normal_logging,
     .measure_time      = true,
+    .bench_time        = 0.2,
+    .bench_samples     = 20,
+    .bench_threshold   = 0.05,
 };
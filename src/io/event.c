@@ -24,15 +24,27 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <csptr/smalloc.h>
 #include "criterion/stats.h"
 #include "criterion/common.h"
 #include "criterion/hooks.h"
 #include "criterion/logging.h"
+#include "core/stats.h"
 #include "core/worker.h"
+#include "compat/time.h"
+#include "common.h"
 #include "event.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+# include <pthread.h>
+
+// the fragments of the threads of a worker must not interleave
+static pthread_mutex_t g_fragments_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 s_pipe_file_handle *g_event_pipe = NULL;
+f_event_sink *g_event_sink = NULL;
 
 void destroy_event(void *ptr, CR_UNUSED void *meta) {
     struct event *ev = ptr;
@@ -59,105 +71,532 @@ void destroy_assert_event(void *ptr, CR_UNUSED void *meta) {
         }                                                                   \
     } while (0)
 
-struct event *read_event(s_pipe_file_handle *f) {
-    unsigned kind;
-    ASSERT(pipe_read(&kind, sizeof (unsigned), f) == 1);
+struct file_name {
+    struct file_name *next;
+    char name[];
+};
 
-    unsigned long long pid;
-    ASSERT(pipe_read(&pid, sizeof (unsigned long long), f) == 1);
+/*
+ * The file names of the assertions are sent along with them, as the address
+ * of the string is meaningless in the runner when the worker was spawned
+ * rather than forked. They are interned, since the statistics keep them
+ * for the whole run.
+ */
+static const char *intern_file_name(const char *name) {
+    static struct file_name *names;
+    for (struct file_name *n = names; n; n = n->next) {
+        if (!strcmp(n->name, name))
+            return n->name;
+    }
 
-    switch (kind) {
-        case ASSERT: {
-            const size_t assert_size = sizeof (struct criterion_assert_stats);
-            struct criterion_assert_stats *buf = NULL;
-            char *msg = NULL;
+    size_t len = strlen(name) + 1;
+    struct file_name *n = malloc(sizeof (struct file_name) + len);
+    memcpy(n->name, name, len);
+    n->next = names;
+    names = n;
+    return n->name;
+}
 
-            buf = malloc(assert_size);
-            ASSERT(pipe_read(buf, assert_size, f) == 1);
+struct memory_reader {
+    const unsigned char *ptr;
+    const unsigned char *end;
+};
 
-            size_t len = 0;
-            ASSERT(pipe_read(&len, sizeof (size_t), f) == 1);
+static bool read_memory(void *buf, size_t size, struct memory_reader *r) {
+    if ((size_t) (r->end - r->ptr) < size)
+        return false;
+    memcpy(buf, r->ptr, size);
+    r->ptr += size;
+    return true;
+}
 
-            msg = malloc(len);
-            ASSERT(pipe_read(msg, len, f) == 1);
+// Reads a size-prefixed string, which is always given back terminated
+static char *read_string(struct memory_reader *r) {
+    size_t len;
+    if (!read_memory(&len, sizeof (size_t), r)
+            || !len || len > (size_t) (r->end - r->ptr))
+        return NULL;
 
-            buf->message = msg;
+    char *str = malloc(len);
+    read_memory(str, len, r);
+    str[len - 1] = '\0';
+    return str;
+}
 
-            struct event *ev = smalloc(
-                    .size = sizeof (struct event),
-                    .dtor = destroy_assert_event
-                );
-            *ev = (struct event) { .pid = pid, .kind = kind, .data = buf };
-            return ev;
-        }
-        case TEST_ABORT: {
-            char *msg = NULL;
+static struct event *new_event(const struct event_header *header,
+                               void *data,
+                               f_destructor dtor) {
+    struct event *ev = smalloc(
+            .size = sizeof (struct event),
+            .dtor = dtor
+        );
+    *ev = (struct event) {
+        .pid = header->pid,
+        .kind = header->kind,
+        .timestamp = header->timestamp,
+        .data = data,
+    };
+    return ev;
+}
 
-            size_t len = 0;
-            ASSERT(pipe_read(&len, sizeof (size_t), f) == 1);
+static struct event *decode_payload(const struct event_header *header,
+                                    struct memory_reader *r) {
+    switch (header->kind) {
+        case ASSERT: {
+            struct criterion_assert_stats *buf =
+                    malloc(sizeof (struct criterion_assert_stats));
+            if (!read_memory(buf, sizeof (*buf), r))
+                goto fail_assert;
+
+            char *msg = read_string(r);
+            if (!msg)
+                goto fail_assert;
 
-            msg = malloc(len);
-            ASSERT(pipe_read(msg, len, f) == 1);
+            char *file = read_string(r);
+            if (!file) {
+                free(msg);
+                goto fail_assert;
+            }
+            buf->message = msg;
+            buf->file = intern_file_name(file);
+            free(file);
 
-            struct event *ev = smalloc(
-                    .size = sizeof (struct event),
-                    .dtor = destroy_event
-                );
-            *ev = (struct event) { .pid = pid, .kind = kind, .data = msg };
-            return ev;
+            return new_event(header, buf, destroy_assert_event);
+fail_assert:
+            free(buf);
+            return NULL;
         }
+        case TEST_ABORT:
         case THEORY_FAIL: {
-            size_t len = 0;
-            ASSERT(pipe_read(&len, sizeof (size_t), f) == 1);
-
-            char *buf = malloc(len);
-            ASSERT(pipe_read(buf, len, f) == 1);
-
-            struct event *ev = smalloc(
-                    .size = sizeof (struct event),
-                    .dtor = destroy_event
-                );
-            *ev = (struct event) { .pid = pid, .kind = kind, .data = buf };
-            return ev;
+            char *msg = read_string(r);
+            if (!msg)
+                return NULL;
+            return new_event(header, msg, destroy_event);
         }
         case POST_TEST: {
-            double *elapsed_time = malloc(sizeof (double));
-            ASSERT(pipe_read(elapsed_time, sizeof (double), f) == 1);
-
-            struct event *ev = smalloc(
-                    .size = sizeof (struct event),
-                    .dtor = destroy_event
-                );
-            *ev = (struct event) { .pid = pid, .kind = kind, .data = elapsed_time };
-            return ev;
+            struct post_test_data *data = malloc(sizeof (struct post_test_data));
+            if (!read_memory(data, sizeof (*data), r)) {
+                free(data);
+                return NULL;
+            }
+            return new_event(header, data, destroy_event);
+        }
+        case BENCH: {
+            struct criterion_bench_stats stats;
+            if (!read_memory(&stats, sizeof (stats), r)
+                    || stats.samples > (size_t) (r->end - r->ptr) / sizeof (double))
+                return NULL;
+
+            // the samples are kept in the same block as the statistics
+            size_t samples_size = stats.samples * sizeof (double);
+            struct criterion_bench_stats *buf =
+                    malloc(sizeof (stats) + samples_size);
+            *buf = stats;
+            buf->sample_times = (double *) (buf + 1);
+            read_memory(buf->sample_times, samples_size, r);
+            return new_event(header, buf, destroy_event);
         }
         case WORKER_TERMINATED: {
             struct worker_status *status = malloc(sizeof (struct worker_status));
-            ASSERT(pipe_read(status, sizeof (struct worker_status), f) == 1);
-
-            struct event *ev = smalloc(
-                    .size = sizeof (struct event),
-                    .dtor = destroy_event
-                );
-            *ev = (struct event) { .pid = pid, .kind = kind, .data = status };
-            return ev;
+            if (!read_memory(status, sizeof (*status), r)) {
+                free(status);
+                return NULL;
+            }
+            return new_event(header, status, destroy_event);
+        }
+        default:
+            return new_event(header, NULL, NULL);
+    }
+}
+
+void event_header_init(struct event_header *header, int kind,
+                       unsigned long long pid, size_t size) {
+    *header = (struct event_header) {
+        .magic = EVENT_MAGIC,
+        .version = EVENT_VERSION,
+        .kind = kind,
+        .size = size,
+        .pid = pid,
+        .timestamp = get_timestamp_ns(),
+    };
+}
+
+int event_decode(const void *buf, size_t size, size_t *consumed,
+                 struct event **ev) {
+    struct event_header header;
+    if (size < sizeof (header))
+        return 0;
+    memcpy(&header, buf, sizeof (header));
+
+    if (header.magic != EVENT_MAGIC || header.version != EVENT_VERSION
+            || header.flags || header.size > EVENT_MAX_PAYLOAD)
+        return -1;
+    if (size - sizeof (header) < header.size)
+        return 0;
+
+    const unsigned char *payload = (const unsigned char *) buf + sizeof (header);
+    struct memory_reader r = { payload, payload + header.size };
+    struct event *e = decode_payload(&header, &r);
+
+    // the payload must be exactly what its kind expects
+    if (!e || r.ptr != r.end) {
+        sfree(e);
+        return -1;
+    }
+    *consumed = sizeof (header) + header.size;
+    *ev = e;
+    return 1;
+}
+
+// The fragments received so far from a source, behind the first header
+struct partial_frame {
+    unsigned long long pid;
+    unsigned char *buf;
+    size_t size;
+    struct partial_frame *next;
+};
+
+struct event_reader {
+    s_pipe_file_handle *pipe;
+    unsigned char *buf;
+    size_t begin;
+    size_t end;
+    size_t capacity;
+    struct partial_frame *partials;
+};
+
+static void destroy_event_reader(void *ptr, CR_UNUSED void *meta) {
+    struct event_reader *reader = ptr;
+    for (struct partial_frame *p = reader->partials, *next; p; p = next) {
+        next = p->next;
+        free(p->buf);
+        free(p);
+    }
+    free(reader->buf);
+}
+
+struct event_reader *event_reader_new(s_pipe_file_handle *pipe) {
+    struct event_reader *reader = smalloc(
+            .size = sizeof (struct event_reader),
+            .dtor = destroy_event_reader
+        );
+
+    // the size of a pipe buffer, to drain it in one read when it fills up
+    size_t capacity = 64 * 1024;
+    *reader = (struct event_reader) {
+        .pipe = pipe,
+        .buf = malloc(capacity),
+        .capacity = capacity,
+    };
+    return reader;
+}
+
+static void corrupted_pipe(void) {
+    criterion_perror("Corrupted event IO in the worker pipe.\n");
+    abort();
+}
+
+// Returns the size of the frame being received, or 0 if it is not known yet
+static size_t pending_frame_size(struct event_reader *reader) {
+    struct event_header header;
+    if (reader->end - reader->begin < sizeof (header))
+        return 0;
+    memcpy(&header, reader->buf + reader->begin, sizeof (header));
+
+    // a corrupted header is caught before waiting for its payload
+    if (header.magic != EVENT_MAGIC || header.version != EVENT_VERSION
+            || (header.flags & ~EVENT_MORE) || header.size > EVENT_MAX_PAYLOAD)
+        corrupted_pipe();
+    return sizeof (header) + header.size;
+}
+
+static struct partial_frame **find_partial(struct event_reader *reader,
+                                           unsigned long long pid) {
+    struct partial_frame **p = &reader->partials;
+    while (*p && (*p)->pid != pid)
+        p = &(*p)->next;
+    return p;
+}
+
+static void drop_partial(struct partial_frame **slot) {
+    struct partial_frame *p = *slot;
+    *slot = p->next;
+    free(p->buf);
+    free(p);
+}
+
+/*
+ * Decodes a whole frame whose header was checked, or adds it to the
+ * fragments of its source. Returns 1 and sets ev when an event is complete,
+ * 0 when more fragments are expected, and -1 when the frame is invalid.
+ */
+static int take_frame(struct event_reader *reader, const unsigned char *frame,
+                      size_t size, struct event **ev) {
+    struct event_header header;
+    memcpy(&header, frame, sizeof (header));
+
+    // a process that died halfway through a frame never sends the rest
+    struct partial_frame **slot = find_partial(reader, header.pid);
+    if (*slot && header.kind == WORKER_TERMINATED)
+        drop_partial(slot);
+
+    struct partial_frame *p = *slot;
+    if (!p && !(header.flags & EVENT_MORE)) {
+        size_t consumed;
+        return event_decode(frame, size, &consumed, ev) > 0 ? 1 : -1;
+    }
+
+    if (!p) {
+        p = malloc(sizeof (struct partial_frame));
+        *p = (struct partial_frame) {
+            .pid = header.pid,
+            .buf = malloc(size),
+            .next = reader->partials,
+        };
+        memcpy(p->buf, frame, size);
+        p->size = size;
+        reader->partials = p;
+        return 0;
+    }
+
+    struct event_header first;
+    memcpy(&first, p->buf, sizeof (first));
+    size_t payload = p->size - sizeof (first) + header.size;
+    if (header.kind != first.kind || payload > EVENT_MAX_PAYLOAD)
+        return -1;
+
+    unsigned char *buf = realloc(p->buf, p->size + header.size);
+    ASSERT(buf != NULL);
+    memcpy(buf + p->size, frame + sizeof (header), header.size);
+    p->buf = buf;
+    p->size += header.size;
+    if (header.flags & EVENT_MORE)
+        return 0;
+
+    // the event is whole: decode it as if it had been sent in one frame
+    first.flags = 0;
+    first.size = payload;
+    memcpy(p->buf, &first, sizeof (first));
+
+    size_t consumed;
+    int res = event_decode(p->buf, p->size, &consumed, ev);
+    drop_partial(slot);
+    return res > 0 ? 1 : -1;
+}
+
+struct event *event_reader_next(struct event_reader *reader) {
+    for (;;) {
+        size_t size = pending_frame_size(reader);
+        if (size && size <= reader->end - reader->begin) {
+            struct event *ev = NULL;
+            int res = take_frame(reader, reader->buf + reader->begin, size,
+                    &ev);
+            if (res < 0)
+                corrupted_pipe();
+            reader->begin += size;
+            if (res > 0)
+                return ev;
+            continue;
         }
-        default: {
-            struct event *ev = smalloc(sizeof (struct event));
-            *ev = (struct event) { .pid = pid, .kind = kind, .data = NULL };
-            return ev;
+
+        // make room for the rest of the frame at the end of the buffer
+        memmove(reader->buf, reader->buf + reader->begin,
+                reader->end - reader->begin);
+        reader->end -= reader->begin;
+        reader->begin = 0;
+
+        size_t needed = pending_frame_size(reader);
+        if (needed > reader->capacity) {
+            size_t capacity = reader->capacity;
+            while (capacity < needed)
+                capacity *= 2;
+            unsigned char *buf = realloc(reader->buf, capacity);
+            ASSERT(buf != NULL);
+            reader->buf = buf;
+            reader->capacity = capacity;
+        }
+
+        size_t read;
+        uint64_t start = get_timestamp_ns();
+        int res = pipe_read_some(reader->buf + reader->end,
+                reader->capacity - reader->end, &read, reader->pipe);
+        ++g_runner_counters.reads.calls;
+        if (start)
+            g_runner_counters.reads.time += get_timestamp_ns() - start;
+        if (res < 0) {
+            criterion_perror("Could not read from the event pipe: %s.\n",
+                    strerror(errno));
+            abort();
         }
+        if (!res) {
+            // the pipe may only be closed between two frames
+            if (reader->end)
+                corrupted_pipe();
+            return NULL;
+        }
+        reader->end += read;
     }
 }
 
+bool event_reader_ready(struct event_reader *reader) {
+    size_t size = pending_frame_size(reader);
+    return size && size <= reader->end - reader->begin;
+}
+
+size_t event_reader_buffered(struct event_reader *reader) {
+    return reader->end - reader->begin;
+}
+
+s_pipe_file_handle *event_reader_pipe(struct event_reader *reader) {
+    return reader->pipe;
+}
+
+int event_reader_wait(struct event_reader *reader, int64_t timeout_ns) {
+    if (event_reader_ready(reader))
+        return 1;
+    return pipe_wait_readable(reader->pipe, timeout_ns);
+}
+
+/*
+ * Events of the tests running in a thread pool are kept in a buffer of
+ * their thread until the test is over, and are tagged with the id of the
+ * test rather than the pid of the pool. The frames are stored back to
+ * back, as they would have been sent.
+ */
+struct event_capture {
+    unsigned long long source;
+    unsigned char *buf;
+    size_t size;
+    size_t capacity;
+};
+
+static CR_THREAD_LOCAL struct event_capture g_capture;
+
+void event_capture_begin(unsigned long long source) {
+    g_capture.source = source;
+    g_capture.size = 0;
+}
+
+static void event_capture_push(const unsigned char *frame, size_t size) {
+    size_t needed = g_capture.size + size;
+    if (needed > g_capture.capacity) {
+        size_t capacity = DEF(g_capture.capacity, 4096);
+        while (capacity < needed)
+            capacity *= 2;
+        unsigned char *buf = realloc(g_capture.buf, capacity);
+        ASSERT(buf != NULL);
+        g_capture.buf = buf;
+        g_capture.capacity = capacity;
+    }
+    memcpy(g_capture.buf + g_capture.size, frame, size);
+
+    // only account for the frame once complete, for event_capture_flush
+    g_capture.size = needed;
+}
+
+/*
+ * Writes a frame down the event pipe, one fragment per write to keep them
+ * whole in the shared pipe. Async-signal-safe.
+ */
+static int write_frame(const unsigned char *frame) {
+    struct event_header header;
+    memcpy(&header, frame, sizeof (header));
+    if (sizeof (header) + header.size <= EVENT_ATOMIC_WRITE)
+        return pipe_write(frame, sizeof (header) + header.size, g_event_pipe);
+
+    unsigned char fragment[EVENT_ATOMIC_WRITE];
+    const unsigned char *payload = frame + sizeof (header);
+    size_t left = header.size;
+    while (left) {
+        size_t size = left;
+        if (size > EVENT_ATOMIC_WRITE - sizeof (header))
+            size = EVENT_ATOMIC_WRITE - sizeof (header);
+        left -= size;
+
+        header.size = size;
+        header.flags = left ? EVENT_MORE : 0;
+        memcpy(fragment, &header, sizeof (header));
+        memcpy(fragment + sizeof (header), payload, size);
+        payload += size;
+
+        int res = pipe_write(fragment, sizeof (header) + size, g_event_pipe);
+        if (res != 1)
+            return res;
+    }
+    return 1;
+}
+
+// Async-signal-safe, so that a crashing test can still report its events
+void event_capture_flush(void) {
+    size_t off = 0;
+    while (off < g_capture.size) {
+        struct event_header header;
+        memcpy(&header, g_capture.buf + off, sizeof (header));
+        write_frame(g_capture.buf + off);
+        off += sizeof (header) + header.size;
+    }
+    g_capture.size = 0;
+}
+
+void event_capture_end(void) {
+    g_capture.source = 0;
+    g_capture.size = 0;
+}
+
+static void lock_fragments(void) {
+#if defined(__unix__) || defined(__APPLE__)
+    pthread_mutex_lock(&g_fragments_lock);
+#endif
+}
+
+static void unlock_fragments(void) {
+#if defined(__unix__) || defined(__APPLE__)
+    pthread_mutex_unlock(&g_fragments_lock);
+#endif
+}
+
 void criterion_send_event(int kind, void *data, size_t size) {
-    unsigned long long pid = get_process_id();
+    unsigned long long pid = DEF(g_capture.source, get_process_id());
 
-    unsigned char *buf = malloc(sizeof (int) + sizeof (pid) + size);
-    memcpy(buf, &kind, sizeof (int));
-    memcpy(buf + sizeof (int), &pid, sizeof (pid));
-    memcpy(buf + sizeof (int) + sizeof (pid), data, size);
-    ASSERT(pipe_write(buf, sizeof (int) + sizeof (pid) + size, g_event_pipe) == 1);
+    const char *file = NULL;
+    size_t file_len = 0;
+    size_t extra_size = 0;
+    if (kind == ASSERT) {
+        file = DEF(((struct criterion_assert_stats *) data)->file, "");
+        file_len = strlen(file) + 1;
+        extra_size = sizeof (size_t) + file_len;
+    }
+
+    struct event_header header;
+    event_header_init(&header, kind, pid, size + extra_size);
+
+    size_t frame_size = sizeof (header) + size + extra_size;
+    unsigned char *buf = malloc(frame_size);
+    unsigned char *payload = buf + sizeof (header);
+    memcpy(buf, &header, sizeof (header));
+    memcpy(payload, data, size);
+    if (file) {
+        memcpy(payload + size, &file_len, sizeof (size_t));
+        memcpy(payload + size + sizeof (size_t), file, file_len);
+    }
+
+    if (g_capture.source) {
+        event_capture_push(buf, frame_size);
+    } else if (g_event_sink) {
+        // the event goes through the same decoding as the pipe's
+        struct event *ev;
+        size_t consumed;
+        ASSERT(event_decode(buf, frame_size, &consumed, &ev) == 1);
+        g_event_sink(ev);
+        sfree(ev);
+    } else if (frame_size <= EVENT_ATOMIC_WRITE) {
+        ASSERT(pipe_write(buf, frame_size, g_event_pipe) == 1);
+    } else {
+        lock_fragments();
+        int res = write_frame(buf);
+        unlock_fragments();
+        ASSERT(res == 1);
+    }
 
     free(buf);
 }
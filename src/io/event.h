@@ -25,25 +25,109 @@
 # define EVENT_H_
 
 # include "criterion/event.h"
+# include "criterion/stats.h"
 # include "core/worker.h"
 # include <stdio.h>
+# include <inttypes.h>
+# include <limits.h>
 
 extern s_pipe_file_handle *g_event_pipe;
 
+struct event;
+
+// Receives the events sent by the tests running in the runner itself
+typedef void f_event_sink(struct event *ev);
+extern f_event_sink *g_event_sink;
+
 struct event {
     unsigned long long pid;
     int kind;
     void *data;
+    uint64_t timestamp;
 
     struct worker *worker;
     size_t worker_index;
 };
 
+// Payload of the POST_TEST event
+struct post_test_data {
+    double elapsed_time;
+    struct criterion_perf_counters perf_counters;
+};
+
 enum other_event_kinds {
     WORKER_TERMINATED = 1 << 30,
     TEST_ABORT,
+    BENCH,
+};
+
+/*
+ * Every event goes down the worker pipe as a frame: this header, followed
+ * by size bytes of payload laid out according to the kind. The magic and
+ * version catch a corrupted pipe, or a worker built against another
+ * revision of the protocol, before the payload gets interpreted.
+ */
+# define EVENT_MAGIC 0xC3E7
+# define EVENT_VERSION 1
+
+// Anything bigger is the sign of a corrupted stream
+# define EVENT_MAX_PAYLOAD (64 << 20)
+
+/*
+ * The pipe keeps the writes of up to PIPE_BUF bytes whole, whatever the
+ * other writers do. Larger frames are split into fragments of at most that
+ * size, flagged with EVENT_MORE but the last, which the reader puts back
+ * together by source. The fragments of a source must not interleave.
+ */
+# ifdef PIPE_BUF
+#  define EVENT_ATOMIC_WRITE PIPE_BUF
+# else
+#  define EVENT_ATOMIC_WRITE 512
+# endif
+
+# define EVENT_MORE 1
+
+struct event_header {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t flags;      // EVENT_MORE or zero
+    int32_t kind;
+    uint64_t size;
+    uint64_t pid;
+    uint64_t timestamp;
 };
 
-struct event *read_event(s_pipe_file_handle *f);
+// Async-signal-safe, so that it can be used from the SIGCHLD handler
+void event_header_init(struct event_header *header, int kind,
+                       unsigned long long pid, size_t size);
+
+/*
+ * Decodes the frame at the start of buf. Returns 1 and sets ev and
+ * consumed when a frame was decoded, 0 when buf does not hold a whole
+ * frame yet, and -1 when the frame is invalid. Fragments are invalid here.
+ */
+int event_decode(const void *buf, size_t size, size_t *consumed,
+                 struct event **ev);
+
+/*
+ * Reads the events off the worker pipe, decoding as many frames as were
+ * received by each read. A corrupted stream aborts the process.
+ */
+struct event_reader;
+
+struct event_reader *event_reader_new(s_pipe_file_handle *pipe);
+struct event *event_reader_next(struct event_reader *reader);
+int event_reader_wait(struct event_reader *reader, int64_t timeout_ns);
+
+// Whether a whole frame is buffered, and can be read without blocking
+bool event_reader_ready(struct event_reader *reader);
+
+// Bytes received but not decoded yet
+size_t event_reader_buffered(struct event_reader *reader);
+s_pipe_file_handle *event_reader_pipe(struct event_reader *reader);
+
+void event_capture_begin(unsigned long long source);
+void event_capture_flush(void);
+void event_capture_end(void);
 
 #endif /* !EVENT_H_ */
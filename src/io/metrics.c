@@ -0,0 +1,517 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "criterion/logging.h"
+#include "compat/pipe-internal.h"
+#include "compat/time.h"
+#include "core/report.h"
+#include "core/stats.h"
+#include "string/strbuf.h"
+#include "event.h"
+#include "metrics.h"
+
+#ifdef HAVE_METRICS
+# include <unistd.h>
+# include <fcntl.h>
+# include <poll.h>
+# include <limits.h>
+# include <pthread.h>
+# include <sys/socket.h>
+# include <sys/stat.h>
+# include <sys/un.h>
+# include <sys/resource.h>
+
+# ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL 0
+# endif
+
+# define MAX_CLIENTS 16
+# define MAX_REQUEST 4096
+
+struct metrics_client {
+    int fd;
+    char request[MAX_REQUEST];
+    size_t received;
+    struct strbuf response;
+    size_t sent;
+};
+
+static struct {
+    int fd;
+    char *path;
+    struct criterion_global_stats *stats;
+    struct worker_set *workers;
+    size_t nb_tests;
+    uint64_t start;
+
+    // the rate of events is measured between two scrapes
+    uint64_t last_scrape;
+    size_t last_events;
+    double event_rate;
+
+    struct metrics_client clients[MAX_CLIENTS];
+    size_t nb_clients;
+} g_metrics = { .fd = -1 };
+
+// The workers forked afterwards must not keep the connections open
+static void close_in_child(void) {
+    if (g_metrics.fd < 0)
+        return;
+    close(g_metrics.fd);
+    for (size_t i = 0; i < g_metrics.nb_clients; ++i)
+        close(g_metrics.clients[i].fd);
+    g_metrics.fd = -1;
+    g_metrics.nb_clients = 0;
+}
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return -1;
+    return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+bool metrics_start(const char *path,
+                   struct criterion_global_stats *stats,
+                   struct worker_set *workers,
+                   size_t nb_tests) {
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof (addr.sun_path)) {
+        criterion_perror("The metrics socket path is too long: %s.\n", path);
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+
+    // a socket left behind by a previous run is replaced
+    struct stat st;
+    if (!lstat(path, &st) && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || set_nonblocking(fd) < 0
+            || bind(fd, (struct sockaddr *) &addr, sizeof (addr)) < 0
+            || listen(fd, MAX_CLIENTS) < 0) {
+        criterion_perror("Could not serve the metrics on %s: %s.\n",
+                path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    static bool registered;
+    if (!registered) {
+        pthread_atfork(NULL, NULL, close_in_child);
+        registered = true;
+    }
+
+    g_metrics.fd = fd;
+    g_metrics.path = strdup(path);
+    g_metrics.stats = stats;
+    g_metrics.workers = workers;
+    g_metrics.nb_tests = nb_tests;
+    g_metrics.start = get_timestamp_ns();
+    g_metrics.last_scrape = g_metrics.start;
+    g_metrics.last_events = 0;
+    g_metrics.event_rate = 0;
+    return true;
+}
+
+static void drop_client(size_t i) {
+    struct metrics_client *c = &g_metrics.clients[i];
+    close(c->fd);
+    strbuf_free(&c->response);
+    g_metrics.clients[i] = g_metrics.clients[--g_metrics.nb_clients];
+}
+
+void metrics_stop(void) {
+    if (g_metrics.fd < 0)
+        return;
+    while (g_metrics.nb_clients)
+        drop_client(0);
+    close(g_metrics.fd);
+    unlink(g_metrics.path);
+    free(g_metrics.path);
+    g_metrics.fd = -1;
+}
+
+static uint64_t runner_rss(void) {
+# ifdef __linux__
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        unsigned long size, resident;
+        int res = fscanf(f, "%lu %lu", &size, &resident);
+        fclose(f);
+        if (res == 2)
+            return (uint64_t) resident * sysconf(_SC_PAGESIZE);
+    }
+# endif
+    // the peak is the best approximation left
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru))
+        return 0;
+# ifdef __APPLE__
+    return (uint64_t) ru.ru_maxrss;
+# else
+    return (uint64_t) ru.ru_maxrss * 1024;
+# endif
+}
+
+struct metrics_snapshot {
+    struct criterion_global_stats *stats;
+    size_t done;
+    size_t failed;          // without the crashes, counted apart
+    size_t running;
+    size_t events;
+    double event_rate;
+    size_t hook_queue;
+    size_t event_buffer;
+    uint64_t rss;
+    uint64_t now;
+};
+
+static void take_snapshot(struct metrics_snapshot *s,
+                          struct event_reader *events) {
+    struct criterion_global_stats *stats = g_metrics.stats;
+    *s = (struct metrics_snapshot) {
+        .stats = stats,
+        .done = stats->tests_passed + stats->tests_failed
+            + stats->tests_skipped + stats->tests_cancelled,
+        .failed = stats->tests_failed - stats->tests_crashed,
+        .events = g_runner_counters.events.calls,
+        .hook_queue = report_queue_depth(),
+        .event_buffer = event_reader_buffered(events),
+        .rss = runner_rss(),
+        .now = get_timestamp_ns(),
+    };
+
+    for (size_t i = 0; i < g_metrics.workers->max_workers; ++i) {
+        if (g_metrics.workers->workers[i])
+            ++s->running;
+    }
+
+    // a burst of scrapes keeps the rate of the last meaningful interval
+    uint64_t elapsed = s->now - g_metrics.last_scrape;
+    if (elapsed >= 100000000) {
+        g_metrics.event_rate = (s->events - g_metrics.last_events)
+            / (elapsed / 1e9);
+        g_metrics.last_scrape = s->now;
+        g_metrics.last_events = s->events;
+    }
+    s->event_rate = g_metrics.event_rate;
+}
+
+static void put_label(struct strbuf *buf, const char *name, const char *value) {
+    strbuf_printf(buf, "%s=\"", name);
+    for (const char *c = value; *c; ++c) {
+        switch (*c) {
+            case '\\': strbuf_puts(buf, "\\\\"); break;
+            case '"':  strbuf_puts(buf, "\\\""); break;
+            case '\n': strbuf_puts(buf, "\\n"); break;
+            default:   strbuf_putc(buf, *c); break;
+        }
+    }
+    strbuf_putc(buf, '"');
+}
+
+static void put_metric(struct strbuf *buf, const char *name,
+                       const char *type, const char *help) {
+    strbuf_printf(buf, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void render_prometheus(struct strbuf *buf, struct metrics_snapshot *s) {
+    struct criterion_global_stats *st = s->stats;
+
+    put_metric(buf, "criterion_tests", "gauge", "Tests selected for the run.");
+    strbuf_printf(buf, "criterion_tests %zu\n", g_metrics.nb_tests);
+
+    put_metric(buf, "criterion_tests_done", "gauge",
+            "Tests done, by outcome.");
+    strbuf_printf(buf,
+            "criterion_tests_done{status=\"passed\"} %zu\n"
+            "criterion_tests_done{status=\"failed\"} %zu\n"
+            "criterion_tests_done{status=\"crashed\"} %zu\n"
+            "criterion_tests_done{status=\"skipped\"} %zu\n"
+            "criterion_tests_done{status=\"cancelled\"} %zu\n",
+            st->tests_passed, s->failed, st->tests_crashed,
+            st->tests_skipped, st->tests_cancelled);
+
+    put_metric(buf, "criterion_tests_running", "gauge",
+            "Tests currently running in a worker.");
+    strbuf_printf(buf, "criterion_tests_running %zu\n", s->running);
+
+    put_metric(buf, "criterion_asserts", "gauge", "Assertions, by result.");
+    strbuf_printf(buf,
+            "criterion_asserts{result=\"passed\"} %zu\n"
+            "criterion_asserts{result=\"failed\"} %zu\n",
+            st->asserts_passed, st->asserts_failed);
+
+    put_metric(buf, "criterion_events", "counter",
+            "Worker events handled by the runner.");
+    strbuf_printf(buf, "criterion_events %zu\n", s->events);
+
+    put_metric(buf, "criterion_events_per_second", "gauge",
+            "Worker events handled per second since the previous scrape.");
+    strbuf_printf(buf, "criterion_events_per_second %.3f\n", s->event_rate);
+
+    put_metric(buf, "criterion_hook_queue_depth", "gauge",
+            "Events waiting for the report hooks with --async-hooks.");
+    strbuf_printf(buf, "criterion_hook_queue_depth %zu\n", s->hook_queue);
+
+    put_metric(buf, "criterion_event_buffer_bytes", "gauge",
+            "Bytes received from the workers but not handled yet.");
+    strbuf_printf(buf, "criterion_event_buffer_bytes %zu\n", s->event_buffer);
+
+    put_metric(buf, "criterion_runner_rss_bytes", "gauge",
+            "Resident set size of the runner.");
+    strbuf_printf(buf, "criterion_runner_rss_bytes %" PRIu64 "\n", s->rss);
+
+    put_metric(buf, "criterion_uptime_seconds", "gauge",
+            "Time since the tests started.");
+    strbuf_printf(buf, "criterion_uptime_seconds %.3f\n",
+            (s->now - g_metrics.start) / 1e9);
+
+    put_metric(buf, "criterion_worker_elapsed_seconds", "gauge",
+            "Time since the worker of each running test was started.");
+    for (size_t i = 0; i < g_metrics.workers->max_workers; ++i) {
+        struct worker *w = g_metrics.workers->workers[i];
+        if (!w)
+            continue;
+        uint64_t spawn = w->ctx.test_stats->timestamps.spawn;
+        strbuf_printf(buf, "criterion_worker_elapsed_seconds{slot=\"%zu\",", i);
+        put_label(buf, "suite", w->ctx.suite->name);
+        strbuf_putc(buf, ',');
+        put_label(buf, "test", w->ctx.test->name);
+        strbuf_printf(buf, "} %.3f\n", spawn ? (s->now - spawn) / 1e9 : 0.);
+    }
+}
+
+static void render_json(struct strbuf *buf, struct metrics_snapshot *s) {
+    struct criterion_global_stats *st = s->stats;
+    strbuf_printf(buf,
+            "{\"tests\":{\"total\":%zu,\"done\":%zu,\"running\":%zu"
+            ",\"passed\":%zu,\"failed\":%zu,\"crashed\":%zu"
+            ",\"skipped\":%zu,\"cancelled\":%zu}"
+            ",\"asserts\":{\"passed\":%zu,\"failed\":%zu}"
+            ",\"events\":{\"total\":%zu,\"per_second\":%.3f}"
+            ",\"hook_queue_depth\":%zu"
+            ",\"event_buffer_bytes\":%zu"
+            ",\"runner_rss\":%" PRIu64
+            ",\"uptime\":%.3f"
+            ",\"workers\":[",
+            g_metrics.nb_tests, s->done, s->running,
+            st->tests_passed, s->failed, st->tests_crashed,
+            st->tests_skipped, st->tests_cancelled,
+            st->asserts_passed, st->asserts_failed,
+            s->events, s->event_rate,
+            s->hook_queue,
+            s->event_buffer,
+            s->rss,
+            (s->now - g_metrics.start) / 1e9);
+
+    bool first = true;
+    for (size_t i = 0; i < g_metrics.workers->max_workers; ++i) {
+        struct worker *w = g_metrics.workers->workers[i];
+        if (!w)
+            continue;
+        uint64_t spawn = w->ctx.test_stats->timestamps.spawn;
+        strbuf_printf(buf, "%s{\"slot\":%zu,\"id\":%llu,\"suite\":",
+                first ? "" : ",", i, w->id);
+        strbuf_put_json_string(buf, w->ctx.suite->name);
+        strbuf_puts(buf, ",\"test\":");
+        strbuf_put_json_string(buf, w->ctx.test->name);
+        strbuf_printf(buf, ",\"elapsed\":%.3f}",
+                spawn ? (s->now - spawn) / 1e9 : 0.);
+        first = false;
+    }
+    strbuf_puts(buf, "]}\n");
+}
+
+static void respond(struct metrics_client *c, struct event_reader *events) {
+    char method[8], target[256];
+    c->request[c->received] = '\0';
+    bool valid = sscanf(c->request, "%7s %255s", method, target) == 2
+        && !strcmp(method, "GET");
+
+    // the query string is not used
+    char *query = valid ? strchr(target, '?') : NULL;
+    if (query)
+        *query = '\0';
+
+    struct strbuf body = STRBUF_INIT;
+    const char *status = "200 OK";
+    const char *type = "text/plain";
+    if (!valid) {
+        status = "400 Bad Request";
+        strbuf_puts(&body, "Bad request\n");
+    } else if (!strcmp(target, "/metrics") || !strcmp(target, "/")) {
+        struct metrics_snapshot s;
+        take_snapshot(&s, events);
+        render_prometheus(&body, &s);
+        type = "text/plain; version=0.0.4";
+    } else if (!strcmp(target, "/metrics.json")) {
+        struct metrics_snapshot s;
+        take_snapshot(&s, events);
+        render_json(&body, &s);
+        type = "application/json";
+    } else {
+        status = "404 Not Found";
+        strbuf_puts(&body, "Not found\n");
+    }
+
+    strbuf_printf(&c->response,
+            "HTTP/1.0 %s\r\n"
+            "Content-Type: %s\r\n"
+            "Content-Length: %zu\r\n"
+            "Connection: close\r\n\r\n",
+            status, type, body.size);
+    strbuf_append(&c->response, body.str, body.size);
+    strbuf_free(&body);
+}
+
+// Returns false once the client is done with
+static bool serve_client(struct metrics_client *c, short revents,
+                         struct event_reader *events) {
+    if (revents & (POLLERR | POLLNVAL))
+        return false;
+
+    if (!c->response.size) {
+        ssize_t res = recv(c->fd, c->request + c->received,
+                MAX_REQUEST - 1 - c->received, 0);
+        if (res < 0)
+            return errno == EAGAIN || errno == EINTR;
+        if (res == 0)
+            return false;
+        c->received += res;
+        c->request[c->received] = '\0';
+
+        // the headers are not used, but the whole request is waited for
+        if (!strstr(c->request, "\r\n\r\n") && !strstr(c->request, "\n\n")
+                && c->received < MAX_REQUEST - 1)
+            return true;
+        respond(c, events);
+    }
+
+    ssize_t res = send(c->fd, c->response.str + c->sent,
+            c->response.size - c->sent, MSG_NOSIGNAL);
+    if (res < 0)
+        return errno == EAGAIN || errno == EINTR;
+    c->sent += res;
+    return c->sent < c->response.size;
+}
+
+static void accept_clients(void) {
+    for (;;) {
+        int fd = accept(g_metrics.fd, NULL, NULL);
+        if (fd < 0)
+            return;
+        if (g_metrics.nb_clients == MAX_CLIENTS || set_nonblocking(fd) < 0) {
+            close(fd);
+            continue;
+        }
+        g_metrics.clients[g_metrics.nb_clients++] = (struct metrics_client) {
+            .fd = fd,
+            .response = STRBUF_INIT,
+        };
+    }
+}
+
+int metrics_wait(struct event_reader *events, const int *fds, size_t nb_fds,
+                 bool *fds_ready, int64_t timeout_ns) {
+    *fds_ready = false;
+    if (g_metrics.fd < 0 && !nb_fds)
+        return event_reader_wait(events, timeout_ns);
+    if (event_reader_ready(events))
+        return 1;
+
+    int timeout_ms = -1;
+    if (timeout_ns >= 0) {
+        int64_t ms = (timeout_ns + 999999) / 1000000;
+        timeout_ms = ms > INT_MAX ? INT_MAX : (int) ms;
+    }
+
+    // the event pipe, then the listening socket, the clients and the fds
+    // of the caller
+    size_t nb_clients = g_metrics.fd < 0 ? 0 : g_metrics.nb_clients;
+    struct pollfd pfds[2 + MAX_CLIENTS + nb_fds];
+    pfds[0] = (struct pollfd) {
+        .fd = event_reader_pipe(events)->fd,
+        .events = POLLIN,
+    };
+    pfds[1] = (struct pollfd) { .fd = g_metrics.fd, .events = POLLIN };
+    for (size_t i = 0; i < nb_clients; ++i) {
+        struct metrics_client *c = &g_metrics.clients[i];
+        pfds[2 + i] = (struct pollfd) {
+            .fd = c->fd,
+            .events = c->response.size ? POLLOUT : POLLIN,
+        };
+    }
+    struct pollfd *extra = pfds + 2 + nb_clients;
+    for (size_t i = 0; i < nb_fds; ++i)
+        extra[i] = (struct pollfd) { .fd = fds[i], .events = POLLIN };
+
+    int res = poll(pfds, 2 + nb_clients + nb_fds, timeout_ms);
+    if (res == -1)
+        return errno == EINTR ? 0 : -1;
+
+    for (size_t i = 0; i < nb_fds; ++i)
+        *fds_ready |= extra[i].revents != 0;
+
+    // backwards, as the clients that are done are swapped with the last one
+    for (size_t i = nb_clients; i-- > 0;) {
+        if (pfds[2 + i].revents
+                && !serve_client(&g_metrics.clients[i], pfds[2 + i].revents,
+                    events))
+            drop_client(i);
+    }
+    if (pfds[1].revents & POLLIN)
+        accept_clients();
+
+    // only the metrics were served: the caller waits again
+    return pfds[0].revents ? 1 : 0;
+}
+#else
+bool metrics_start(const char *path,
+                   CR_UNUSED struct criterion_global_stats *stats,
+                   CR_UNUSED struct worker_set *workers,
+                   CR_UNUSED size_t nb_tests) {
+    criterion_perror("Could not serve the metrics on %s: "
+            "not supported on this platform.\n", path);
+    return false;
+}
+
+void metrics_stop(void) {}
+
+int metrics_wait(struct event_reader *events, CR_UNUSED const int *fds,
+                 CR_UNUSED size_t nb_fds, bool *fds_ready,
+                 int64_t timeout_ns) {
+    *fds_ready = false;
+    return event_reader_wait(events, timeout_ns);
+}
+#endif
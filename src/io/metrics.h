@@ -0,0 +1,55 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef METRICS_H_
+# define METRICS_H_
+
+# include <stdbool.h>
+# include <stdint.h>
+# include "criterion/stats.h"
+# include "core/worker.h"
+
+# if defined(__unix__) || defined(__APPLE__)
+#  define HAVE_METRICS 1
+# endif
+
+/*
+ * Serves the progress of the run on a local socket, as Prometheus text on
+ * /metrics and as JSON on /metrics.json. The requests are handled by the
+ * event loop of the runner, while it waits for the next event.
+ */
+bool metrics_start(const char *path,
+                   struct criterion_global_stats *stats,
+                   struct worker_set *workers,
+                   size_t nb_tests);
+void metrics_stop(void);
+
+/*
+ * Waits for the event pipe like event_reader_wait, serving the metrics.
+ * The given fds are watched along, and fds_ready is set when one of them
+ * is readable.
+ */
+int metrics_wait(struct event_reader *events, const int *fds, size_t nb_fds,
+                 bool *fds_ready, int64_t timeout_ns);
+
+#endif /* !METRICS_H_ */
@@ -0,0 +1,216 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "criterion/logging.h"
+#include "criterion/options.h"
+#include "compat/posix.h"
+#include "output.h"
+
+#ifdef VANILLA_WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+
+struct output_provider_entry {
+    const char *name;
+    struct criterion_output_provider *provider;
+    struct output_provider_entry *next;
+};
+
+static struct output_provider_entry builtin_providers[] = {
+    { "normal", &normal_logging, &builtin_providers[1] },
+    { "tap",    &tap_logging,    &builtin_providers[2] },
+    { "xml",    &xml_logging,    &builtin_providers[3] },
+    { "json",   &json_logging,   &builtin_providers[4] },
+    { "binary", &binary_logging, NULL },
+};
+
+static struct output_provider_entry *providers = builtin_providers;
+
+// Outputs added through criterion_add_output, in insertion order
+static struct criterion_output *extra_outputs;
+
+// The outputs of the current run, starting with the default provider
+struct criterion_output *g_outputs;
+
+static struct criterion_output default_output;
+static struct criterion_output *current_output;
+
+static struct criterion_output_provider *find_provider(const char *name) {
+    for (struct output_provider_entry *p = providers; p; p = p->next)
+        if (!strcmp(p->name, name))
+            return p->provider;
+    return NULL;
+}
+
+int criterion_register_output_provider(const char *name,
+        struct criterion_output_provider *provider) {
+
+    if (find_provider(name))
+        return 0;
+
+    struct output_provider_entry *entry = malloc(sizeof (*entry));
+    *entry = (struct output_provider_entry) {
+        .name = name,
+        .provider = provider,
+        .next = providers,
+    };
+    providers = entry;
+    return 1;
+}
+
+static bool is_stderr_path(const char *path) {
+    return !path || !*path || !strcmp(path, "-") || !strcmp(path, "fd:2");
+}
+
+static bool same_destination(const char *a, const char *b) {
+    if (is_stderr_path(a) || is_stderr_path(b))
+        return is_stderr_path(a) && is_stderr_path(b);
+    return !strcmp(a, b);
+}
+
+static FILE *open_destination(const char *path) {
+    if (is_stderr_path(path))
+        return stderr;
+
+    if (!strncmp(path, "fd:", 3)) {
+        char *end;
+        long fd = strtol(path + 3, &end, 10);
+        if (*end || end == path + 3 || fd < 0 || fd > INT_MAX) {
+            errno = EBADF;
+            return NULL;
+        }
+
+        // the descriptor still belongs to the caller, and outlives the output
+#ifdef VANILLA_WIN32
+        int copy = _dup((int) fd);
+        FILE *stream = copy == -1 ? NULL : _fdopen(copy, "w");
+        if (!stream && copy != -1)
+            _close(copy);
+#else
+        int copy = dup((int) fd);
+        FILE *stream = copy == -1 ? NULL : fdopen(copy, "w");
+        if (!stream && copy != -1)
+            close(copy);
+#endif
+        return stream;
+    }
+
+    return fopen(path, "w");
+}
+
+int criterion_add_output(const char *name, const char *path) {
+    struct criterion_output_provider *provider = find_provider(name);
+    if (!provider) {
+        criterion_perror("Unknown output provider: %s.\n", name);
+        return 0;
+    }
+
+    struct criterion_output **last = &extra_outputs;
+    for (struct criterion_output *o = extra_outputs; o; o = o->next) {
+        if (o->provider == provider && same_destination(o->path, path))
+            return 1;
+        last = &o->next;
+    }
+
+    FILE *stream = open_destination(path);
+    if (!stream) {
+        criterion_perror("Could not open %s for the %s output: %s.\n",
+                path, name, strerror(errno));
+        return 0;
+    }
+
+    struct criterion_output *output = malloc(sizeof (*output));
+    *output = (struct criterion_output) {
+        .provider = provider,
+        .stream = stream,
+        .path = is_stderr_path(path) ? NULL : strdup(path),
+    };
+    *last = output;
+    return 1;
+}
+
+void init_outputs(void) {
+    struct criterion_output *first = extra_outputs;
+
+    if (criterion_options.output_provider) {
+        // drop the explicit outputs duplicating the default one
+        struct criterion_output **prev = &extra_outputs;
+        for (struct criterion_output *o = extra_outputs; o; o = *prev) {
+            if (o->provider == criterion_options.output_provider && !o->path) {
+                *prev = o->next;
+                free(o);
+            } else {
+                prev = &o->next;
+            }
+        }
+
+        default_output = (struct criterion_output) {
+            .provider = criterion_options.output_provider,
+            .stream = stderr,
+            .next = extra_outputs,
+        };
+        first = &default_output;
+    }
+
+    g_outputs = first;
+}
+
+void flush_outputs(void) {
+    for (struct criterion_output *o = g_outputs; o; o = o->next)
+        fflush(o->stream);
+}
+
+void close_outputs(void) {
+    for (struct criterion_output *o = extra_outputs, *next; o; o = next) {
+        next = o->next;
+        if (o->stream != stderr)
+            fclose(o->stream);
+        free((char *) o->path);
+        free(o);
+    }
+    extra_outputs = NULL;
+    g_outputs = NULL;
+}
+
+FILE *get_output_stream(void) {
+    return current_output ? current_output->stream : stderr;
+}
+
+void set_current_output(struct criterion_output *output) {
+    current_output = output;
+}
+
+bool output_test_reported(struct criterion_test_stats *stats) {
+    if (!current_output)
+        return false;
+    if (current_output->last_reported == stats)
+        return true;
+    current_output->last_reported = stats;
+    return false;
+}
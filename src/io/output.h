@@ -0,0 +1,55 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef OUTPUT_H_
+# define OUTPUT_H_
+
+# include <stdbool.h>
+# include <stdio.h>
+# include "criterion/output.h"
+
+struct criterion_output {
+    struct criterion_output_provider *provider;
+    FILE *stream;
+    const char *path;
+
+    // The last test this output wrote a record for
+    struct criterion_test_stats *last_reported;
+    struct criterion_output *next;
+};
+
+extern struct criterion_output *g_outputs;
+
+void init_outputs(void);
+void flush_outputs(void);
+void close_outputs(void);
+
+// Stream the output providers are currently writing to
+FILE *get_output_stream(void);
+void set_current_output(struct criterion_output *output);
+
+// Whether the current output already wrote a record for this test,
+// which is then remembered for the next call
+bool output_test_reported(struct criterion_test_stats *stats);
+
+#endif /* !OUTPUT_H_ */
@@ -0,0 +1,306 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "criterion/logging.h"
+#include "criterion/options.h"
+#include "compat/time.h"
+#include "core/report.h"
+#include "string/strbuf.h"
+#include "event.h"
+#include "trace.h"
+
+#ifndef _WIN32
+# include <pthread.h>
+#endif
+
+// The records are written out by chunks of that size
+#define TRACE_FLUSH_SIZE (64 << 10)
+
+bool g_trace_enabled;
+
+static struct {
+    FILE *file;
+    struct strbuf buf;
+    bool *named;        // worker slots whose track got a name
+    size_t nb_named;
+    size_t counters[TRACE_NB_COUNTERS];
+#ifdef HAVE_ASYNC_HOOKS
+    pthread_mutex_t lock;
+#endif
+} g_trace = {
+#ifdef HAVE_ASYNC_HOOKS
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+};
+
+static const char *counter_names[] = {
+    [TRACE_ACTIVE_WORKERS] = "active workers",
+    [TRACE_PENDING_BYTES]  = "pending event bytes",
+    [TRACE_HOOK_QUEUE]     = "queued hook events",
+};
+
+const char *trace_event_name(int kind) {
+    static const char *names[] = {
+        [PRE_ALL]       = "PRE_ALL",
+        [PRE_SUITE]     = "PRE_SUITE",
+        [PRE_INIT]      = "PRE_INIT",
+        [PRE_TEST]      = "PRE_TEST",
+        [ASSERT]        = "ASSERT",
+        [THEORY_FAIL]   = "THEORY_FAIL",
+        [TEST_CRASH]    = "TEST_CRASH",
+        [POST_TEST]     = "POST_TEST",
+        [POST_FINI]     = "POST_FINI",
+        [POST_SUITE]    = "POST_SUITE",
+        [POST_ALL]      = "POST_ALL",
+    };
+    switch (kind) {
+        case WORKER_TERMINATED: return "WORKER_TERMINATED";
+        case TEST_ABORT:        return "TEST_ABORT";
+        case BENCH:             return "BENCH";
+        default:
+            if (kind >= 0 && kind <= POST_ALL)
+                return names[kind];
+            return "UNKNOWN";
+    }
+}
+
+static void lock(void) {
+#ifdef HAVE_ASYNC_HOOKS
+    pthread_mutex_lock(&g_trace.lock);
+#endif
+}
+
+static void unlock(void) {
+#ifdef HAVE_ASYNC_HOOKS
+    pthread_mutex_unlock(&g_trace.lock);
+#endif
+}
+
+/*
+ * The records are buffered here rather than in the stream, which is
+ * flushed right away: a worker forked in between must not inherit
+ * anything it could write a second time.
+ */
+static void flush_records(void) {
+    if (!g_trace.buf.size)
+        return;
+    fwrite(g_trace.buf.str, 1, g_trace.buf.size, g_trace.file);
+    fflush(g_trace.file);
+    strbuf_clear(&g_trace.buf);
+}
+
+static void end_record(void) {
+    strbuf_puts(&g_trace.buf, "},\n");
+    if (g_trace.buf.size >= TRACE_FLUSH_SIZE)
+        flush_records();
+}
+
+static void put_timestamp(const char *field, uint64_t ns) {
+    // microseconds, as the format wants, down to the nanosecond
+    strbuf_printf(&g_trace.buf, ",\"%s\":%" PRIu64 ".%03u", field,
+            ns / 1000, (unsigned) (ns % 1000));
+}
+
+static void name_track(unsigned track, const char *name) {
+    strbuf_printf(&g_trace.buf, "{\"ph\":\"M\",\"pid\":1,\"tid\":%u"
+            ",\"name\":\"thread_name\",\"args\":{\"name\":", track);
+    strbuf_put_json_string(&g_trace.buf, name);
+    strbuf_printf(&g_trace.buf, "}},\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u"
+            ",\"name\":\"thread_sort_index\",\"args\":{\"sort_index\":%u}",
+            track, track);
+    end_record();
+}
+
+#ifndef _WIN32
+// The workers have nothing to trace
+static void disable_in_child(void) {
+    g_trace_enabled = false;
+    g_trace.file = NULL;
+    g_trace.buf = (struct strbuf) STRBUF_INIT;
+}
+#endif
+
+bool trace_open(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        criterion_perror("Could not open the trace file %s: %s.\n",
+                path, strerror(errno));
+        return false;
+    }
+
+#ifndef _WIN32
+    static bool registered;
+    if (!registered) {
+        pthread_atfork(NULL, NULL, disable_in_child);
+        registered = true;
+    }
+#endif
+
+    g_trace.file = f;
+    memset(g_trace.counters, 0, sizeof (g_trace.counters));
+
+    // the closing bracket is optional: a trace cut short still loads
+    strbuf_puts(&g_trace.buf, "[\n{\"ph\":\"M\",\"pid\":1"
+            ",\"name\":\"process_name\",\"args\":{\"name\":\"criterion\"}");
+    end_record();
+    name_track(TRACE_RUNNER, "runner");
+#ifdef HAVE_ASYNC_HOOKS
+    if (criterion_options.async_hooks)
+        name_track(TRACE_HOOKS, "report hooks");
+#endif
+
+    g_trace_enabled = true;
+    return true;
+}
+
+void trace_close(void) {
+    if (!g_trace_enabled)
+        return;
+
+    lock();
+    g_trace_enabled = false;
+
+    // the last record needs no trailing comma
+    if (g_trace.buf.size >= 2)
+        g_trace.buf.size -= 2;
+    else
+        fseek(g_trace.file, -2, SEEK_END);
+    strbuf_puts(&g_trace.buf, "\n]\n");
+    flush_records();
+    fclose(g_trace.file);
+    g_trace.file = NULL;
+    strbuf_free(&g_trace.buf);
+
+    free(g_trace.named);
+    g_trace.named = NULL;
+    g_trace.nb_named = 0;
+    unlock();
+}
+
+static void put_span(unsigned track, const char *name,
+                     uint64_t start, uint64_t end) {
+    strbuf_printf(&g_trace.buf, "{\"ph\":\"X\",\"pid\":1,\"tid\":%u"
+            ",\"name\":", track);
+    strbuf_put_json_string(&g_trace.buf, name);
+    put_timestamp("ts", start);
+    put_timestamp("dur", end > start ? end - start : 0);
+}
+
+void trace_span(unsigned track, const char *name,
+                uint64_t start, uint64_t end) {
+    if (!g_trace_enabled || !start)
+        return;
+    lock();
+    put_span(track, name, start, end);
+    end_record();
+    unlock();
+}
+
+void trace_counter(enum trace_counter counter, size_t value) {
+    if (!g_trace_enabled || g_trace.counters[counter] == value)
+        return;
+
+    uint64_t now = get_timestamp_ns();
+    if (!now)
+        return;
+
+    lock();
+    g_trace.counters[counter] = value;
+    strbuf_puts(&g_trace.buf, "{\"ph\":\"C\",\"pid\":1,\"name\":");
+    strbuf_put_json_string(&g_trace.buf, counter_names[counter]);
+    put_timestamp("ts", now);
+    strbuf_printf(&g_trace.buf, ",\"args\":{\"value\":%zu}", value);
+    end_record();
+    unlock();
+}
+
+static const char *test_status(struct criterion_test_stats *stats) {
+    if (stats->cancelled)
+        return "cancelled";
+    if (stats->timed_out)
+        return "timed out";
+    if (stats->crashed)
+        return "crashed";
+    return stats->failed ? "failed" : "passed";
+}
+
+static void put_phase(unsigned track, const char *name,
+                      uint64_t start, uint64_t end) {
+    if (!start || !end)
+        return;
+    put_span(track, name, start, end);
+    end_record();
+}
+
+void trace_test(size_t slot, struct criterion_test_stats *stats) {
+    struct criterion_test_timestamps *ts = &stats->timestamps;
+    if (!g_trace_enabled || !ts->spawn)
+        return;
+
+    unsigned track = TRACE_WORKERS + slot;
+    lock();
+    if (slot >= g_trace.nb_named) {
+        size_t nb = slot + 1;
+        g_trace.named = realloc(g_trace.named, nb * sizeof (bool));
+        memset(g_trace.named + g_trace.nb_named, 0,
+                (nb - g_trace.nb_named) * sizeof (bool));
+        g_trace.nb_named = nb;
+    }
+    if (!g_trace.named[slot]) {
+        char name[32];
+        snprintf(name, sizeof (name), "worker %zu", slot);
+        name_track(track, name);
+        g_trace.named[slot] = true;
+    }
+
+    struct criterion_test *test = stats->test;
+    size_t size = strlen(test->category) + strlen(test->name) + 3;
+    char *name = malloc(size);
+    snprintf(name, size, "%s::%s", test->category, test->name);
+
+    uint64_t end = ts->reap ? ts->reap : ts->exit;
+    put_span(track, name, ts->spawn, end);
+    strbuf_puts(&g_trace.buf, ",\"args\":{\"status\":");
+    strbuf_put_json_string(&g_trace.buf, test_status(stats));
+    strbuf_printf(&g_trace.buf, ",\"asserts\":%d}",
+            stats->passed_asserts + stats->failed_asserts);
+    end_record();
+    free(name);
+
+    // the phases that were not reached are left out
+    uint64_t startup_end = ts->pre_init ? ts->pre_init : ts->exit;
+    uint64_t init_end = ts->pre_test ? ts->pre_test : ts->exit;
+    uint64_t test_end = ts->post_test ? ts->post_test : ts->exit;
+    put_phase(track, "startup", ts->spawn, startup_end);
+    put_phase(track, "init", ts->pre_init, init_end);
+    put_phase(track, "test", ts->pre_test, test_end);
+    put_phase(track, "fini", ts->post_test, ts->post_fini);
+    put_phase(track, "exit", ts->post_fini, ts->exit);
+    put_phase(track, "reap", ts->exit, ts->reap);
+    unlock();
+}
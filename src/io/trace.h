@@ -0,0 +1,65 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef TRACE_H_
+# define TRACE_H_
+
+# include <stdbool.h>
+# include <stddef.h>
+# include <stdint.h>
+# include "criterion/stats.h"
+
+/*
+ * Writes the timeline of the run as Chrome trace events, which Perfetto
+ * and chrome://tracing can load. The runner, the report hooks and each
+ * worker slot get a track of their own; all the timestamps are the
+ * monotonic ones stamped by the process where the event happened.
+ */
+enum trace_track {
+    TRACE_RUNNER,
+    TRACE_HOOKS,
+    TRACE_WORKERS,  // the worker slots follow
+};
+
+enum trace_counter {
+    TRACE_ACTIVE_WORKERS,
+    TRACE_PENDING_BYTES,
+    TRACE_HOOK_QUEUE,
+    TRACE_NB_COUNTERS,
+};
+
+extern bool g_trace_enabled;
+
+bool trace_open(const char *path);
+void trace_close(void);
+
+void trace_span(unsigned track, const char *name,
+                uint64_t start, uint64_t end);
+void trace_counter(enum trace_counter counter, size_t value);
+
+// The phases of a test that is over, on the track of its worker slot
+void trace_test(size_t slot, struct criterion_test_stats *stats);
+
+const char *trace_event_name(int kind);
+
+#endif /* !TRACE_H_ */
@@ -0,0 +1,420 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "criterion/stats.h"
+#include "criterion/logging.h"
+#include "criterion/options.h"
+#include "criterion/ordered-set.h"
+#include "compat/posix.h"
+#include "compat/time.h"
+#include "string/strbuf.h"
+#include "io/output.h"
+#include "config.h"
+#include "common.h"
+
+/*
+ * Every record is laid out as a little-endian u32 payload length, followed
+ * by the payload: a u8 record type and a sequence of (u8 tag, u32 length,
+ * value) fields. Integers are encoded as little-endian u64 values.
+ * Readers must skip tags they do not know about.
+ */
+
+#define BINARY_FORMAT_VERSION 1
+
+enum binary_record {
+    RECORD_START    = 1,
+    RECORD_TEST     = 2,
+    RECORD_SUMMARY  = 3,
+};
+
+enum binary_tag {
+    // start record
+    TAG_FORMAT_VERSION  = 1,
+    TAG_VERSION         = 2,
+    TAG_TESTS           = 3,
+
+    // test record
+    TAG_SUITE           = 16,
+    TAG_NAME            = 17,
+    TAG_STATUS          = 18,
+    TAG_DESCRIPTION     = 19,
+    TAG_ELAPSED_NS      = 20,
+    TAG_ASSERTS_PASSED  = 21,
+    TAG_ASSERTS_FAILED  = 22,
+    TAG_SIGNAL          = 23,
+    TAG_EXIT_CODE       = 24,
+    TAG_FAILURE         = 25,
+    TAG_FILE            = 26,
+    TAG_LINE            = 27,
+    TAG_MESSAGE         = 28,
+    TAG_STARTUP_NS      = 29,
+    TAG_INIT_NS         = 30,
+    TAG_TEST_NS         = 31,
+    TAG_FINI_NS         = 32,
+    TAG_EXIT_NS         = 33,
+    TAG_REAP_NS         = 34,
+    TAG_USER_TIME_NS    = 35,
+    TAG_SYSTEM_TIME_NS  = 36,
+    TAG_MAX_RSS         = 37,
+    TAG_MINOR_FAULTS    = 38,
+    TAG_MAJOR_FAULTS    = 39,
+    TAG_VOL_SWITCHES    = 40,
+    TAG_INVOL_SWITCHES  = 41,
+    TAG_READ_BYTES      = 42,
+    TAG_WRITE_BYTES     = 43,
+
+    // summary record
+    TAG_NB_SUITES       = 48,
+    TAG_NB_TESTS        = 49,
+    TAG_PASSED          = 50,
+    TAG_FAILED          = 51,
+    TAG_CRASHED         = 52,
+    TAG_SKIPPED         = 53,
+    TAG_WALL_TIME_NS    = 54,
+
+    // test record, continued
+    TAG_CYCLES          = 55,
+    TAG_INSTRUCTIONS    = 56,
+    TAG_CACHE_REFS      = 57,
+    TAG_CACHE_MISSES    = 58,
+    TAG_BRANCHES        = 59,
+    TAG_BRANCH_MISSES   = 60,
+    TAG_BENCH           = 61,
+
+    // bench field
+    TAG_BENCH_SAMPLES   = 62,
+    TAG_BENCH_ITERS     = 63,
+    TAG_BENCH_MEDIAN_PS = 64,
+    TAG_BENCH_MAD_PS    = 65,
+    TAG_BENCH_MIN_PS    = 66,
+    TAG_BENCH_MAX_PS    = 67,
+    TAG_BENCH_CI_LO_PS  = 68,
+    TAG_BENCH_CI_HI_PS  = 69,
+    TAG_BENCH_UNIT      = 70,
+    TAG_BENCH_AMOUNT    = 71,
+    TAG_BASE_CHANGE_PPM = 72,
+    TAG_BASE_CI_LO_PPM  = 73,
+    TAG_BASE_CI_HI_PPM  = 74,
+    TAG_BASE_P_PPM      = 75,
+    TAG_BASE_REGRESSED  = 76,
+
+    // summary record, continued
+    TAG_CANCELLED       = 77,
+
+    // test record, continued
+    TAG_MEMORY_PEAK     = 78,
+    TAG_THROTTLED_NS    = 79,
+
+    // summary record, continued
+    TAG_HOOK_CALLS      = 80,
+    TAG_HOOK_TIME_NS    = 81,
+    TAG_HOOK_WAITS      = 82,
+    TAG_HOOK_WAIT_NS    = 83,
+    TAG_EVENTS          = 84,
+    TAG_EVENT_TIME_NS   = 85,
+    TAG_SPAWNS          = 86,
+    TAG_SPAWN_TIME_NS   = 87,
+    TAG_READS           = 88,
+    TAG_READ_TIME_NS    = 89,
+    TAG_STAT_PUSHES     = 90,
+    TAG_STAT_TIME_NS    = 91,
+    TAG_LOGS            = 92,
+    TAG_LOG_TIME_NS     = 93,
+};
+
+enum binary_status {
+    STATUS_PASSED       = 0,
+    STATUS_FAILED       = 1,
+    STATUS_CRASHED      = 2,
+    STATUS_TIMED_OUT    = 3,
+    STATUS_SKIPPED      = 4,
+    STATUS_CANCELLED    = 5,
+    STATUS_OOM_KILLED   = 6,
+};
+
+static struct strbuf record = STRBUF_INIT;
+static struct strbuf nested = STRBUF_INIT;
+
+static INLINE bool is_disabled(struct criterion_test *t, struct criterion_suite *s) {
+    return t->data->disabled || (s->data && s->data->disabled);
+}
+
+static void put_u32(struct strbuf *buf, uint32_t val) {
+    unsigned char bytes[4];
+    for (size_t i = 0; i < sizeof (bytes); ++i)
+        bytes[i] = (val >> (8 * i)) & 0xff;
+    strbuf_append(buf, bytes, sizeof (bytes));
+}
+
+static void put_u64(struct strbuf *buf, uint64_t val) {
+    unsigned char bytes[8];
+    for (size_t i = 0; i < sizeof (bytes); ++i)
+        bytes[i] = (val >> (8 * i)) & 0xff;
+    strbuf_append(buf, bytes, sizeof (bytes));
+}
+
+static void put_field(struct strbuf *buf, enum binary_tag tag,
+        const void *data, size_t size) {
+    strbuf_putc(buf, (char) tag);
+    put_u32(buf, (uint32_t) size);
+    strbuf_append(buf, data, size);
+}
+
+static void put_uint(struct strbuf *buf, enum binary_tag tag, uint64_t val) {
+    strbuf_putc(buf, (char) tag);
+    put_u32(buf, 8);
+    put_u64(buf, val);
+}
+
+static void put_string(struct strbuf *buf, enum binary_tag tag, const char *str) {
+    put_field(buf, tag, str, str ? strlen(str) : 0);
+}
+
+static void put_phase_times(struct criterion_phase_times *times) {
+    put_uint(&record, TAG_STARTUP_NS, times->startup);
+    put_uint(&record, TAG_INIT_NS, times->init);
+    put_uint(&record, TAG_TEST_NS, times->test);
+    put_uint(&record, TAG_FINI_NS, times->fini);
+    put_uint(&record, TAG_EXIT_NS, times->exit);
+    put_uint(&record, TAG_REAP_NS, times->reap);
+}
+
+static void put_resource_usage(struct criterion_resource_usage *usage) {
+    put_uint(&record, TAG_USER_TIME_NS, usage->user_time);
+    put_uint(&record, TAG_SYSTEM_TIME_NS, usage->system_time);
+    put_uint(&record, TAG_MAX_RSS, usage->max_rss);
+    put_uint(&record, TAG_MINOR_FAULTS, usage->minor_faults);
+    put_uint(&record, TAG_MAJOR_FAULTS, usage->major_faults);
+    put_uint(&record, TAG_VOL_SWITCHES, usage->voluntary_switches);
+    put_uint(&record, TAG_INVOL_SWITCHES, usage->involuntary_switches);
+    put_uint(&record, TAG_READ_BYTES, usage->read_bytes);
+    put_uint(&record, TAG_WRITE_BYTES, usage->write_bytes);
+    if (usage->memory_peak)
+        put_uint(&record, TAG_MEMORY_PEAK, usage->memory_peak);
+    if (usage->throttled_time)
+        put_uint(&record, TAG_THROTTLED_NS, usage->throttled_time);
+}
+
+static void put_perf_counters(struct criterion_perf_counters *perf) {
+    if (perf->measured & CR_PERF_CYCLES)
+        put_uint(&record, TAG_CYCLES, perf->cycles);
+    if (perf->measured & CR_PERF_INSTRUCTIONS)
+        put_uint(&record, TAG_INSTRUCTIONS, perf->instructions);
+    if (perf->measured & CR_PERF_CACHE_REFERENCES)
+        put_uint(&record, TAG_CACHE_REFS, perf->cache_references);
+    if (perf->measured & CR_PERF_CACHE_MISSES)
+        put_uint(&record, TAG_CACHE_MISSES, perf->cache_misses);
+    if (perf->measured & CR_PERF_BRANCHES)
+        put_uint(&record, TAG_BRANCHES, perf->branches);
+    if (perf->measured & CR_PERF_BRANCH_MISSES)
+        put_uint(&record, TAG_BRANCH_MISSES, perf->branch_misses);
+}
+
+static void put_picos(struct strbuf *buf, enum binary_tag tag, double ns) {
+    put_uint(buf, tag, (uint64_t) (ns * 1e3));
+}
+
+static void put_ppm(struct strbuf *buf, enum binary_tag tag, double val) {
+    put_uint(buf, tag, (uint64_t) (int64_t) (val * 1e6));
+}
+
+static void put_bench(struct criterion_bench_stats *bench) {
+    strbuf_clear(&nested);
+    put_uint(&nested, TAG_BENCH_SAMPLES, bench->samples);
+    put_uint(&nested, TAG_BENCH_ITERS, bench->iterations);
+    put_picos(&nested, TAG_BENCH_MEDIAN_PS, bench->median);
+    put_picos(&nested, TAG_BENCH_MAD_PS, bench->mad);
+    put_picos(&nested, TAG_BENCH_MIN_PS, bench->min);
+    put_picos(&nested, TAG_BENCH_MAX_PS, bench->max);
+    put_picos(&nested, TAG_BENCH_CI_LO_PS, bench->ci_low);
+    put_picos(&nested, TAG_BENCH_CI_HI_PS, bench->ci_high);
+    if (bench->unit != CR_BENCH_NO_UNIT) {
+        put_uint(&nested, TAG_BENCH_UNIT, bench->unit);
+        put_uint(&nested, TAG_BENCH_AMOUNT, bench->throughput);
+    }
+    if (bench->baseline.compared) {
+        struct criterion_bench_comparison *cmp = &bench->baseline;
+        put_ppm(&nested, TAG_BASE_CHANGE_PPM, cmp->change);
+        put_ppm(&nested, TAG_BASE_CI_LO_PPM, cmp->change_low);
+        put_ppm(&nested, TAG_BASE_CI_HI_PPM, cmp->change_high);
+        put_ppm(&nested, TAG_BASE_P_PPM, cmp->p_value);
+        put_uint(&nested, TAG_BASE_REGRESSED, cmp->regressed);
+    }
+    put_field(&record, TAG_BENCH, nested.str, nested.size);
+}
+
+static void begin_record(enum binary_record type) {
+    strbuf_clear(&record);
+    put_u32(&record, 0); // patched by flush_record
+    strbuf_putc(&record, (char) type);
+}
+
+static void flush_record(void) {
+    uint32_t size = (uint32_t) (record.size - 4);
+    for (size_t i = 0; i < 4; ++i)
+        record.str[i] = (char) ((size >> (8 * i)) & 0xff);
+
+    fwrite(record.str, 1, record.size, get_output_stream());
+    strbuf_clear(&record);
+}
+
+static enum binary_status get_status(struct criterion_test_stats *ts) {
+    if (ts->oom_killed)
+        return STATUS_OOM_KILLED;
+    if (ts->crashed)
+        return STATUS_CRASHED;
+    if (ts->timed_out)
+        return STATUS_TIMED_OUT;
+    if (ts->failed)
+        return STATUS_FAILED;
+    return STATUS_PASSED;
+}
+
+static void put_test_header(struct criterion_test_stats *ts,
+        enum binary_status status) {
+    begin_record(RECORD_TEST);
+    put_string(&record, TAG_SUITE, ts->test->category);
+    put_string(&record, TAG_NAME, ts->test->name);
+    put_uint(&record, TAG_STATUS, status);
+    if (ts->test->data->description)
+        put_string(&record, TAG_DESCRIPTION, ts->test->data->description);
+}
+
+static void put_test_record(struct criterion_test_stats *ts) {
+    put_test_header(ts, get_status(ts));
+
+    if (can_measure_time()) {
+        put_uint(&record, TAG_ELAPSED_NS, (uint64_t) (ts->elapsed_time * 1e9));
+        put_phase_times(&ts->phase_times);
+    }
+    put_resource_usage(&ts->resource_usage);
+    put_perf_counters(&ts->perf_counters);
+    if (ts->bench)
+        put_bench(ts->bench);
+
+    put_uint(&record, TAG_ASSERTS_PASSED, ts->passed_asserts);
+    put_uint(&record, TAG_ASSERTS_FAILED, ts->failed_asserts);
+
+    if (ts->crashed) {
+        if (ts->signal)
+            put_uint(&record, TAG_SIGNAL, ts->signal);
+        else if (ts->exit_code)
+            put_uint(&record, TAG_EXIT_CODE, (uint64_t) (int64_t) ts->exit_code);
+    }
+
+    bool sf = criterion_options.short_filename;
+    for (struct criterion_assert_stats *asrt = ts->asserts; asrt; asrt = asrt->next) {
+        if (asrt->passed)
+            continue;
+        strbuf_clear(&nested);
+        put_string(&nested, TAG_FILE, sf ? basename_compat(asrt->file) : asrt->file);
+        put_uint(&nested, TAG_LINE, asrt->line);
+        put_string(&nested, TAG_MESSAGE, asrt->message);
+        put_field(&record, TAG_FAILURE, nested.str, nested.size);
+    }
+
+    flush_record();
+}
+
+void binary_log_pre_all(struct criterion_test_set *set) {
+    begin_record(RECORD_START);
+    put_uint(&record, TAG_FORMAT_VERSION, BINARY_FORMAT_VERSION);
+    put_string(&record, TAG_VERSION, VERSION);
+    put_uint(&record, TAG_TESTS, set->tests);
+    flush_record();
+}
+
+void binary_log_test_done(struct criterion_test_stats *stats) {
+    // A worker may still crash or exit after its test has been reported
+    // as finished, which is then notified right after the post_fini event.
+    if (output_test_reported(stats))
+        return;
+    put_test_record(stats);
+}
+
+void binary_log_test_cancel(struct criterion_test_stats *stats) {
+    put_test_header(stats, STATUS_CANCELLED);
+    flush_record();
+}
+
+void binary_log_post_suite(struct criterion_suite_stats *stats) {
+    for (struct criterion_test_stats *ts = stats->tests; ts; ts = ts->next) {
+        if (!is_disabled(ts->test, stats->suite))
+            continue;
+        put_test_header(ts, STATUS_SKIPPED);
+        flush_record();
+    }
+}
+
+void binary_log_post_all(struct criterion_global_stats *stats) {
+    begin_record(RECORD_SUMMARY);
+    put_uint(&record, TAG_NB_SUITES, stats->nb_suites);
+    put_uint(&record, TAG_NB_TESTS, stats->nb_tests);
+    put_uint(&record, TAG_PASSED, stats->tests_passed);
+    put_uint(&record, TAG_FAILED, stats->tests_failed);
+    put_uint(&record, TAG_CRASHED, stats->tests_crashed);
+    put_uint(&record, TAG_SKIPPED, stats->tests_skipped);
+    put_uint(&record, TAG_CANCELLED, stats->tests_cancelled);
+    put_uint(&record, TAG_ASSERTS_PASSED, stats->asserts_passed);
+    put_uint(&record, TAG_ASSERTS_FAILED, stats->asserts_failed);
+    if (can_measure_time()) {
+        put_uint(&record, TAG_WALL_TIME_NS, stats->wall_time);
+        put_phase_times(&stats->phase_times);
+        put_uint(&record, TAG_HOOK_CALLS, stats->runner.hooks.calls);
+        put_uint(&record, TAG_HOOK_TIME_NS, stats->runner.hooks.time);
+        put_uint(&record, TAG_HOOK_WAITS, stats->runner.hook_waits.calls);
+        put_uint(&record, TAG_HOOK_WAIT_NS, stats->runner.hook_waits.time);
+        put_uint(&record, TAG_EVENTS, stats->runner.events.calls);
+        put_uint(&record, TAG_EVENT_TIME_NS, stats->runner.events.time);
+        put_uint(&record, TAG_SPAWNS, stats->runner.spawns.calls);
+        put_uint(&record, TAG_SPAWN_TIME_NS, stats->runner.spawns.time);
+        put_uint(&record, TAG_READS, stats->runner.reads.calls);
+        put_uint(&record, TAG_READ_TIME_NS, stats->runner.reads.time);
+        put_uint(&record, TAG_STAT_PUSHES, stats->runner.stats.calls);
+        put_uint(&record, TAG_STAT_TIME_NS, stats->runner.stats.time);
+        put_uint(&record, TAG_LOGS, stats->runner.logs.calls);
+        put_uint(&record, TAG_LOG_TIME_NS, stats->runner.logs.time);
+    }
+    flush_record();
+
+    fflush(get_output_stream());
+    strbuf_free(&record);
+    strbuf_free(&nested);
+}
+
+struct criterion_output_provider binary_logging = {
+    .log_pre_all        = binary_log_pre_all,
+    .log_test_timeout   = binary_log_test_done,
+    .log_test_crash     = binary_log_test_done,
+    .log_other_crash    = binary_log_test_done,
+    .log_abnormal_exit  = binary_log_test_done,
+    .log_post_fini      = binary_log_test_done,
+    .log_post_suite     = binary_log_post_suite,
+    .log_post_all       = binary_log_post_all,
+    .log_test_cancel    = binary_log_test_cancel,
+};
@@ -0,0 +1,333 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "criterion/stats.h"
+#include "criterion/logging.h"
+#include "criterion/options.h"
+#include "criterion/ordered-set.h"
+#include "compat/posix.h"
+#include "compat/time.h"
+#include "string/strbuf.h"
+#include "io/output.h"
+#include "config.h"
+#include "common.h"
+
+static struct strbuf record = STRBUF_INIT;
+
+static INLINE bool is_disabled(struct criterion_test *t, struct criterion_suite *s) {
+    return t->data->disabled || (s->data && s->data->disabled);
+}
+
+static const char *get_status_string(struct criterion_test_stats *ts) {
+    if (ts->oom_killed)
+        return "OUT_OF_MEMORY";
+    if (ts->crashed)
+        return "CRASHED";
+    if (ts->timed_out)
+        return "TIMED_OUT";
+    if (ts->failed)
+        return "FAILED";
+    return "PASSED";
+}
+
+static void flush_record(void) {
+    // Each record is emitted with a single call so that lines never
+    // interleave with anything else written to the stream
+    strbuf_putc(&record, '\n');
+    criterion_important("%s", record.str);
+    strbuf_clear(&record);
+}
+
+static void put_phase_times(struct criterion_phase_times *times) {
+    strbuf_printf(&record,
+            ",\"phases\":{\"startup\":%" PRIu64
+            ",\"init\":%" PRIu64
+            ",\"test\":%" PRIu64
+            ",\"fini\":%" PRIu64
+            ",\"exit\":%" PRIu64
+            ",\"reap\":%" PRIu64 "}",
+            times->startup,
+            times->init,
+            times->test,
+            times->fini,
+            times->exit,
+            times->reap);
+}
+
+static void put_runner_counter(const char *sep, const char *name,
+                               struct criterion_runner_counter *counter) {
+    strbuf_printf(&record,
+            "%s\"%s\":{\"calls\":" CR_SIZE_T_FORMAT ",\"time\":%" PRIu64 "}",
+            sep, name, counter->calls, counter->time);
+}
+
+static void put_resource_usage(struct criterion_resource_usage *usage) {
+    strbuf_printf(&record,
+            ",\"resources\":{\"user_time\":%" PRIu64
+            ",\"system_time\":%" PRIu64
+            ",\"max_rss\":%" PRIu64
+            ",\"minor_faults\":%" PRIu64
+            ",\"major_faults\":%" PRIu64
+            ",\"voluntary_switches\":%" PRIu64
+            ",\"involuntary_switches\":%" PRIu64
+            ",\"read_bytes\":%" PRIu64
+            ",\"write_bytes\":%" PRIu64,
+            usage->user_time,
+            usage->system_time,
+            usage->max_rss,
+            usage->minor_faults,
+            usage->major_faults,
+            usage->voluntary_switches,
+            usage->involuntary_switches,
+            usage->read_bytes,
+            usage->write_bytes);
+
+    // only measured for the tests run in a cgroup of their own, with
+    // the memory and cpu controllers respectively
+    if (usage->memory_peak)
+        strbuf_printf(&record, ",\"memory_peak\":%" PRIu64,
+                usage->memory_peak);
+    if (usage->throttled_time)
+        strbuf_printf(&record, ",\"throttled_time\":%" PRIu64,
+                usage->throttled_time);
+    strbuf_putc(&record, '}');
+}
+
+static void put_perf_counter(const char **sep, const char *name, uint64_t val) {
+    strbuf_printf(&record, "%s\"%s\":%" PRIu64, *sep, name, val);
+    *sep = ",";
+}
+
+static void put_perf_counters(struct criterion_perf_counters *perf) {
+    if (!perf->measured)
+        return;
+
+    const char *sep = "";
+    strbuf_puts(&record, ",\"perf\":{");
+    if (perf->measured & CR_PERF_CYCLES)
+        put_perf_counter(&sep, "cycles", perf->cycles);
+    if (perf->measured & CR_PERF_INSTRUCTIONS)
+        put_perf_counter(&sep, "instructions", perf->instructions);
+    if (perf->measured & CR_PERF_CACHE_REFERENCES)
+        put_perf_counter(&sep, "cache_references", perf->cache_references);
+    if (perf->measured & CR_PERF_CACHE_MISSES)
+        put_perf_counter(&sep, "cache_misses", perf->cache_misses);
+    if (perf->measured & CR_PERF_BRANCHES)
+        put_perf_counter(&sep, "branches", perf->branches);
+    if (perf->measured & CR_PERF_BRANCH_MISSES)
+        put_perf_counter(&sep, "branch_misses", perf->branch_misses);
+    strbuf_putc(&record, '}');
+}
+
+static void put_bench(struct criterion_bench_stats *bench) {
+    strbuf_printf(&record,
+            ",\"bench\":{\"samples\":" CR_SIZE_T_FORMAT
+            ",\"iterations\":" CR_SIZE_T_FORMAT
+            ",\"median\":%.3f"
+            ",\"mad\":%.3f"
+            ",\"min\":%.3f"
+            ",\"max\":%.3f"
+            ",\"ci\":[%.3f,%.3f]",
+            bench->samples,
+            bench->iterations,
+            bench->median,
+            bench->mad,
+            bench->min,
+            bench->max,
+            bench->ci_low,
+            bench->ci_high);
+    if (bench->unit != CR_BENCH_NO_UNIT) {
+        strbuf_printf(&record,
+                ",\"throughput\":{\"unit\":\"%s\",\"amount\":%" PRIu64 "}",
+                bench->unit == CR_BENCH_BYTES ? "bytes" : "items",
+                bench->throughput);
+    }
+    struct criterion_bench_comparison *cmp = &bench->baseline;
+    if (cmp->compared) {
+        strbuf_printf(&record,
+                ",\"baseline\":{\"change\":%.6f"
+                ",\"ci\":[%.6f,%.6f]"
+                ",\"p_value\":%.6f"
+                ",\"regressed\":%s}",
+                cmp->change,
+                cmp->change_low,
+                cmp->change_high,
+                cmp->p_value,
+                cmp->regressed ? "true" : "false");
+    }
+    strbuf_puts(&record, ",\"times\":[");
+    for (size_t i = 0; i < bench->samples; ++i)
+        strbuf_printf(&record, "%s%.3f", i ? "," : "", bench->sample_times[i]);
+    strbuf_puts(&record, "]}");
+}
+
+static void put_test_header(struct criterion_test_stats *ts, const char *status) {
+    strbuf_puts(&record, "{\"type\":\"test\",\"suite\":");
+    strbuf_put_json_string(&record, ts->test->category);
+    strbuf_puts(&record, ",\"name\":");
+    strbuf_put_json_string(&record, ts->test->name);
+    strbuf_puts(&record, ",\"status\":");
+    strbuf_put_json_string(&record, status);
+    if (ts->test->data->description) {
+        strbuf_puts(&record, ",\"description\":");
+        strbuf_put_json_string(&record, ts->test->data->description);
+    }
+}
+
+static void put_test_record(struct criterion_test_stats *ts) {
+    put_test_header(ts, get_status_string(ts));
+
+    if (can_measure_time()) {
+        strbuf_printf(&record, ",\"elapsed\":%.6f", ts->elapsed_time);
+        put_phase_times(&ts->phase_times);
+    }
+    put_resource_usage(&ts->resource_usage);
+    put_perf_counters(&ts->perf_counters);
+    if (ts->bench)
+        put_bench(ts->bench);
+
+    strbuf_printf(&record, ",\"asserts\":{\"passed\":%d,\"failed\":%d}",
+            ts->passed_asserts, ts->failed_asserts);
+
+    bool sf = criterion_options.short_filename;
+    if (ts->crashed) {
+        if (ts->signal)
+            strbuf_printf(&record, ",\"signal\":%d", ts->signal);
+        else if (ts->exit_code)
+            strbuf_printf(&record, ",\"exit_code\":%d", ts->exit_code);
+        if (ts->file) {
+            strbuf_puts(&record, ",\"last_assert\":{\"file\":");
+            strbuf_put_json_string(&record,
+                    sf ? basename_compat(ts->file) : ts->file);
+            strbuf_printf(&record, ",\"line\":%u}", ts->progress);
+        }
+    }
+
+    if (ts->failed_asserts) {
+        strbuf_puts(&record, ",\"failures\":[");
+        const char *sep = "";
+        for (struct criterion_assert_stats *asrt = ts->asserts; asrt; asrt = asrt->next) {
+            if (asrt->passed)
+                continue;
+            strbuf_printf(&record, "%s{\"file\":", sep);
+            strbuf_put_json_string(&record,
+                    sf ? basename_compat(asrt->file) : asrt->file);
+            strbuf_printf(&record, ",\"line\":%u,\"message\":", asrt->line);
+            strbuf_put_json_string(&record, asrt->message);
+            strbuf_putc(&record, '}');
+            sep = ",";
+        }
+        strbuf_putc(&record, ']');
+    }
+
+    strbuf_putc(&record, '}');
+    flush_record();
+}
+
+void json_log_pre_all(struct criterion_test_set *set) {
+    strbuf_printf(&record,
+            "{\"type\":\"start\",\"version\":\"%s\",\"tests\":" CR_SIZE_T_FORMAT "}",
+            VERSION, set->tests);
+    flush_record();
+}
+
+void json_log_test_done(struct criterion_test_stats *stats) {
+    // A worker may still crash or exit after its test has been reported
+    // as finished, which is then notified right after the post_fini event.
+    if (output_test_reported(stats))
+        return;
+    put_test_record(stats);
+}
+
+void json_log_test_cancel(struct criterion_test_stats *stats) {
+    put_test_header(stats, "CANCELLED");
+    strbuf_putc(&record, '}');
+    flush_record();
+}
+
+void json_log_post_suite(struct criterion_suite_stats *stats) {
+    for (struct criterion_test_stats *ts = stats->tests; ts; ts = ts->next) {
+        if (!is_disabled(ts->test, stats->suite))
+            continue;
+        put_test_header(ts, "SKIPPED");
+        strbuf_putc(&record, '}');
+        flush_record();
+    }
+}
+
+void json_log_post_all(struct criterion_global_stats *stats) {
+    strbuf_printf(&record,
+            "{\"type\":\"summary\""
+            ",\"suites\":" CR_SIZE_T_FORMAT
+            ",\"tests\":" CR_SIZE_T_FORMAT
+            ",\"passed\":" CR_SIZE_T_FORMAT
+            ",\"failed\":" CR_SIZE_T_FORMAT
+            ",\"crashed\":" CR_SIZE_T_FORMAT
+            ",\"skipped\":" CR_SIZE_T_FORMAT
+            ",\"cancelled\":" CR_SIZE_T_FORMAT
+            ",\"asserts\":{\"passed\":" CR_SIZE_T_FORMAT
+            ",\"failed\":" CR_SIZE_T_FORMAT "}",
+            stats->nb_suites,
+            stats->nb_tests,
+            stats->tests_passed,
+            stats->tests_failed,
+            stats->tests_crashed,
+            stats->tests_skipped,
+            stats->tests_cancelled,
+            stats->asserts_passed,
+            stats->asserts_failed);
+    if (can_measure_time()) {
+        strbuf_printf(&record, ",\"wall_time\":%" PRIu64, stats->wall_time);
+        put_phase_times(&stats->phase_times);
+        struct criterion_runner_counters *r = &stats->runner;
+        strbuf_puts(&record, ",\"runner\":{");
+        put_runner_counter("", "hooks", &r->hooks);
+        put_runner_counter(",", "hook_waits", &r->hook_waits);
+        put_runner_counter(",", "events", &r->events);
+        put_runner_counter(",", "spawns", &r->spawns);
+        put_runner_counter(",", "reads", &r->reads);
+        put_runner_counter(",", "stats", &r->stats);
+        put_runner_counter(",", "logs", &r->logs);
+        strbuf_putc(&record, '}');
+    }
+    strbuf_putc(&record, '}');
+    flush_record();
+    strbuf_free(&record);
+}
+
+struct criterion_output_provider json_logging = {
+    .log_pre_all        = json_log_pre_all,
+    .log_test_timeout   = json_log_test_done,
+    .log_test_crash     = json_log_test_done,
+    .log_other_crash    = json_log_test_done,
+    .log_abnormal_exit  = json_log_test_done,
+    .log_post_fini      = json_log_test_done,
+    .log_post_suite     = json_log_post_suite,
+    .log_post_all       = json_log_post_all,
+    .log_test_cancel    = json_log_test_cancel,
+};
@@ -28,6 +28,7 @@
 #include "criterion/logging.h"
 #include "criterion/options.h"
 #include "string/i18n.h"
+#include "io/output.h"
 
 #ifdef ENABLE_NLS
 # define LOG_FORMAT "[%1$s%2$s%3$s] %4$s"
@@ -45,6 +46,7 @@ const struct criterion_prefix_data g_criterion_logging_prefixes[] = {
     [CRITERION_LOGGING_PREFIX_PASS]     = { "PASS", CRIT_FG_GREEN },
     [CRITERION_LOGGING_PREFIX_FAIL]     = { "FAIL", CRIT_FG_RED   },
     [CRITERION_LOGGING_PREFIX_ERR]      = { "ERR ", CRIT_FG_RED   },
+    [CRITERION_LOGGING_PREFIX_BENCH]    = { "BNCH", CRIT_FG_BLUE  },
     { NULL, NULL }
 };
 
@@ -60,7 +62,7 @@ void criterion_plog(enum criterion_logging_level level, const struct criterion_p
     va_end(args);
 
     if (prefix == &g_criterion_logging_prefixes[CRITERION_LOGGING_PREFIX_ERR]) {
-        fprintf(stderr, _(ERROR_FORMAT),
+        fprintf(get_output_stream(), _(ERROR_FORMAT),
             CRIT_COLOR_NORMALIZE(prefix->color),
             prefix->prefix,
                 CR_RESET,
@@ -69,7 +71,7 @@ void criterion_plog(enum criterion_logging_level level, const struct criterion_p
             formatted_msg,
                 CR_RESET);
     } else {
-        fprintf(stderr, _(LOG_FORMAT),
+        fprintf(get_output_stream(), _(LOG_FORMAT),
             CRIT_COLOR_NORMALIZE(prefix->color),
             prefix->prefix,
                 CR_RESET,
@@ -89,5 +91,5 @@ void criterion_vlog(enum criterion_logging_level level, const char *msg, va_list
     if (level < criterion_options.logging_threshold)
         return;
 
-    vfprintf(stderr, msg, args);
+    vfprintf(get_output_stream(), msg, args);
 }
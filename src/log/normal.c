@@ -23,6 +23,7 @@
  */
 #define _GNU_SOURCE
 #define CRITERION_LOGGING_COLORS
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,6 +35,7 @@
 #include "compat/strtok.h"
 #include "compat/time.h"
 #include "string/i18n.h"
+#include "string/strbuf.h"
 #include "config.h"
 #include "common.h"
 
@@ -48,11 +50,13 @@ static msg_t msg_post_test_timed = N_("%1$s::%2$s: (%3$3.2fs)\n");
 static msg_t msg_post_test = N_("%1$s::%2$s\n");
 static msg_t msg_post_suite_test = N_("%1$s::%2$s: Test is disabled\n");
 static msg_t msg_post_suite_suite = N_("%1$s::%2$s: Suite is disabled\n");
+static msg_t msg_test_cancel = N_("%1$s::%2$s: Cancelled\n");
 static msg_t msg_assert_fail = N_("%1$s%2$s%3$s:%4$s%5$d%6$s: Assertion failed: %7$s\n");
 static msg_t msg_theory_fail = N_("  Theory %1$s::%2$s failed with the following parameters: (%3$s)\n");
 static msg_t msg_test_timeout = N_("%1$s::%2$s: Timed out. (%3$3.2fs)\n");
 static msg_t msg_test_crash_line = N_("%1$s%2$s%3$s:%4$s%5$u%6$s: Unexpected signal caught below this line!\n");
 static msg_t msg_test_crash = N_("%1$s::%2$s: CRASH!\n");
+static msg_t msg_test_oom = N_("%1$s::%2$s: Killed for exceeding its memory limit. (peak: %3$.1f MiB)\n");
 static msg_t msg_test_abort = N_("%1$s::%2$s: %3$s\n");
 static msg_t msg_test_other_crash = N_("%1$sWarning! The test `%2$s::%3$s` crashed during its setup or teardown.%4$s\n");
 static msg_t msg_test_abnormal_exit = N_("%1$sWarning! The test `%2$s::%3$s` exited during its setup or teardown.%4$s\n");
@@ -63,17 +67,73 @@ static msg_t msg_post_all = N_("%1$sSynthesis: Tested: %2$s%3$lu%4$s "
              "| Failing: %8$s%9$lu%10$s "
              "| Crashing: %11$s%12$lu%13$s "
              "%14$s\n");
+static msg_t msg_post_all_cancelled = N_("%1$sSynthesis: Tested: %2$s%3$lu%4$s "
+             "| Passing: %5$s%6$lu%7$s "
+             "| Failing: %8$s%9$lu%10$s "
+             "| Crashing: %11$s%12$lu%13$s "
+             "| Cancelled: %14$s%15$lu%16$s "
+             "%17$s\n");
+static msg_t msg_post_all_times = N_("Time: %1$.3fs wall "
+             "| Startup: %2$.3fs "
+             "| Init: %3$.3fs "
+             "| Test: %4$.3fs "
+             "| Fini: %5$.3fs "
+             "| Exit: %6$.3fs "
+             "| Reap: %7$.3fs\n");
+static msg_t msg_runner_events = N_("Worker events: %1$lu handled "
+             "in %2$.3fs\n");
+static msg_t msg_runner_work = N_("Spawns: %1$lu in %2$.3fs "
+             "| Pipe reads: %3$lu in %4$.3fs "
+             "| Stats: %5$lu in %6$.3fs "
+             "| Logging: %7$lu in %8$.3fs\n");
+static msg_t msg_runner_hooks = N_("Report hooks: %1$lu calls "
+             "in %2$.3fs\n");
+static msg_t msg_runner_hook_waits = N_("Waited %1$lu times for the "
+             "report hooks, for %2$.3fs\n");
+static msg_t msg_top_rss = N_("Top tests by peak memory usage:\n");
+static msg_t msg_top_rss_entry = N_("  %1$s::%2$s: %3$.1f MiB\n");
+static msg_t msg_top_cpu = N_("Top tests by CPU time:\n");
+static msg_t msg_top_cpu_entry = N_("  %1$s::%2$s: %3$.3fs "
+             "(user %4$.3fs, system %5$.3fs)\n");
+static msg_t msg_perf_slowest_tests = N_("Slowest tests:\n");
+static msg_t msg_perf_test = N_("  %1$s::%2$s: %3$.3fs "
+             "(test %4$.3fs, fixtures %5$.3fs, worker %6$.3fs)\n");
+static msg_t msg_perf_slowest_suites = N_("Slowest suites:\n");
+static msg_t msg_perf_suite[] = N_s("  %1$s: %2$.3fs in %3$lu test\n",
+             "  %1$s: %2$.3fs in %3$lu tests\n");
+static msg_t msg_perf_efficiency = N_("Parallel efficiency: %1$.1f%% "
+             "(%2$.3fs of test bodies over %3$.3fs wall on %4$lu "
+             "worker slots)\n");
+static msg_t msg_perf_tail = N_("Idle worker slots at the tail: "
+             "%1$.3fs (%2$.1f%% of the slot time)\n");
+static msg_t msg_perf_no_efficiency = N_("Parallel efficiency: unavailable, "
+             "as no worker slot was accounted for\n");
+static msg_t msg_perf_overhead = N_("Time in the workers: %1$.1f%% test "
+             "bodies, %2$.1f%% fixtures, %3$.1f%% worker startup "
+             "and teardown\n");
+static msg_t msg_perf_heavy_init = N_("%1$sWarning! The suite `%2$s` "
+             "spends more time in its setup (%3$.3fs) than in its "
+             "tests (%4$.3fs).%5$s\n");
+static msg_t msg_bench = N_("%1$s::%2$s: %3$s/op (MAD: %4$s, "
+             "min: %5$s, 95%% CI: %6$s - %7$s, "
+             "%8$lu samples of %9$lu iterations)%10$s\n");
+static msg_t msg_bench_change = N_("%1$s::%2$s: %3$+.2f%% compared to "
+             "the baseline (95%% CI: %4$+.2f%% to %5$+.2f%%, p = %6$.3f)\n");
+static msg_t msg_bench_regression = N_("%1$s::%2$s: %3$sRegression above "
+             "the %4$.2f%% threshold!%5$s\n");
 #else
 static msg_t msg_pre_init = "%s::%s\n";
 static msg_t msg_post_test_timed = "%s::%s: (%3.2fs)\n";
 static msg_t msg_post_test = "%s::%s\n";
 static msg_t msg_post_suite_test = "%s::%s: Test is disabled\n";
 static msg_t msg_post_suite_suite = "%s::%s: Suite is disabled\n";
+static msg_t msg_test_cancel = "%s::%s: Cancelled\n";
 static msg_t msg_assert_fail = "%s%s%s:%s%d%s: Assertion failed: %s\n";
 static msg_t msg_theory_fail = "  Theory %s::%s failed with the following parameters: (%s)\n";
 static msg_t msg_test_timeout = "%s::%s: Timed out. (%3.2fs)\n";
 static msg_t msg_test_crash_line = "%s%s%s:%s%u%s: Unexpected signal caught below this line!\n";
 static msg_t msg_test_crash = "%s::%s: CRASH!\n";
+static msg_t msg_test_oom = "%s::%s: Killed for exceeding its memory limit. (peak: %.1f MiB)\n";
 static msg_t msg_test_abort = N_("%s::%s: %s\n");
 static msg_t msg_test_other_crash = "%sWarning! The test `%s::%s` crashed during its setup or teardown.%s\n";
 static msg_t msg_test_abnormal_exit = "%sWarning! The test `%s::%s` exited during its setup or teardown.%s\n";
@@ -84,8 +144,67 @@ static msg_t msg_post_all = "%sSynthesis: Tested: %s%lu%s "
             "| Failing: %s%lu%s "
             "| Crashing: %s%lu%s "
             "%s\n";
+static msg_t msg_post_all_cancelled = "%sSynthesis: Tested: %s%lu%s "
+            "| Passing: %s%lu%s "
+            "| Failing: %s%lu%s "
+            "| Crashing: %s%lu%s "
+            "| Cancelled: %s%lu%s "
+            "%s\n";
+static msg_t msg_post_all_times = "Time: %.3fs wall "
+            "| Startup: %.3fs "
+            "| Init: %.3fs "
+            "| Test: %.3fs "
+            "| Fini: %.3fs "
+            "| Exit: %.3fs "
+            "| Reap: %.3fs\n";
+static msg_t msg_runner_events = "Worker events: %lu handled "
+            "in %.3fs\n";
+static msg_t msg_runner_work = "Spawns: %lu in %.3fs "
+            "| Pipe reads: %lu in %.3fs "
+            "| Stats: %lu in %.3fs "
+            "| Logging: %lu in %.3fs\n";
+static msg_t msg_runner_hooks = "Report hooks: %lu calls "
+            "in %.3fs\n";
+static msg_t msg_runner_hook_waits = "Waited %lu times for the "
+            "report hooks, for %.3fs\n";
+static msg_t msg_top_rss = "Top tests by peak memory usage:\n";
+static msg_t msg_top_rss_entry = "  %s::%s: %.1f MiB\n";
+static msg_t msg_top_cpu = "Top tests by CPU time:\n";
+static msg_t msg_top_cpu_entry = "  %s::%s: %.3fs "
+            "(user %.3fs, system %.3fs)\n";
+static msg_t msg_perf_slowest_tests = "Slowest tests:\n";
+static msg_t msg_perf_test = "  %s::%s: %.3fs "
+            "(test %.3fs, fixtures %.3fs, worker %.3fs)\n";
+static msg_t msg_perf_slowest_suites = "Slowest suites:\n";
+static msg_t msg_perf_suite[] = { "  %s: %.3fs in %lu test\n",
+            "  %s: %.3fs in %lu tests\n" };
+static msg_t msg_perf_efficiency = "Parallel efficiency: %.1f%% "
+            "(%.3fs of test bodies over %.3fs wall on %lu "
+            "worker slots)\n";
+static msg_t msg_perf_tail = "Idle worker slots at the tail: "
+            "%.3fs (%.1f%% of the slot time)\n";
+static msg_t msg_perf_no_efficiency = "Parallel efficiency: unavailable, "
+            "as no worker slot was accounted for\n";
+static msg_t msg_perf_overhead = "Time in the workers: %.1f%% test "
+            "bodies, %.1f%% fixtures, %.1f%% worker startup "
+            "and teardown\n";
+static msg_t msg_perf_heavy_init = "%sWarning! The suite `%s` "
+            "spends more time in its setup (%.3fs) than in its "
+            "tests (%.3fs).%s\n";
+static msg_t msg_bench = "%s::%s: %s/op (MAD: %s, "
+            "min: %s, 95%% CI: %s - %s, "
+            "%lu samples of %lu iterations)%s\n";
+static msg_t msg_bench_change = "%s::%s: %+.2f%% compared to "
+            "the baseline (95%% CI: %+.2f%% to %+.2f%%, p = %.3f)\n";
+static msg_t msg_bench_regression = "%s::%s: %sRegression above "
+            "the %.2f%% threshold!%s\n";
 #endif
 
+#define TOP_RESOURCE_USERS 5
+
+// below this, the init and test times of a suite are mostly noise
+#define HEAVY_INIT_MIN_NS 10000000
+
 void normal_log_pre_all(CR_UNUSED struct criterion_test_set *set) {
     criterion_pinfo(CRITERION_PREFIX_DASHES, _(msg_pre_all), VERSION);
 }
@@ -100,6 +219,110 @@ void normal_log_pre_init(struct criterion_test *test) {
                 test->data->description);
 }
 
+static void put_perf_counter(struct strbuf *buf, const char *name, uint64_t val) {
+    strbuf_printf(buf, "%s%s: %" PRIu64, buf->size ? " | " : "  ", name, val);
+}
+
+static void print_perf_counters(struct criterion_perf_counters *perf) {
+    if (criterion_options.logging_threshold > CRITERION_INFO)
+        return;
+
+    struct strbuf buf = STRBUF_INIT;
+    if (perf->measured & CR_PERF_CYCLES)
+        put_perf_counter(&buf, "cycles", perf->cycles);
+    if (perf->measured & CR_PERF_INSTRUCTIONS)
+        put_perf_counter(&buf, "instructions", perf->instructions);
+    if ((perf->measured & CR_PERF_CYCLES)
+            && (perf->measured & CR_PERF_INSTRUCTIONS)
+            && perf->cycles)
+        strbuf_printf(&buf, " (IPC: %.2f)",
+                (double) perf->instructions / (double) perf->cycles);
+    if (perf->measured & CR_PERF_CACHE_REFERENCES)
+        put_perf_counter(&buf, "cache-references", perf->cache_references);
+    if (perf->measured & CR_PERF_CACHE_MISSES)
+        put_perf_counter(&buf, "cache-misses", perf->cache_misses);
+    if (perf->measured & CR_PERF_BRANCHES)
+        put_perf_counter(&buf, "branches", perf->branches);
+    if (perf->measured & CR_PERF_BRANCH_MISSES)
+        put_perf_counter(&buf, "branch-misses", perf->branch_misses);
+
+    criterion_pinfo(CRITERION_PREFIX_DASHES, "%s\n", buf.str);
+    strbuf_free(&buf);
+}
+
+static void format_duration(char *buf, size_t size, double ns) {
+    static const char *const units[] = { "ns", "us", "ms", "s" };
+    size_t i = 0;
+    for (; ns >= 1000 && i < 3; ++i)
+        ns /= 1000;
+    snprintf(buf, size, "%.*f %s", ns < 10 ? 2 : 1, ns, units[i]);
+}
+
+static void format_throughput(char *buf, size_t size,
+        struct criterion_bench_stats *bench) {
+    static const char *const bytes[] = {
+        "B/s", "KiB/s", "MiB/s", "GiB/s", "TiB/s"
+    };
+    static const char *const items[] = {
+        "items/s", "K items/s", "M items/s", "G items/s", "T items/s"
+    };
+
+    *buf = '\0';
+    if (bench->unit == CR_BENCH_NO_UNIT || !bench->throughput
+            || bench->median <= 0)
+        return;
+
+    bool is_bytes = bench->unit == CR_BENCH_BYTES;
+    const char *const *units = is_bytes ? bytes : items;
+    double step = is_bytes ? 1024 : 1000;
+
+    double rate = bench->throughput * 1e9 / bench->median;
+    size_t i = 0;
+    for (; rate >= step && i < 4; ++i)
+        rate /= step;
+    snprintf(buf, size, ", %.2f %s", rate, units[i]);
+}
+
+static void print_bench(struct criterion_test_stats *stats) {
+    struct criterion_bench_stats *bench = stats->bench;
+    char median[32], mad[32], min[32], ci_low[32], ci_high[32], rate[32];
+
+    format_duration(median,  sizeof (median),  bench->median);
+    format_duration(mad,     sizeof (mad),     bench->mad);
+    format_duration(min,     sizeof (min),     bench->min);
+    format_duration(ci_low,  sizeof (ci_low),  bench->ci_low);
+    format_duration(ci_high, sizeof (ci_high), bench->ci_high);
+    format_throughput(rate, sizeof (rate), bench);
+
+    criterion_pimportant(CRITERION_PREFIX_BENCH, _(msg_bench),
+            stats->test->category,
+            stats->test->name,
+            median, mad, min, ci_low, ci_high,
+            (unsigned long) bench->samples,
+            (unsigned long) bench->iterations,
+            rate);
+
+    struct criterion_bench_comparison *cmp = &bench->baseline;
+    if (!cmp->compared)
+        return;
+
+    criterion_pimportant(CRITERION_PREFIX_BENCH, _(msg_bench_change),
+            stats->test->category,
+            stats->test->name,
+            cmp->change * 100,
+            cmp->change_low * 100,
+            cmp->change_high * 100,
+            cmp->p_value);
+
+    if (cmp->regressed)
+        criterion_pimportant(CRITERION_PREFIX_FAIL, _(msg_bench_regression),
+                stats->test->category,
+                stats->test->name,
+                CR_FG_RED,
+                criterion_options.bench_threshold * 100,
+                CR_RESET);
+}
+
 void normal_log_post_test(struct criterion_test_stats *stats) {
     const char *format = can_measure_time() ? msg_post_test_timed : msg_post_test;
 
@@ -112,6 +335,11 @@ void normal_log_post_test(struct criterion_test_stats *stats) {
             stats->test->category,
             stats->test->name,
             stats->elapsed_time);
+
+    if (stats->perf_counters.measured)
+        print_perf_counters(&stats->perf_counters);
+    if (stats->bench)
+        print_bench(stats);
 }
 
 static INLINE bool is_disabled(struct criterion_test *t,
@@ -119,6 +347,12 @@ static INLINE bool is_disabled(struct criterion_test *t,
     return t->data->disabled || (s->data && s->data->disabled);
 }
 
+void normal_log_test_cancel(struct criterion_test_stats *stats) {
+    criterion_pinfo(CRITERION_PREFIX_SKIP, _(msg_test_cancel),
+            stats->test->category,
+            stats->test->name);
+}
+
 void normal_log_post_suite(struct criterion_suite_stats *stats) {
     for (struct criterion_test_stats *ts = stats->tests; ts; ts = ts->next) {
         if (is_disabled(ts->test, stats->suite)) {
@@ -137,17 +371,270 @@ void normal_log_post_suite(struct criterion_suite_stats *stats) {
     }
 }
 
+typedef uint64_t (*f_usage_key)(struct criterion_test_stats *);
+
+static uint64_t rss_key(struct criterion_test_stats *ts) {
+    return ts->resource_usage.max_rss;
+}
+
+static uint64_t cpu_key(struct criterion_test_stats *ts) {
+    return ts->resource_usage.user_time + ts->resource_usage.system_time;
+}
+
+static size_t find_top_users(struct criterion_global_stats *stats,
+                             f_usage_key key,
+                             struct criterion_test_stats **top) {
+    size_t count = 0;
+    for (struct criterion_suite_stats *ss = stats->suites; ss; ss = ss->next) {
+        for (struct criterion_test_stats *ts = ss->tests; ts; ts = ts->next) {
+            uint64_t val = key(ts);
+            if (!val)
+                continue;
+
+            size_t i = count;
+            for (; i > 0 && key(top[i - 1]) < val; --i) {
+                if (i < TOP_RESOURCE_USERS)
+                    top[i] = top[i - 1];
+            }
+            if (i < TOP_RESOURCE_USERS)
+                top[i] = ts;
+            if (count < TOP_RESOURCE_USERS)
+                ++count;
+        }
+    }
+    return count;
+}
+
+static void print_top_resource_users(struct criterion_global_stats *stats) {
+    struct criterion_test_stats *top[TOP_RESOURCE_USERS];
+
+    size_t count = find_top_users(stats, rss_key, top);
+    if (count)
+        criterion_pinfo(CRITERION_PREFIX_EQUALS, _(msg_top_rss));
+    for (size_t i = 0; i < count; ++i) {
+        criterion_pinfo(CRITERION_PREFIX_DASHES, _(msg_top_rss_entry),
+                top[i]->test->category,
+                top[i]->test->name,
+                top[i]->resource_usage.max_rss / (1024. * 1024.));
+    }
+
+    count = find_top_users(stats, cpu_key, top);
+    if (count)
+        criterion_pinfo(CRITERION_PREFIX_EQUALS, _(msg_top_cpu));
+    for (size_t i = 0; i < count; ++i) {
+        struct criterion_resource_usage *usage = &top[i]->resource_usage;
+        criterion_pinfo(CRITERION_PREFIX_DASHES, _(msg_top_cpu_entry),
+                top[i]->test->category,
+                top[i]->test->name,
+                cpu_key(top[i]) / 1e9,
+                usage->user_time / 1e9,
+                usage->system_time / 1e9);
+    }
+}
+
+// The time a test held its worker slot, from its spawn to its reaping
+static uint64_t slot_time(struct criterion_test_stats *ts) {
+    struct criterion_test_timestamps *t = &ts->timestamps;
+    uint64_t end = t->reap ? t->reap : t->exit;
+    return t->spawn && end > t->spawn ? end - t->spawn : 0;
+}
+
+static uint64_t phase_total(struct criterion_phase_times *t) {
+    return t->startup + t->init + t->test + t->fini + t->exit + t->reap;
+}
+
+static uint64_t suite_time(struct criterion_suite_stats *ss) {
+    uint64_t total = 0;
+    for (struct criterion_test_stats *ts = ss->tests; ts; ts = ts->next)
+        total += slot_time(ts);
+    return total;
+}
+
+static size_t find_slowest_suites(struct criterion_global_stats *stats,
+                                  struct criterion_suite_stats **top) {
+    size_t count = 0;
+    for (struct criterion_suite_stats *ss = stats->suites; ss; ss = ss->next) {
+        uint64_t val = suite_time(ss);
+        if (!val)
+            continue;
+
+        size_t i = count;
+        for (; i > 0 && suite_time(top[i - 1]) < val; --i) {
+            if (i < TOP_RESOURCE_USERS)
+                top[i] = top[i - 1];
+        }
+        if (i < TOP_RESOURCE_USERS)
+            top[i] = ss;
+        if (count < TOP_RESOURCE_USERS)
+            ++count;
+    }
+    return count;
+}
+
+/*
+ * Once the last test is spawned, the slots freed by the other tests have
+ * nothing left to run until the end: that is the time lost at the tail.
+ */
+static uint64_t tail_idle_time(struct criterion_global_stats *stats,
+                               uint64_t *tail) {
+    uint64_t last_spawn = 0, end = 0;
+    for (struct criterion_suite_stats *ss = stats->suites; ss; ss = ss->next) {
+        for (struct criterion_test_stats *ts = ss->tests; ts; ts = ts->next) {
+            if (!slot_time(ts))
+                continue;
+            if (ts->timestamps.spawn > last_spawn)
+                last_spawn = ts->timestamps.spawn;
+            if (ts->timestamps.spawn + slot_time(ts) > end)
+                end = ts->timestamps.spawn + slot_time(ts);
+        }
+    }
+
+    uint64_t busy = 0;
+    for (struct criterion_suite_stats *ss = stats->suites; ss; ss = ss->next) {
+        for (struct criterion_test_stats *ts = ss->tests; ts; ts = ts->next) {
+            uint64_t ts_end = ts->timestamps.spawn + slot_time(ts);
+            if (slot_time(ts) && ts_end > last_spawn)
+                busy += ts_end - (ts->timestamps.spawn > last_spawn
+                        ? ts->timestamps.spawn : last_spawn);
+        }
+    }
+
+    *tail = stats->jobs * (end - last_spawn);
+    return *tail > busy ? *tail - busy : 0;
+}
+
+static void print_perf_summary(struct criterion_global_stats *stats) {
+    struct criterion_test_stats *top[TOP_RESOURCE_USERS];
+    size_t count = find_top_users(stats, slot_time, top);
+    if (count)
+        criterion_pimportant(CRITERION_PREFIX_EQUALS, _(msg_perf_slowest_tests));
+    for (size_t i = 0; i < count; ++i) {
+        struct criterion_phase_times *t = &top[i]->phase_times;
+        criterion_pimportant(CRITERION_PREFIX_DASHES, _(msg_perf_test),
+                top[i]->test->category,
+                top[i]->test->name,
+                slot_time(top[i]) / 1e9,
+                t->test / 1e9,
+                (t->init + t->fini) / 1e9,
+                (t->startup + t->exit + t->reap) / 1e9);
+    }
+
+    struct criterion_suite_stats *suites[TOP_RESOURCE_USERS];
+    count = find_slowest_suites(stats, suites);
+    if (count)
+        criterion_pimportant(CRITERION_PREFIX_EQUALS, _(msg_perf_slowest_suites));
+    for (size_t i = 0; i < count; ++i) {
+        size_t nb_tests = suites[i]->nb_tests - suites[i]->tests_skipped;
+        criterion_pimportant(CRITERION_PREFIX_DASHES,
+                _s(msg_perf_suite[0], msg_perf_suite[1], nb_tests),
+                suites[i]->suite->name,
+                suite_time(suites[i]) / 1e9,
+                (unsigned long) nb_tests);
+    }
+
+    struct criterion_phase_times *t = &stats->phase_times;
+    uint64_t capacity = stats->wall_time * stats->jobs;
+    if (capacity)
+        criterion_pimportant(CRITERION_PREFIX_EQUALS, _(msg_perf_efficiency),
+                100. * t->test / capacity,
+                t->test / 1e9,
+                stats->wall_time / 1e9,
+                (unsigned long) stats->jobs);
+    else if (stats->nb_tests > stats->tests_skipped)
+        criterion_pimportant(CRITERION_PREFIX_EQUALS,
+                _(msg_perf_no_efficiency));
+
+    uint64_t tail;
+    uint64_t idle = tail_idle_time(stats, &tail);
+    if (capacity)
+        criterion_pimportant(CRITERION_PREFIX_EQUALS, _(msg_perf_tail),
+                idle / 1e9,
+                100. * idle / capacity);
+
+    uint64_t total = phase_total(t);
+    if (total)
+        criterion_pimportant(CRITERION_PREFIX_EQUALS, _(msg_perf_overhead),
+                100. * t->test / total,
+                100. * (t->init + t->fini) / total,
+                100. * (t->startup + t->exit + t->reap) / total);
+
+    for (struct criterion_suite_stats *ss = stats->suites; ss; ss = ss->next) {
+        uint64_t init = ss->phase_times.init;
+        if (init >= HEAVY_INIT_MIN_NS && init > ss->phase_times.test)
+            criterion_pimportant(CRITERION_PREFIX_DASHES, _(msg_perf_heavy_init),
+                    CR_FG_BOLD, ss->suite->name,
+                    init / 1e9,
+                    ss->phase_times.test / 1e9,
+                    CR_RESET);
+    }
+}
+
 void normal_log_post_all(struct criterion_global_stats *stats) {
-    size_t tested = stats->nb_tests - stats->tests_skipped;
+    size_t tested = stats->nb_tests - stats->tests_skipped
+        - stats->tests_cancelled;
+
+    if (stats->tests_cancelled) {
+        criterion_pimportant(CRITERION_PREFIX_EQUALS,
+                _(msg_post_all_cancelled),
+                             CR_FG_BOLD,
+                             CR_FG_BLUE,  (unsigned long) tested, CR_FG_BOLD,
+                             CR_FG_GREEN, (unsigned long) stats->tests_passed, CR_FG_BOLD,
+                             CR_FG_RED,   (unsigned long) stats->tests_failed, CR_FG_BOLD,
+                             CR_FG_RED,   (unsigned long) stats->tests_crashed, CR_FG_BOLD,
+                             CR_FG_GOLD,  (unsigned long) stats->tests_cancelled, CR_FG_BOLD,
+                             CR_RESET);
+    } else {
+        criterion_pimportant(CRITERION_PREFIX_EQUALS,
+                _(msg_post_all),
+                             CR_FG_BOLD,
+                             CR_FG_BLUE,  (unsigned long) tested, CR_FG_BOLD,
+                             CR_FG_GREEN, (unsigned long) stats->tests_passed, CR_FG_BOLD,
+                             CR_FG_RED,   (unsigned long) stats->tests_failed, CR_FG_BOLD,
+                             CR_FG_RED,   (unsigned long) stats->tests_crashed, CR_FG_BOLD,
+                             CR_RESET);
+    }
+
+    if (!can_measure_time())
+        return;
+
+    // Phase times are cumulated over all the workers, and may exceed the
+    // wall clock time when running tests in parallel.
+    struct criterion_phase_times *t = &stats->phase_times;
+    criterion_pinfo(CRITERION_PREFIX_EQUALS,
+            _(msg_post_all_times),
+            stats->wall_time / 1e9,
+            t->startup / 1e9,
+            t->init / 1e9,
+            t->test / 1e9,
+            t->fini / 1e9,
+            t->exit / 1e9,
+            t->reap / 1e9);
+
+    if (criterion_options.summary == CR_SUMMARY_PERF)
+        print_perf_summary(stats);
+
+    if (criterion_options.logging_threshold > CRITERION_INFO)
+        return;
 
-    criterion_pimportant(CRITERION_PREFIX_EQUALS,
-            _(msg_post_all),
-                         CR_FG_BOLD,
-                         CR_FG_BLUE,  (unsigned long) tested, CR_FG_BOLD,
-                         CR_FG_GREEN, (unsigned long) stats->tests_passed, CR_FG_BOLD,
-                         CR_FG_RED,   (unsigned long) stats->tests_failed, CR_FG_BOLD,
-                         CR_FG_RED,   (unsigned long) stats->tests_crashed, CR_FG_BOLD,
-                         CR_RESET);
+    // the time spent by the runner on behalf of the tests
+    struct criterion_runner_counters *r = &stats->runner;
+    criterion_pinfo(CRITERION_PREFIX_EQUALS, _(msg_runner_events),
+            (unsigned long) r->events.calls,
+            r->events.time / 1e9);
+    criterion_pinfo(CRITERION_PREFIX_EQUALS, _(msg_runner_work),
+            (unsigned long) r->spawns.calls, r->spawns.time / 1e9,
+            (unsigned long) r->reads.calls, r->reads.time / 1e9,
+            (unsigned long) r->stats.calls, r->stats.time / 1e9,
+            (unsigned long) r->logs.calls, r->logs.time / 1e9);
+    criterion_pinfo(CRITERION_PREFIX_EQUALS, _(msg_runner_hooks),
+            (unsigned long) r->hooks.calls,
+            r->hooks.time / 1e9);
+    if (r->hook_waits.calls)
+        criterion_pinfo(CRITERION_PREFIX_EQUALS, _(msg_runner_hook_waits),
+                (unsigned long) r->hook_waits.calls,
+                r->hook_waits.time / 1e9);
+
+    print_top_resource_users(stats);
 }
 
 void normal_log_assert(struct criterion_assert_stats *stats) {
@@ -170,6 +657,14 @@ void normal_log_assert(struct criterion_assert_stats *stats) {
 }
 
 void normal_log_test_crash(struct criterion_test_stats *stats) {
+    if (stats->oom_killed) {
+        criterion_pimportant(CRITERION_PREFIX_FAIL, _(msg_test_oom),
+                stats->test->category,
+                stats->test->name,
+                stats->resource_usage.memory_peak / (1024. * 1024.));
+        return;
+    }
+
     bool sf = criterion_options.short_filename;
     criterion_pimportant(CRITERION_PREFIX_DASHES,
             _(msg_test_crash_line),
@@ -247,4 +742,5 @@ struct criterion_output_provider normal_logging = {
     .log_post_test      = normal_log_post_test,
     .log_post_suite     = normal_log_post_suite,
     .log_post_all       = normal_log_post_all,
+    .log_test_cancel    = normal_log_test_cancel,
 };
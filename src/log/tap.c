@@ -90,6 +90,12 @@ static void print_test_crashed(struct criterion_test_stats *stats) {
             stats->progress);
 }
 
+static void print_test_oom(struct criterion_test_stats *stats) {
+    criterion_important("not ok - %s::%s killed for exceeding its memory limit\n",
+            stats->test->category,
+            stats->test->name);
+}
+
 static void print_test_timeout(struct criterion_test_stats *stats) {
     criterion_important("not ok - %s::%s timed out (%3.2fs)\n",
             stats->test->category,
@@ -100,12 +106,19 @@ static void print_test_timeout(struct criterion_test_stats *stats) {
 static void print_test(struct criterion_test_stats *ts,
                        struct criterion_suite_stats *ss) {
 
-    if (is_disabled(ts->test, ss->suite)) {
+    if (ts->cancelled) {
+        criterion_important("ok - %s::%s %s # SKIP cancelled\n",
+                ts->test->category,
+                ts->test->name,
+                DEF(ts->test->data->description, ""));
+    } else if (is_disabled(ts->test, ss->suite)) {
         criterion_important("ok - %s::%s %s # SKIP %s is disabled\n",
                 ts->test->category,
                 ts->test->name,
                 DEF(ts->test->data->description, ""),
                 ts->test->data->disabled ? "test" : "suite");
+    } else if (ts->oom_killed) {
+        print_test_oom(ts);
     } else if (ts->crashed) {
         print_test_crashed(ts);
     } else if (ts->timed_out) {
@@ -77,6 +77,9 @@
 
 #define XML_TEST_SKIPPED "      <skipped/>\n"
 
+#define XML_TEST_CANCELLED \
+    "      <skipped message=\"The test was cancelled.\" />\n"
+
 #define LF "&#10;"
 
 #define XML_FAILURE_MSG_ENTRY \
@@ -91,6 +94,9 @@
 #define XML_CRASH_MSG_ENTRY \
     "      <error type=\"crash\" message=\"The test crashed.\" />"
 
+#define XML_OOM_MSG_ENTRY \
+    "      <error type=\"oom\" message=\"The test exceeded its memory limit.\" />"
+
 #define XML_TIMEOUT_MSG_ENTRY \
     "      <error type=\"timeout\" message=\"The test timed out.\" />"
 
@@ -103,7 +109,9 @@ const char *get_status_string(struct criterion_test_stats *ts,
                               struct criterion_suite_stats *ss) {
 
     const char *status = "PASSED";
-    if (ts->crashed || ts->timed_out)
+    if (ts->cancelled)
+        status = "CANCELLED";
+    else if (ts->crashed || ts->timed_out)
         status = "ERRORED";
     else if (ts->failed)
         status = "FAILED";
@@ -121,8 +129,12 @@ static void print_test(struct criterion_test_stats *ts,
             get_status_string(ts, ss)
         );
 
-    if (is_disabled(ts->test, ss->suite)) {
+    if (ts->cancelled) {
+        criterion_important(XML_TEST_CANCELLED);
+    } else if (is_disabled(ts->test, ss->suite)) {
         criterion_important(XML_TEST_SKIPPED);
+    } else if (ts->oom_killed) {
+        criterion_important(XML_OOM_MSG_ENTRY);
     } else if (ts->crashed) {
         criterion_important(XML_CRASH_MSG_ENTRY);
     } else if (ts->timed_out) {
@@ -171,7 +183,7 @@ void xml_log_post_all(struct criterion_global_stats *stats) {
                 ss->tests_failed,
                 ss->tests_crashed,
                 ss->tests_skipped,
-                ss->tests_skipped
+                ss->tests_skipped + ss->tests_cancelled
             );
 
         for (struct criterion_test_stats *ts = ss->tests; ts; ts = ts->next) {
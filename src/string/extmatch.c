@@ -21,7 +21,9 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  */
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <pcre.h>
 #include <setjmp.h>
@@ -29,6 +31,7 @@
 #include <stdio.h>
 #include "criterion/common.h"
 #include "common.h"
+#include "extmatch.h"
 
 struct context {
     int depth;
@@ -203,7 +206,7 @@ void transform_impl(struct context *ctx) {
     }
 }
 
-static int transform(const char *pattern, char *result, const char **errmsg) {
+static char *transform(const char *pattern, char *result, const char **errmsg) {
     jmp_buf jmp;
     struct context ctx = {
         .src = pattern,
@@ -212,13 +215,10 @@ static int transform(const char *pattern, char *result, const char **errmsg) {
         .jmp = &jmp,
     };
     if (!setjmp(*ctx.jmp)) {
-        copy_char(&ctx, '^');
         transform_impl(&ctx);
-        copy_char(&ctx, '$');
-        copy_char(&ctx, '\0');
-        return 0;
+        return ctx.dst;
     }
-    return -1;
+    return NULL;
 }
 
 /*
@@ -270,16 +270,181 @@ static inline size_t max_length(size_t len) {
     return 7 * len / 3 + 4;
 }
 
-int extmatch(const char *pattern, const char *string, const char **errmsg) {
-    char regex[max_length(strlen(pattern)) + 1];
-    if (transform(pattern, regex, errmsg) != -1) {
-        int erroffset;
-        pcre *preg = pcre_compile(regex, 0, errmsg, &erroffset, NULL);
-        if (preg) {
-            int res = pcre_exec(preg, NULL, string, strlen(string), 0, 0, NULL, 0);
-            pcre_free(preg);
-            return res;
+#ifdef PCRE_STUDY_JIT_COMPILE
+# define STUDY_OPTIONS PCRE_STUDY_JIT_COMPILE
+# define free_study pcre_free_study
+#else
+# define STUDY_OPTIONS 0
+# define free_study pcre_free
+#endif
+
+struct literal_prefix {
+    const char *str;
+    size_t len;
+    bool whole;
+};
+
+struct extmatch_matcher {
+    pcre *re;
+    pcre_extra *extra;
+
+    // the literal prefixes of the included patterns, if they all have one:
+    // a string that starts with none of them cannot match.
+    struct literal_prefix *prefixes;
+    size_t nb_prefixes;
+
+    // true if every included pattern is a plain string and nothing is
+    // excluded, in which case the regex is never compiled.
+    bool literal_only;
+};
+
+// Characters that either have a special meaning in a pattern, or are
+// passed as-is to the regex engine that gives them one.
+static const char special_chars[] = "*?[]+!@()|\\^${}";
+
+static size_t literal_prefix_length(const char *pattern) {
+    return strcspn(pattern, special_chars);
+}
+
+static void init_prefixes(struct extmatch_matcher *m,
+                          const char **include, size_t nb_include,
+                          size_t nb_exclude) {
+    if (!nb_include)
+        return;
+
+    struct literal_prefix *prefixes = malloc(sizeof (*prefixes) * nb_include);
+    bool all_whole = true;
+    for (size_t i = 0; i < nb_include; ++i) {
+        size_t len = literal_prefix_length(include[i]);
+        if (!len) {
+            free(prefixes);
+            return;
         }
+        bool whole = include[i][len] == '\0';
+        prefixes[i] = (struct literal_prefix) { include[i], len, whole };
+        all_whole = all_whole && whole;
     }
-    return -10;
+    m->prefixes = prefixes;
+    m->nb_prefixes = nb_include;
+    m->literal_only = all_whole && !nb_exclude;
+}
+
+static char *append(char *dst, const char *src) {
+    size_t len = strlen(src);
+    memcpy(dst, src, len + 1);
+    return dst + len;
+}
+
+// Appends the given patterns as an alternation of non-capturing groups
+static char *append_alternation(char *dst, const char **patterns, size_t nb,
+                                const char **errmsg) {
+    dst = append(dst, "(?:");
+    for (size_t i = 0; i < nb; ++i) {
+        if (i > 0)
+            *dst++ = '|';
+        dst = append(dst, "(?:");
+        dst = transform(patterns[i], dst, errmsg);
+        if (!dst)
+            return NULL;
+        *dst++ = ')';
+    }
+    *dst++ = ')';
+    return dst;
+}
+
+static char *build_regex(const char **include, size_t nb_include,
+                         const char **exclude, size_t nb_exclude,
+                         const char **errmsg) {
+    size_t size = sizeof ("^(?!$)$");
+    for (size_t i = 0; i < nb_include; ++i)
+        size += max_length(strlen(include[i])) + sizeof ("|(?:)");
+    for (size_t i = 0; i < nb_exclude; ++i)
+        size += max_length(strlen(exclude[i])) + sizeof ("|(?:)");
+    size += 2 * sizeof ("(?:)") + sizeof (".*");
+
+    char *regex = malloc(size);
+    char *dst = append(regex, "^");
+    if (nb_exclude) {
+        dst = append(dst, "(?!");
+        dst = append_alternation(dst, exclude, nb_exclude, errmsg);
+        if (!dst)
+            goto error;
+        dst = append(dst, "$)");
+    }
+    if (nb_include) {
+        dst = append_alternation(dst, include, nb_include, errmsg);
+        if (!dst)
+            goto error;
+    } else {
+        dst = append(dst, ".*");
+    }
+    append(dst, "$");
+    return regex;
+
+error:
+    free(regex);
+    return NULL;
+}
+
+struct extmatch_matcher *extmatch_compile(const char **include,
+                                          size_t nb_include,
+                                          const char **exclude,
+                                          size_t nb_exclude,
+                                          const char **errmsg) {
+    struct extmatch_matcher *m = calloc(1, sizeof (*m));
+    init_prefixes(m, include, nb_include, nb_exclude);
+    if (m->literal_only)
+        return m;
+
+    char *regex = build_regex(include, nb_include, exclude, nb_exclude, errmsg);
+    if (!regex)
+        goto error;
+
+    int erroffset;
+    m->re = pcre_compile(regex, 0, errmsg, &erroffset, NULL);
+    free(regex);
+    if (!m->re)
+        goto error;
+
+    // a NULL result without an error only means that there was nothing
+    // worth studying, which is fine.
+    const char *study_err = NULL;
+    m->extra = pcre_study(m->re, STUDY_OPTIONS, &study_err);
+    return m;
+
+error:
+    extmatch_free(m);
+    return NULL;
+}
+
+bool extmatch_matches(struct extmatch_matcher *m, const char *string) {
+    if (m->nb_prefixes) {
+        bool candidate = false;
+        for (size_t i = 0; i < m->nb_prefixes; ++i) {
+            struct literal_prefix *p = &m->prefixes[i];
+            if (strncmp(string, p->str, p->len))
+                continue;
+            if (!p->whole || string[p->len] == '\0')
+                candidate = true;
+            if (candidate)
+                break;
+        }
+        if (!candidate)
+            return false;
+        if (m->literal_only)
+            return true;
+    }
+    int len = (int) strlen(string);
+    return pcre_exec(m->re, m->extra, string, len, 0, 0, NULL, 0) >= 0;
+}
+
+void extmatch_free(struct extmatch_matcher *m) {
+    if (!m)
+        return;
+    if (m->extra)
+        free_study(m->extra);
+    if (m->re)
+        pcre_free(m->re);
+    free(m->prefixes);
+    free(m);
 }
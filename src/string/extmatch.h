@@ -24,6 +24,23 @@
 #ifndef EXTMATCH_H_
 # define EXTMATCH_H_
 
-int extmatch(const char *pattern, const char *string, const char **errmsg);
+# include <stdbool.h>
+# include <stddef.h>
+
+struct extmatch_matcher;
+
+/*
+ * Compiles a matcher accepting the strings that match any of the included
+ * patterns (or any string if there are none) but none of the excluded ones.
+ * The patterns must outlive the matcher. Returns NULL and sets errmsg if one
+ * of the patterns is malformed.
+ */
+struct extmatch_matcher *extmatch_compile(const char **include,
+                                          size_t nb_include,
+                                          const char **exclude,
+                                          size_t nb_exclude,
+                                          const char **errmsg);
+bool extmatch_matches(struct extmatch_matcher *m, const char *string);
+void extmatch_free(struct extmatch_matcher *m);
 
 #endif /* !EXTMATCH_H_ */
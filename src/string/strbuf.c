@@ -0,0 +1,104 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "strbuf.h"
+
+static void strbuf_reserve(struct strbuf *buf, size_t size) {
+    if (buf->size + size + 1 <= buf->capacity)
+        return;
+
+    size_t capacity = buf->capacity ? buf->capacity : 256;
+    while (capacity < buf->size + size + 1)
+        capacity *= 2;
+
+    char *str = realloc(buf->str, capacity);
+    if (!str)
+        abort();
+    buf->str = str;
+    buf->capacity = capacity;
+}
+
+void strbuf_append(struct strbuf *buf, const void *data, size_t size) {
+    strbuf_reserve(buf, size);
+    memcpy(buf->str + buf->size, data, size);
+    buf->size += size;
+    buf->str[buf->size] = '\0';
+}
+
+void strbuf_putc(struct strbuf *buf, char c) {
+    strbuf_append(buf, &c, 1);
+}
+
+void strbuf_puts(struct strbuf *buf, const char *str) {
+    strbuf_append(buf, str, strlen(str));
+}
+
+void strbuf_printf(struct strbuf *buf, const char *fmt, ...) {
+    va_list vl;
+    va_start(vl, fmt);
+    int size = vsnprintf(NULL, 0, fmt, vl);
+    va_end(vl);
+    if (size < 0)
+        return;
+
+    strbuf_reserve(buf, size);
+
+    va_start(vl, fmt);
+    vsnprintf(buf->str + buf->size, size + 1, fmt, vl);
+    va_end(vl);
+    buf->size += size;
+}
+
+void strbuf_put_json_string(struct strbuf *buf, const char *str) {
+    strbuf_putc(buf, '"');
+    for (const unsigned char *c = (const unsigned char *) str; c && *c; ++c) {
+        switch (*c) {
+            case '"':  strbuf_puts(buf, "\\\""); break;
+            case '\\': strbuf_puts(buf, "\\\\"); break;
+            case '\n': strbuf_puts(buf, "\\n"); break;
+            case '\r': strbuf_puts(buf, "\\r"); break;
+            case '\t': strbuf_puts(buf, "\\t"); break;
+            default:
+                if (*c < 0x20)
+                    strbuf_printf(buf, "\\u%04x", *c);
+                else
+                    strbuf_putc(buf, *c);
+        }
+    }
+    strbuf_putc(buf, '"');
+}
+
+void strbuf_clear(struct strbuf *buf) {
+    buf->size = 0;
+    if (buf->str)
+        buf->str[0] = '\0';
+}
+
+void strbuf_free(struct strbuf *buf) {
+    free(buf->str);
+    *buf = (struct strbuf) STRBUF_INIT;
+}
@@ -0,0 +1,51 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright © 2015 Franklin "Snaipe" Mathieu <http://snai.pe/>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef STRBUF_H_
+# define STRBUF_H_
+
+# include <stddef.h>
+# include "criterion/common.h"
+
+struct strbuf {
+    char *str;
+    size_t size;
+    size_t capacity;
+};
+
+# define STRBUF_INIT { NULL, 0, 0 }
+
+void strbuf_append(struct strbuf *buf, const void *data, size_t size);
+void strbuf_putc(struct strbuf *buf, char c);
+void strbuf_puts(struct strbuf *buf, const char *str);
+
+CR_FORMAT(printf, 2, 3)
+void strbuf_printf(struct strbuf *buf, const char *fmt, ...);
+
+// Appends `str` as a double-quoted JSON string literal
+void strbuf_put_json_string(struct strbuf *buf, const char *str);
+
+void strbuf_clear(struct strbuf *buf);
+void strbuf_free(struct strbuf *buf);
+
+#endif /* !STRBUF_H_ */
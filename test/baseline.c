@@ -0,0 +1,200 @@
+#include <stdio.h>
+
+#include "criterion/criterion.h"
+#include "criterion/options.h"
+#include "compat/process.h"
+#include "core/baseline.h"
+
+#define EPSILON 1e-9
+
+// Loads the given baseline through a file, as --bench-compare does
+static int load(const char *json) {
+    char path[64];
+    snprintf(path, sizeof (path), "baseline-%llu.json", get_process_id());
+
+    FILE *f = fopen(path, "w");
+    cr_assert_not_null(f);
+    fputs(json, f);
+    fclose(f);
+
+    int ok = baseline_load(path);
+    remove(path);
+    return ok;
+}
+
+static struct criterion_test test = { .name = "t", .category = "s" };
+
+static struct criterion_bench_stats compare(double *times, size_t samples,
+                                            bool *failed) {
+    struct criterion_bench_stats bench = {
+        .samples = samples,
+        .sample_times = times,
+    };
+    struct criterion_test_stats ts = { .test = &test, .bench = &bench };
+    baseline_compare(&ts);
+    if (failed)
+        *failed = ts.failed;
+    return bench;
+}
+
+#define BASELINE_10_17 "{\"version\":1,\"benchmarks\":[\n" \
+    "    {\"suite\":\"s\",\"name\":\"t\",\"iterations\":1,\"median\":13.5," \
+    "\"times\":[10,11,12,13,14,15,16,17]}\n]}\n"
+
+Test(baseline, identical_samples) {
+    cr_assert(load(BASELINE_10_17));
+    double times[] = { 10, 11, 12, 13, 14, 15, 16, 17 };
+
+    bool failed;
+    struct criterion_bench_stats bench = compare(times, 8, &failed);
+    struct criterion_bench_comparison *res = &bench.baseline;
+    cr_assert(res->compared);
+    cr_expect_float_eq(res->p_value, 1, EPSILON);
+    cr_expect_float_eq(res->change, 0, EPSILON);
+    cr_expect_lt(res->change_low, 0);
+    cr_expect_gt(res->change_high, 0);
+    cr_expect_not(res->regressed);
+    cr_expect_not(failed);
+    baseline_free();
+}
+
+Test(baseline, regression) {
+    criterion_options.bench_threshold = 0.05;
+    cr_assert(load(BASELINE_10_17));
+    double times[] = { 20, 21, 22, 23, 24, 25, 26, 27 };
+
+    bool failed;
+    struct criterion_bench_stats bench = compare(times, 8, &failed);
+    struct criterion_bench_comparison *res = &bench.baseline;
+    cr_assert(res->compared);
+    cr_expect_float_eq(res->p_value, 0.0009391056991171905, EPSILON);
+    cr_expect_float_eq(res->change, 0.7416467303484175, EPSILON);
+    cr_expect_float_eq(res->change_low, 0.47058823529411775, EPSILON);
+    cr_expect_float_eq(res->change_high, 1.0909090909090908, EPSILON);
+    cr_expect(res->regressed);
+    cr_expect(failed);
+    baseline_free();
+}
+
+Test(baseline, regression_under_threshold) {
+    criterion_options.bench_threshold = 1;
+    cr_assert(load(BASELINE_10_17));
+    double times[] = { 20, 21, 22, 23, 24, 25, 26, 27 };
+
+    bool failed;
+    struct criterion_bench_stats bench = compare(times, 8, &failed);
+    cr_expect_lt(bench.baseline.p_value, 0.05);
+    cr_expect_not(bench.baseline.regressed);
+    cr_expect_not(failed);
+    baseline_free();
+}
+
+Test(baseline, improvement) {
+    cr_assert(load("{\"benchmarks\":[{\"suite\":\"s\",\"name\":\"t\","
+            "\"times\":[20,21,22,23,24,25,26,27]}]}"));
+    double times[] = { 10, 11, 12, 13, 14, 15, 16, 17 };
+
+    bool failed;
+    struct criterion_bench_stats bench = compare(times, 8, &failed);
+    struct criterion_bench_comparison *res = &bench.baseline;
+    cr_expect_float_eq(res->p_value, 0.0009391056991171905, EPSILON);
+    cr_expect_float_eq(res->change, -0.42583074823678546, EPSILON);
+    cr_expect_float_eq(res->change_low, -0.5217391304347826, EPSILON);
+    cr_expect_float_eq(res->change_high, -0.32, EPSILON);
+    cr_expect_not(res->regressed);
+    cr_expect_not(failed);
+    baseline_free();
+}
+
+Test(baseline, ties_in_small_samples) {
+    cr_assert(load("{\"benchmarks\":[{\"suite\":\"s\",\"name\":\"t\","
+            "\"times\":[2,3,3,4]}]}"));
+    double times[] = { 1, 2, 2, 3 };
+
+    struct criterion_bench_stats bench = compare(times, 4, NULL);
+    struct criterion_bench_comparison *res = &bench.baseline;
+    cr_expect_float_eq(res->p_value, 0.17203370892182296, EPSILON);
+    cr_expect_float_eq(res->change, -1. / 3, EPSILON);
+    cr_expect_float_eq(res->change_low, -2. / 3, EPSILON);
+    cr_expect_float_eq(res->change_high, 0, EPSILON);
+    baseline_free();
+}
+
+Test(baseline, single_samples) {
+    cr_assert(load("{\"benchmarks\":[{\"suite\":\"s\",\"name\":\"t\","
+            "\"times\":[1]}]}"));
+
+    // too few samples to ever be significant
+    double slower[] = { 2 };
+    struct criterion_bench_stats bench = compare(slower, 1, NULL);
+    cr_expect_float_eq(bench.baseline.p_value, 1, EPSILON);
+    cr_expect_float_eq(bench.baseline.change, 1, EPSILON);
+    cr_expect_not(bench.baseline.regressed);
+
+    // all tied, without any variance left
+    double same[] = { 1 };
+    bench = compare(same, 1, NULL);
+    cr_expect_float_eq(bench.baseline.p_value, 1, EPSILON);
+    cr_expect_float_eq(bench.baseline.change, 0, EPSILON);
+    baseline_free();
+}
+
+Test(baseline, not_compared) {
+    cr_assert(load("{\"benchmarks\":[{\"suite\":\"s\",\"name\":\"other\","
+            "\"times\":[1,2,3]},{\"suite\":\"s\",\"name\":\"t\","
+            "\"times\":[]}]}"));
+    double times[] = { 1, 2, 3 };
+
+    // the entry of the test has no samples to compare with
+    struct criterion_bench_stats bench = compare(times, 3, NULL);
+    cr_expect_not(bench.baseline.compared);
+    baseline_free();
+
+    cr_assert(load("{}"));
+    bench = compare(times, 3, NULL);
+    cr_expect_not(bench.baseline.compared);
+    baseline_free();
+}
+
+Test(baseline, skips_unknown_members) {
+    cr_assert(load(" {\"version\" : 2, \"host\": {\"cpus\": [1, 2.5e1, -3],"
+            " \"smt\": true, \"gov\": null, \"name\": \"a\\\"b\"},\n"
+            "\"benchmarks\": [ {\"suite\": \"\\u0073\", \"extra\": [[], {}],"
+            " \"name\": \"\\t\", \"times\": [ 1.5 , 2.5 ]},\n"
+            "{\"name\": \"t\", \"times\": [1e1], \"suite\": \"s\"} ],"
+            " \"trailer\": false }\n"));
+    double times[] = { 10 };
+    struct criterion_bench_stats bench = compare(times, 1, NULL);
+    cr_expect(bench.baseline.compared);
+    cr_expect_float_eq(bench.baseline.change, 0, EPSILON);
+    baseline_free();
+}
+
+Test(baseline, rejects_malformed_input) {
+    static const char *const inputs[] = {
+        "",
+        "[]",
+        "{\"benchmarks\":",
+        "{\"benchmarks\":[{\"suite\":\"s\",\"name\":\"t\"",
+        "{\"benchmarks\":[{\"suite\":\"s\",\"name\":\"t\",\"times\":[1,]}]}",
+        "{\"benchmarks\":[{\"suite\":\"s\",\"name\":\"t\",\"times\":[a]}]}",
+        "{\"benchmarks\":[{\"name\":\"t\",\"times\":[1]}]}",
+        "{\"benchmarks\":[{}]}",
+        "{\"benchmarks\":[{\"suite\":\"s\",\"name\":\"t\\u00\"}]}",
+        "{\"benchmarks\":[{\"suite\":\"s\",\"name\":\"t\",\"times\":[1]},]}",
+        "{\"version\":1 \"benchmarks\":[]}",
+        "{\"x\":{\"y\":[1,2}}",
+    };
+    double times[] = { 1 };
+    for (size_t i = 0; i < sizeof (inputs) / sizeof (*inputs); ++i) {
+        cr_expect_not(load(inputs[i]), "Loaded `%s`.", inputs[i]);
+
+        // nothing read before the error is kept
+        struct criterion_bench_stats bench = compare(times, 1, NULL);
+        cr_expect_not(bench.baseline.compared, "Kept `%s`.", inputs[i]);
+    }
+}
+
+Test(baseline, missing_file) {
+    cr_expect_not(baseline_load("baseline-missing_file.json"));
+}
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <csptr/smalloc.h>
+
+#include "criterion/bench.h"
+#include "compat/pipe-internal.h"
+#include "io/event.h"
+
+// The events of 10000 tests, as a worker would have sent them
+#define NB_TESTS 10000
+#define EVENTS_PER_TEST 5
+
+static unsigned char *stream;
+static size_t stream_size;
+
+static void push_frame(int kind, const void *payload, size_t size) {
+    struct event_header header;
+    event_header_init(&header, kind, 4242, size);
+
+    stream = realloc(stream, stream_size + sizeof (header) + size);
+    memcpy(stream + stream_size, &header, sizeof (header));
+    memcpy(stream + stream_size + sizeof (header), payload, size);
+    stream_size += sizeof (header) + size;
+}
+
+static void push_assert(const char *msg, const char *file) {
+    size_t msg_len = strlen(msg) + 1;
+    size_t file_len = strlen(file) + 1;
+    size_t size = sizeof (struct criterion_assert_stats)
+        + 2 * sizeof (size_t) + msg_len + file_len;
+
+    unsigned char *buf = calloc(1, size);
+    unsigned char *ptr = buf + sizeof (struct criterion_assert_stats);
+    memcpy(ptr, &msg_len, sizeof (size_t));     ptr += sizeof (size_t);
+    memcpy(ptr, msg, msg_len);                  ptr += msg_len;
+    memcpy(ptr, &file_len, sizeof (size_t));    ptr += sizeof (size_t);
+    memcpy(ptr, file, file_len);
+
+    push_frame(ASSERT, buf, size);
+    free(buf);
+}
+
+void generate_stream(void) {
+    for (size_t i = 0; i < NB_TESTS; ++i) {
+        push_frame(PRE_INIT, NULL, 0);
+        push_frame(PRE_TEST, NULL, 0);
+        push_assert("The expression (a) == (b) is false.", "test/sample.c");
+
+        struct post_test_data data = { .elapsed_time = 0.001 };
+        push_frame(POST_TEST, &data, sizeof (data));
+
+        struct worker_status status = { .status = { .kind = EXIT_STATUS } };
+        push_frame(WORKER_TERMINATED, &status, sizeof (status));
+    }
+}
+
+void free_stream(void) {
+    free(stream);
+    stream = NULL;
+    stream_size = 0;
+}
+
+TestSuite(event, .init = generate_stream, .fini = free_stream);
+
+Bench(event, decode) {
+    cr_bench_throughput(CR_BENCH_BYTES, stream_size);
+    cr_bench_loop() {
+        size_t off = 0, events = 0;
+        struct event *ev;
+        size_t consumed;
+        while (event_decode(stream + off, stream_size - off,
+                    &consumed, &ev) == 1) {
+            off += consumed;
+            ++events;
+            sfree(ev);
+        }
+        cr_assert_eq(events, NB_TESTS * EVENTS_PER_TEST);
+    }
+}
+
+#ifndef _WIN32
+# include <unistd.h>
+
+// Goes through a file, whose reads are cut at arbitrary frame offsets
+Bench(event, reader) {
+    FILE *f = tmpfile();
+    cr_assert(f);
+    fwrite(stream, 1, stream_size, f);
+    fflush(f);
+
+    s_pipe_file_handle handle = { .fd = fileno(f) };
+    struct event_reader *reader = event_reader_new(&handle);
+
+    cr_bench_throughput(CR_BENCH_BYTES, stream_size);
+    cr_bench_loop() {
+        lseek(handle.fd, 0, SEEK_SET);
+        size_t events = 0;
+        struct event *ev;
+        while ((ev = event_reader_next(reader))) {
+            ++events;
+            sfree(ev);
+        }
+        cr_assert_eq(events, NB_TESTS * EVENTS_PER_TEST);
+    }
+    sfree(reader);
+    fclose(f);
+}
+#endif
+
+/*
+ * Flips random bytes of the stream and cuts it short: the decoder has to
+ * reject or accept every frame without crashing or reading past the end.
+ */
+Bench(event, fuzz) {
+    // a few tests are plenty, as every iteration mutates the stream anew
+    size_t size = stream_size / NB_TESTS * 4;
+    unsigned char *buf = malloc(size);
+    srand(42);
+
+    cr_bench_throughput(CR_BENCH_BYTES, size);
+    cr_bench_loop() {
+        memcpy(buf, stream, size);
+        for (size_t i = 0; i < 8; ++i)
+            buf[rand() % size] ^= 1 << (rand() % 8);
+        size_t end = size - rand() % 64;
+
+        size_t off = 0;
+        struct event *ev;
+        size_t consumed;
+        int res;
+        while ((res = event_decode(buf + off, end - off, &consumed, &ev)) == 1) {
+            cr_assert_leq(consumed, end - off);
+            off += consumed;
+            sfree(ev);
+        }
+        cr_assert(res == 0 || res == -1);
+    }
+    free(buf);
+}
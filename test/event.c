@@ -0,0 +1,332 @@
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <csptr/smalloc.h>
+
+#include "criterion/criterion.h"
+#include "compat/pipe-internal.h"
+#include "io/event.h"
+
+struct frames {
+    unsigned char *buf;
+    size_t size;
+};
+
+static void push_frame(struct frames *f, int kind, unsigned long long pid,
+                       int flags, const void *payload, size_t size) {
+    struct event_header header;
+    event_header_init(&header, kind, pid, size);
+    header.flags = flags;
+
+    f->buf = realloc(f->buf, f->size + sizeof (header) + size);
+    memcpy(f->buf + f->size, &header, sizeof (header));
+    memcpy(f->buf + f->size + sizeof (header), payload, size);
+    f->size += sizeof (header) + size;
+}
+
+// The payload of an ASSERT event, as criterion_send_event lays it out
+static unsigned char *assert_payload(const char *msg, const char *file,
+                                     size_t *size) {
+    size_t msg_len = strlen(msg) + 1;
+    size_t file_len = strlen(file) + 1;
+    *size = sizeof (struct criterion_assert_stats)
+        + 2 * sizeof (size_t) + msg_len + file_len;
+
+    unsigned char *buf = calloc(1, *size);
+    unsigned char *ptr = buf + sizeof (struct criterion_assert_stats);
+    memcpy(ptr, &msg_len, sizeof (size_t));     ptr += sizeof (size_t);
+    memcpy(ptr, msg, msg_len);                  ptr += msg_len;
+    memcpy(ptr, &file_len, sizeof (size_t));    ptr += sizeof (size_t);
+    memcpy(ptr, file, file_len);
+    return buf;
+}
+
+static void push_assert(struct frames *f, unsigned long long pid,
+                        const char *msg) {
+    size_t size;
+    unsigned char *payload = assert_payload(msg, "test/event.c", &size);
+    push_frame(f, ASSERT, pid, 0, payload, size);
+    free(payload);
+}
+
+static void expect_assert(struct event *ev, unsigned long long pid,
+                          const char *msg) {
+    cr_assert_not_null(ev);
+    cr_expect_eq(ev->kind, ASSERT);
+    cr_expect_eq(ev->pid, pid);
+    struct criterion_assert_stats *stats = ev->data;
+    cr_expect_str_eq(stats->message, msg);
+    cr_expect_str_eq(stats->file, "test/event.c");
+}
+
+Test(event, decode_incomplete) {
+    struct frames f = { NULL, 0 };
+    push_assert(&f, 42, "message");
+
+    struct event *ev;
+    size_t consumed;
+    cr_expect_eq(event_decode(f.buf, sizeof (struct event_header) - 1,
+                &consumed, &ev), 0);
+    cr_expect_eq(event_decode(f.buf, f.size - 1, &consumed, &ev), 0);
+    cr_assert_eq(event_decode(f.buf, f.size, &consumed, &ev), 1);
+    cr_expect_eq(consumed, f.size);
+    expect_assert(ev, 42, "message");
+    sfree(ev);
+    free(f.buf);
+}
+
+Test(event, decode_rejects_invalid) {
+    struct frames f = { NULL, 0 };
+    push_frame(&f, PRE_INIT, 42, 0, NULL, 0);
+
+    struct event *ev;
+    size_t consumed;
+    struct event_header *header = (struct event_header *) f.buf;
+
+    header->magic ^= 1;
+    cr_expect_eq(event_decode(f.buf, f.size, &consumed, &ev), -1);
+    header->magic ^= 1;
+
+    header->size = EVENT_MAX_PAYLOAD + 1;
+    cr_expect_eq(event_decode(f.buf, f.size, &consumed, &ev), -1);
+    header->size = 0;
+
+    // the reader puts fragments back together, never the decoder
+    header->flags = EVENT_MORE;
+    cr_expect_eq(event_decode(f.buf, f.size, &consumed, &ev), -1);
+    free(f.buf);
+}
+
+#ifndef _WIN32
+# include <unistd.h>
+# include <sys/wait.h>
+
+struct reader_pipe {
+    int fds[2];
+    s_pipe_file_handle in;
+    struct event_reader *reader;
+};
+
+static void open_reader(struct reader_pipe *p) {
+    cr_assert_eq(pipe(p->fds), 0);
+    p->in = (s_pipe_file_handle) { .fd = p->fds[0] };
+    p->reader = event_reader_new(&p->in);
+}
+
+static void close_reader(struct reader_pipe *p) {
+    sfree(p->reader);
+    close(p->fds[0]);
+}
+
+// Writes the frames all at once, and closes the pipe behind them
+static void write_frames(struct reader_pipe *p, struct frames *f) {
+    cr_assert_eq(write(p->fds[1], f->buf, f->size), (ssize_t) f->size);
+    close(p->fds[1]);
+    free(f->buf);
+}
+
+Test(event, reader_short_reads) {
+    struct frames f = { NULL, 0 };
+    push_frame(&f, PRE_INIT, 42, 0, NULL, 0);
+    push_assert(&f, 42, "first");
+    push_assert(&f, 42, "second");
+    struct post_test_data data = { .elapsed_time = 1 };
+    push_frame(&f, POST_TEST, 42, 0, &data, sizeof (data));
+
+    struct reader_pipe p;
+    open_reader(&p);
+
+    // a byte at a time, so that the headers arrive split across reads; the
+    // child must not assert anything, as it would report to the runner
+    pid_t pid = fork();
+    if (!pid) {
+        close(p.fds[0]);
+        for (size_t i = 0; i < f.size; ++i) {
+            if (write(p.fds[1], f.buf + i, 1) != 1)
+                _exit(1);
+            if (i % 7 == 0)
+                usleep(100);
+        }
+        _exit(0);
+    }
+    cr_assert_neq(pid, -1);
+    close(p.fds[1]);
+    free(f.buf);
+
+    struct event *ev = event_reader_next(p.reader);
+    cr_assert_not_null(ev);
+    cr_expect_eq(ev->kind, PRE_INIT);
+    sfree(ev);
+
+    ev = event_reader_next(p.reader);
+    expect_assert(ev, 42, "first");
+    sfree(ev);
+
+    ev = event_reader_next(p.reader);
+    expect_assert(ev, 42, "second");
+    sfree(ev);
+
+    ev = event_reader_next(p.reader);
+    cr_assert_not_null(ev);
+    cr_expect_eq(ev->kind, POST_TEST);
+    cr_expect_eq(((struct post_test_data *) ev->data)->elapsed_time, 1);
+    sfree(ev);
+
+    cr_expect_null(event_reader_next(p.reader));
+    close_reader(&p);
+
+    int status;
+    cr_assert_eq(waitpid(pid, &status, 0), pid);
+    cr_expect(WIFEXITED(status) && !WEXITSTATUS(status));
+}
+
+Test(event, reader_fragments) {
+    // two sources whose fragments interleave, as concurrent writers' would
+    char long_msg[3 * EVENT_ATOMIC_WRITE];
+    memset(long_msg, 'a', sizeof (long_msg) - 1);
+    long_msg[sizeof (long_msg) - 1] = '\0';
+
+    size_t size;
+    unsigned char *payload = assert_payload(long_msg, "test/event.c", &size);
+    size_t half = size / 2;
+
+    struct frames f = { NULL, 0 };
+    push_frame(&f, ASSERT, 1, EVENT_MORE, payload, half);
+    push_frame(&f, ASSERT, 2, EVENT_MORE, payload, half);
+    push_frame(&f, PRE_TEST, 3, 0, NULL, 0);
+    push_frame(&f, ASSERT, 2, 0, payload + half, size - half);
+    push_frame(&f, ASSERT, 1, 0, payload + half, size - half);
+    free(payload);
+
+    struct reader_pipe p;
+    open_reader(&p);
+    write_frames(&p, &f);
+
+    struct event *ev = event_reader_next(p.reader);
+    cr_assert_not_null(ev);
+    cr_expect_eq(ev->kind, PRE_TEST);
+    sfree(ev);
+
+    ev = event_reader_next(p.reader);
+    expect_assert(ev, 2, long_msg);
+    sfree(ev);
+
+    ev = event_reader_next(p.reader);
+    expect_assert(ev, 1, long_msg);
+    sfree(ev);
+
+    cr_expect_null(event_reader_next(p.reader));
+    close_reader(&p);
+}
+
+Test(event, reader_drops_fragments_of_dead_source) {
+    size_t size;
+    unsigned char *payload = assert_payload("message", "test/event.c", &size);
+
+    struct frames f = { NULL, 0 };
+    push_frame(&f, ASSERT, 1, EVENT_MORE, payload, size / 2);
+    struct worker_status status = { .status = { .kind = SIGNAL } };
+    push_frame(&f, WORKER_TERMINATED, 1, 0, &status, sizeof (status));
+    push_frame(&f, PRE_INIT, 1, 0, NULL, 0);
+    free(payload);
+
+    struct reader_pipe p;
+    open_reader(&p);
+    write_frames(&p, &f);
+
+    struct event *ev = event_reader_next(p.reader);
+    cr_assert_not_null(ev);
+    cr_expect_eq(ev->kind, WORKER_TERMINATED);
+    sfree(ev);
+
+    ev = event_reader_next(p.reader);
+    cr_assert_not_null(ev);
+    cr_expect_eq(ev->kind, PRE_INIT);
+    sfree(ev);
+    close_reader(&p);
+}
+
+Test(event, send_fragments) {
+    char long_msg[2 * EVENT_ATOMIC_WRITE];
+    memset(long_msg, 'b', sizeof (long_msg) - 1);
+    long_msg[sizeof (long_msg) - 1] = '\0';
+
+    struct reader_pipe p;
+    open_reader(&p);
+
+    s_pipe_file_handle out = { .fd = p.fds[1] };
+    s_pipe_file_handle *worker_pipe = g_event_pipe;
+    g_event_pipe = &out;
+
+    // the message follows the statistics, as the assertion macros put it
+    size_t msg_len = sizeof (long_msg);
+    size_t size = sizeof (struct criterion_assert_stats)
+        + sizeof (size_t) + msg_len;
+    unsigned char *data = calloc(1, size);
+    ((struct criterion_assert_stats *) data)->file = "test/event.c";
+    memcpy(data + sizeof (struct criterion_assert_stats), &msg_len,
+            sizeof (size_t));
+    memcpy(data + size - msg_len, long_msg, msg_len);
+    criterion_send_event(ASSERT, data, size);
+    free(data);
+
+    // every fragment fits in a write that the pipe keeps whole
+    char buf[4 * EVENT_ATOMIC_WRITE];
+    ssize_t len = read(p.fds[0], buf, sizeof (buf));
+    g_event_pipe = worker_pipe;
+    close(p.fds[1]);
+
+    cr_assert_gt(len, 0);
+    size_t fragments = 0;
+    for (ssize_t off = 0; off < len; ++fragments) {
+        struct event_header header;
+        memcpy(&header, buf + off, sizeof (header));
+        cr_assert_leq(sizeof (header) + header.size, EVENT_ATOMIC_WRITE);
+        off += sizeof (header) + header.size;
+    }
+    cr_expect_gt(fragments, 1);
+
+    // feed them back to a reader
+    int fds[2];
+    cr_assert_eq(pipe(fds), 0);
+    cr_assert_eq(write(fds[1], buf, len), len);
+    close(fds[1]);
+    close_reader(&p);
+
+    s_pipe_file_handle in = { .fd = fds[0] };
+    struct event_reader *reader = event_reader_new(&in);
+    struct event *ev = event_reader_next(reader);
+    cr_assert_not_null(ev);
+    cr_expect_eq(ev->kind, ASSERT);
+    cr_expect_str_eq(((struct criterion_assert_stats *) ev->data)->message,
+            long_msg);
+    sfree(ev);
+    sfree(reader);
+    close(fds[0]);
+}
+
+Test(event, reader_rejects_bad_magic, .signal = SIGABRT) {
+    struct frames f = { NULL, 0 };
+    push_frame(&f, PRE_INIT, 42, 0, NULL, 0);
+    ((struct event_header *) f.buf)->magic ^= 1;
+
+    // the payload is not waited for: the header alone is enough
+    struct reader_pipe p;
+    open_reader(&p);
+    cr_assert_eq(write(p.fds[1], f.buf, f.size), (ssize_t) f.size);
+    free(f.buf);
+    event_reader_next(p.reader);
+}
+
+Test(event, reader_rejects_oversized, .signal = SIGABRT) {
+    struct frames f = { NULL, 0 };
+    push_frame(&f, PRE_INIT, 42, 0, NULL, 0);
+    ((struct event_header *) f.buf)->size = EVENT_MAX_PAYLOAD + 1;
+
+    struct reader_pipe p;
+    open_reader(&p);
+    cr_assert_eq(write(p.fds[1], f.buf, f.size), (ssize_t) f.size);
+    free(f.buf);
+    event_reader_next(p.reader);
+}
+#endif
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "criterion/bench.h"
+#include "string/extmatch.h"
+
+// 1000 suites of 1000 tests each, named like the test identifiers
+#define NB_SUITES 1000
+#define NB_TESTS  1000
+#define NB_IDENTIFIERS (NB_SUITES * NB_TESTS)
+
+static char *identifiers;
+
+static const char *identifier(size_t i) {
+    return identifiers + i * 32;
+}
+
+void generate_identifiers(void) {
+    identifiers = malloc(NB_IDENTIFIERS * 32);
+    for (size_t i = 0; i < NB_IDENTIFIERS; ++i)
+        snprintf(identifiers + i * 32, 32, "suite_%zu/test_%zu",
+                i / NB_TESTS, i % NB_TESTS);
+}
+
+void free_identifiers(void) {
+    free(identifiers);
+}
+
+TestSuite(extmatch, .init = generate_identifiers, .fini = free_identifiers);
+
+static void bench_filter(const char **include, size_t nb_include,
+                         const char **exclude, size_t nb_exclude) {
+    const char *errmsg;
+    struct extmatch_matcher *m = extmatch_compile(include, nb_include,
+            exclude, nb_exclude, &errmsg);
+    cr_assert(m, "pattern error: %s", errmsg);
+
+    cr_bench_throughput(CR_BENCH_ITEMS, NB_IDENTIFIERS);
+    cr_bench_loop() {
+        size_t matched = 0;
+        for (size_t i = 0; i < NB_IDENTIFIERS; ++i)
+            matched += extmatch_matches(m, identifier(i));
+        cr_do_not_optimize(matched);
+    }
+    extmatch_free(m);
+}
+
+Bench(extmatch, literal) {
+    const char *include[] = { "suite_500/test_500" };
+    bench_filter(include, 1, NULL, 0);
+}
+
+Bench(extmatch, prefix) {
+    const char *include[] = { "suite_42/*" };
+    bench_filter(include, 1, NULL, 0);
+}
+
+Bench(extmatch, glob) {
+    const char *include[] = { "*/test_?7" };
+    bench_filter(include, 1, NULL, 0);
+}
+
+Bench(extmatch, include_exclude) {
+    const char *include[] = { "suite_1*/*", "suite_2*/*" };
+    const char *exclude[] = { "*/test_@(1|2)*", "!(*_0)/test_999" };
+    bench_filter(include, 2, exclude, 2);
+}
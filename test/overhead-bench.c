@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "criterion/bench.h"
+
+/*
+ * Runs the synthetic tests of overhead.c in a child runner, each iteration
+ * being a whole run, so that the time per item is the cost of a test. The
+ * JSON output of the last run of each benchmark is kept as
+ * overhead-<name>.json: its summary holds the counters of the runner, to
+ * tell the spawns, pipe reads, stats and logging apart.
+ */
+#ifndef _WIN32
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/wait.h>
+
+# define NB_TESTS 1000
+# define NB_PARAMS 2000
+# define NB_HEAP_TESTS 40
+
+static void run_overhead(const char *binary, const char *name,
+                         const char *jobs, const char *extra) {
+    char path[4096], output[256];
+    snprintf(path, sizeof (path), "%s/%s", OVERHEAD_DIR, binary);
+    snprintf(output, sizeof (output), "--output=json:overhead-%s.json", name);
+
+    // the child must not assert anything, as it would report to the runner
+    pid_t pid = fork();
+    if (!pid) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execl(path, binary, jobs, output, extra, (char *) NULL);
+        _exit(127);
+    }
+    cr_assert_neq(pid, -1);
+
+    int status;
+    cr_assert_eq(waitpid(pid, &status, 0), pid);
+    cr_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+            "%s did not run successfully", binary);
+}
+
+# define OVERHEAD_BENCH(Name, Binary, Items, Jobs, Extra)                     \
+    Bench(overhead, Name) {                                                    \
+        cr_bench_throughput(CR_BENCH_ITEMS, Items);                            \
+        cr_bench_loop() {                                                      \
+            run_overhead(Binary, #Name, "--jobs=" #Jobs, Extra);               \
+        }                                                                      \
+    }
+
+OVERHEAD_BENCH(empty_j1, "overhead_empty", NB_TESTS, 1, NULL)
+OVERHEAD_BENCH(empty_j4, "overhead_empty", NB_TESTS, 4, NULL)
+OVERHEAD_BENCH(empty_jauto, "overhead_empty", NB_TESTS, auto, NULL)
+OVERHEAD_BENCH(asserts_j1, "overhead_asserts", NB_TESTS, 1, NULL)
+OVERHEAD_BENCH(asserts_j4, "overhead_asserts", NB_TESTS, 4, NULL)
+OVERHEAD_BENCH(params_j4, "overhead_params", NB_PARAMS, 4, NULL)
+OVERHEAD_BENCH(logs_j4, "overhead_logs", NB_TESTS, 4, "--verbose")
+
+// a 2 GB runner, whose workers are forked from the zygote, a copy of it,
+// or spawned afresh
+OVERHEAD_BENCH(heap_forked_j1, "overhead_heap", NB_HEAP_TESTS, 1, NULL)
+OVERHEAD_BENCH(heap_spawned_j1, "overhead_heap", NB_HEAP_TESTS, 1,
+        "--spawn-workers")
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Synthetic tests for the framework overhead benchmarks: their bodies do
+ * next to nothing, so that running them measures Criterion itself. Each
+ * flavour is built from this file with its own definitions.
+ */
+#include "criterion/criterion.h"
+#include "criterion/parameterized.h"
+#include "criterion/logging.h"
+
+#ifndef OVERHEAD_ASSERTS
+# define OVERHEAD_ASSERTS 0
+#endif
+
+#ifndef OVERHEAD_LOG_LINES
+# define OVERHEAD_LOG_LINES 0
+#endif
+
+#ifdef OVERHEAD_HEAP_MB
+# include <stdlib.h>
+# include <string.h>
+
+/*
+ * Grows the heap of the runner before it starts any worker, so that forking
+ * the workers copies its page tables. The spawned workers resume within
+ * criterion_initialize and never get there.
+ */
+int main(int argc, char *argv[]) {
+    struct criterion_test_set *tests = criterion_initialize();
+
+    size_t size = (size_t) OVERHEAD_HEAP_MB << 20;
+    char *heap = malloc(size);
+    memset(heap, 1, size);
+
+    int result = 0;
+    if (criterion_handle_args(argc, argv, true))
+        result = !criterion_run_all_tests(tests);
+
+    criterion_finalize(tests);
+    free(heap);
+    return result;
+}
+#endif
+
+#ifdef OVERHEAD_PARAMS
+ParameterizedTestParameters(overhead, params) {
+    static int params[OVERHEAD_PARAMS];
+    return cr_make_param_array(int, params, OVERHEAD_PARAMS);
+}
+
+ParameterizedTest(int *param, overhead, params) {
+    cr_assert_eq(*param, 0);
+}
+#else
+static void body(void) {
+    for (int i = 0; i < OVERHEAD_ASSERTS; ++i)
+        cr_assert(1);
+    for (int i = 0; i < OVERHEAD_LOG_LINES; ++i)
+        criterion_info("Line %d of the output of an overhead test\n", i);
+}
+
+// 1000 tests, named t_000 to t_999, or 40 along with a large heap
+# define TEST(Id) Test(overhead, t ## Id) { body(); }
+# define TESTS_10(Id) TEST(Id ## 0) TEST(Id ## 1) TEST(Id ## 2)               \
+    TEST(Id ## 3) TEST(Id ## 4) TEST(Id ## 5) TEST(Id ## 6) TEST(Id ## 7)      \
+    TEST(Id ## 8) TEST(Id ## 9)
+# define TESTS_100(Id) TESTS_10(Id ## 0) TESTS_10(Id ## 1) TESTS_10(Id ## 2)   \
+    TESTS_10(Id ## 3) TESTS_10(Id ## 4) TESTS_10(Id ## 5) TESTS_10(Id ## 6)    \
+    TESTS_10(Id ## 7) TESTS_10(Id ## 8) TESTS_10(Id ## 9)
+# define TESTS_1000(Id) TESTS_100(Id ## 0) TESTS_100(Id ## 1)                  \
+    TESTS_100(Id ## 2) TESTS_100(Id ## 3) TESTS_100(Id ## 4)                   \
+    TESTS_100(Id ## 5) TESTS_100(Id ## 6) TESTS_100(Id ## 7)                   \
+    TESTS_100(Id ## 8) TESTS_100(Id ## 9)
+
+# ifdef OVERHEAD_HEAP_MB
+TESTS_10(_0) TESTS_10(_1) TESTS_10(_2) TESTS_10(_3)
+# else
+TESTS_1000(_)
+# endif
+#endif
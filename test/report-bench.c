@@ -0,0 +1,40 @@
+#include "criterion/bench.h"
+#include "core/report.h"
+
+#define NB_EVENTS 1000000
+
+static size_t calls;
+
+static void count_calls(void *data, void *userdata) {
+    (void) data;
+    ++*(size_t *) userdata;
+}
+
+static void register_hook(void) {
+    report_init();
+    criterion_register_hook(THEORY_FAIL, count_calls, &calls);
+}
+
+static void unregister_hook(void) {
+    criterion_unregister_hook(THEORY_FAIL, count_calls, &calls);
+}
+
+TestSuite(report, .init = register_hook, .fini = unregister_hook);
+
+// No hook is declared for the assertions
+Bench(report, empty) {
+    cr_bench_throughput(CR_BENCH_ITEMS, NB_EVENTS);
+    cr_bench_loop() {
+        for (size_t i = 0; i < NB_EVENTS; ++i)
+            report(ASSERT, &i);
+    }
+}
+
+Bench(report, registered) {
+    cr_bench_throughput(CR_BENCH_ITEMS, NB_EVENTS);
+    cr_bench_loop() {
+        for (size_t i = 0; i < NB_EVENTS; ++i)
+            report(THEORY_FAIL, &i);
+    }
+    cr_assert(calls > 0);
+}